@@ -0,0 +1,357 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unordered_set>
+#include <vector>
+#include "Abbreviations.hpp"
+#include "MappedFile.hpp"
+
+// Layout of a table in native byte order: the header, one displacement per
+// bucket, the slots and the pool of the keys and abbreviations. A key hashes
+// to a bucket, the displacement of the bucket moves every key of the bucket
+// to a slot of its own (hash and displace).
+static const char magic[8] = {'b', 'i', 'b', 'f', 'p', 'h', 'f', '1'};
+
+struct table_header {
+  char magic[8];
+  uint64_t size;    // size and modification time of the dictionary
+  int64_t mtime;
+  uint32_t buckets;
+  uint32_t slots;
+  uint32_t pool;
+  uint32_t reserved;
+};
+
+struct table_slot {
+  uint32_t key;     // offset of the normalized key in the pool
+  uint32_t abbrev;  // offset of the abbreviation in the pool
+  uint16_t key_len; // 0 for an empty slot
+  uint16_t abbrev_len;
+};
+
+static_assert(sizeof(table_header) == 40 && sizeof(table_slot) == 12,
+    "unexpected padding in the table layout");
+
+
+// Byte of the normalized key for every byte of a name, 0 if it is left out:
+// ASCII letters in lower case, digits and other bytes >= 0x80. A backslash
+// and '&' are marked by 1.
+static const std::array<char, 256> folded = [] {
+    std::array<char, 256> t{};
+    for (int c = 0; c < 256; ++c)
+      if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c >= 0x80)
+        t[c] = char(c);
+      else if (c >= 'A' && c <= 'Z')
+        t[c] = char(c - 'A' + 'a');
+    t['\\'] = t['&'] = 1;
+    return t;
+  }();
+
+
+// Write the normalized key of 'name' to 'out', which has room for
+// 3*name.size() bytes, and return its length. Spaces, punctuation, braces and
+// LaTeX commands are left out, accents leave the letter they apply to and '&'
+// becomes "and".
+static size_t normalize(std::string_view name, char *out)
+{
+  size_t len = 0;
+  for (size_t i = 0; i < name.size(); ++i) {
+    char f = folded[static_cast<unsigned char>(name[i])];
+    if (f != 1) {
+      // without a branch, most names alternate between letters and spaces
+      out[len] = f;
+      len += (f != 0);
+    }
+    else if (name[i] == '&') {
+      std::memcpy(out+len, "and", 3);
+      len += 3;
+    }
+    else if (i+1 < name.size() && name[i+1] != '&') {
+      // a command is a backslash followed by letters or by one other
+      // character
+      size_t end = i+1;
+      while (end < name.size() &&
+          std::isalpha(static_cast<unsigned char>(name[end])))
+        ++end;
+      i = (end == i+1) ? i+1 : end-1;
+    }
+  }
+  return len;
+}
+
+
+// Mixes 'x' into a well distributed 64 bit value (splitmix64)
+static uint64_t mix(uint64_t x)
+{
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+
+// Hash of the normalized 'key', eight bytes at a time
+static uint64_t key_hash(const char *key, size_t len)
+{
+  uint64_t h = len;
+  for (; len >= 8; key += 8, len -= 8) {
+    uint64_t word;
+    std::memcpy(&word, key, 8);
+    h = mix(h ^ word);
+  }
+  uint64_t word = 0;
+  std::memcpy(&word, key, len);
+  return mix(h ^ word);
+}
+
+
+// Maps the high half of 'x' to [0, n) without a division
+static uint32_t reduce(uint64_t x, uint32_t n)
+{
+  return ((x >> 32) * n) >> 32;
+}
+
+
+// Slot of the key with 'hash' in a bucket with 'displacement'
+static uint32_t slot_of(uint64_t hash, uint32_t displacement, uint32_t slots)
+{
+  return reduce(mix(hash ^ (uint64_t(displacement) << 32 | displacement)),
+      slots);
+}
+
+
+// Removes spaces at both ends of 'str' and the quotes of a quoted string
+static std::string_view trim(std::string_view str)
+{
+  while (!str.empty() && std::isspace(static_cast<unsigned char>(
+          str.front())))
+    str.remove_prefix(1);
+  while (!str.empty() && std::isspace(static_cast<unsigned char>(
+          str.back())))
+    str.remove_suffix(1);
+  if (str.size() >= 2 && str.front() == '"' && str.back() == '"')
+    str = str.substr(1, str.size()-2);
+  return str;
+}
+
+
+JournalAbbreviations::JournalAbbreviations() :
+  mapped(nullptr),
+  mapped_size(0)
+{
+}
+
+
+JournalAbbreviations::~JournalAbbreviations()
+{
+  if (mapped)
+    unmap_file(mapped, mapped_size);
+}
+
+
+bool JournalAbbreviations::load(const std::string &filename)
+{
+  uint64_t size;
+  int64_t mtime;
+  if (!file_stamp(filename, size, mtime))
+    return false;
+
+  // use the table of an earlier run if it belongs to this dictionary
+  std::string name = filename + ".phf";
+  size_t data_size = 0;
+  if (const char *data = map_file(name, data_size)) {
+    std::string_view view(data, data_size);
+    if (valid(view, size, mtime)) {
+      mapped = data;
+      mapped_size = data_size;
+      table = view;
+      return true;
+    }
+    unmap_file(data, data_size);
+  }
+
+  std::ifstream dict(filename);
+  if (!dict)
+    return false;
+  build(dict, size, mtime, built);
+  table = built;
+  // the table is kept in memory if it cannot be written, it is renamed when
+  // complete so that no other run maps a partial table
+  std::string tmp = name + ".tmp";
+  std::ofstream out(tmp, std::ios::binary);
+  out.write(built.data(), built.size());
+  out.close();
+  if (out)
+    std::rename(tmp.c_str(), name.c_str());
+  else
+    std::remove(tmp.c_str());
+  return true;
+}
+
+
+std::string_view JournalAbbreviations::find(std::string_view name) const
+{
+  if (table.empty())
+    return std::string_view();
+  const table_header *h = reinterpret_cast<const table_header*>(
+      table.data());
+  const uint32_t *displacements = reinterpret_cast<const uint32_t*>(
+      table.data() + sizeof(table_header));
+  const table_slot *slots = reinterpret_cast<const table_slot*>(
+      displacements + h->buckets);
+  const char *pool = reinterpret_cast<const char*>(slots + h->slots);
+
+  // the key of a short name is normalized on the stack
+  char stack[256];
+  std::string heap;
+  char *key = stack;
+  if (3*name.size() > sizeof(stack)) {
+    heap.resize(3*name.size());
+    key = &heap[0];
+  }
+  size_t len = normalize(name, key);
+  uint64_t hash = key_hash(key, len);
+  uint32_t bucket = reduce(hash, h->buckets);
+  const table_slot &s = slots[slot_of(hash, displacements[bucket], h->slots)];
+  if (s.key_len == 0 || uint64_t(s.key) + s.key_len > h->pool ||
+      uint64_t(s.abbrev) + s.abbrev_len > h->pool)
+    return std::string_view();
+
+  // every key has a slot, other names are told apart by comparing the key
+  if (len != s.key_len || std::memcmp(key, pool + s.key, len) != 0)
+    return std::string_view();
+  return std::string_view(pool + s.abbrev, s.abbrev_len);
+}
+
+
+void JournalAbbreviations::build(std::istream &is, uint64_t size,
+    int64_t mtime, std::string &out)
+{
+  // normalized keys and abbreviations, the first line of a key wins
+  struct item {
+    uint64_t hash;
+    uint32_t key;
+    uint32_t abbrev;
+    uint16_t key_len;
+    uint16_t abbrev_len;
+  };
+  std::vector<item> items;
+  std::string pool;
+  std::unordered_set<std::string> keys;
+  std::string key;
+  for (std::string line; std::getline(is, line);) {
+    std::string_view text = trim(line);
+    if (text.empty() || text.front() == '#')
+      continue;
+    size_t sep = text.find(';');
+    if (sep == std::string_view::npos)
+      sep = text.find('=');
+    if (sep == std::string_view::npos)
+      continue;
+    std::string_view full = trim(text.substr(0, sep));
+    std::string_view abbrev = trim(text.substr(sep+1));
+    // a CSV line may have more columns after the abbreviation
+    abbrev = trim(abbrev.substr(0, abbrev.find(';')));
+    key.resize(3*full.size());
+    key.resize(normalize(full, &key[0]));
+    if (key.empty() || abbrev.empty() || key.size() > 0xffff ||
+        abbrev.size() > 0xffff || !keys.insert(key).second)
+      continue;
+    items.push_back(item{key_hash(key.data(), key.size()),
+        uint32_t(pool.size()), uint32_t(pool.size() + key.size()),
+        uint16_t(key.size()), uint16_t(abbrev.size())});
+    pool += key;
+    pool.append(abbrev.data(), abbrev.size());
+  }
+
+  // about four keys per bucket and a few free slots, the largest buckets are
+  // placed first while most slots are free
+  table_header h;
+  std::memcpy(h.magic, magic, sizeof(magic));
+  h.size = size;
+  h.mtime = mtime;
+  h.buckets = items.size()/4 + 1;
+  h.slots = items.size() + items.size()/16 + 1;
+  h.pool = pool.size();
+  h.reserved = 0;
+  std::vector<std::vector<uint32_t>> buckets(h.buckets);
+  for (uint32_t i = 0; i < items.size(); ++i)
+    buckets[reduce(items[i].hash, h.buckets)].push_back(i);
+  std::vector<uint32_t> order(h.buckets);
+  for (uint32_t b = 0; b < h.buckets; ++b)
+    order[b] = b;
+  std::stable_sort(order.begin(), order.end(), [&] (uint32_t a, uint32_t b) {
+        return buckets[a].size() > buckets[b].size();
+      });
+  std::vector<uint32_t> displacements(h.buckets, 0);
+  std::vector<table_slot> slots(h.slots, table_slot{0, 0, 0, 0});
+  std::vector<uint32_t> taken;
+  for (uint32_t b : order) {
+    if (buckets[b].empty())
+      break;
+    for (uint32_t d = 0; ; ++d) {
+      taken.clear();
+      for (uint32_t i : buckets[b]) {
+        uint32_t s = slot_of(items[i].hash, d, h.slots);
+        if (slots[s].key_len ||
+            std::find(taken.begin(), taken.end(), s) != taken.end())
+          break;
+        taken.push_back(s);
+      }
+      if (taken.size() < buckets[b].size())
+        continue;
+      displacements[b] = d;
+      for (size_t k = 0; k < taken.size(); ++k) {
+        const item &it = items[buckets[b][k]];
+        slots[taken[k]] = table_slot{it.key, it.abbrev, it.key_len,
+          it.abbrev_len};
+      }
+      break;
+    }
+  }
+
+  out.clear();
+  out.append(reinterpret_cast<const char*>(&h), sizeof(h));
+  out.append(reinterpret_cast<const char*>(displacements.data()),
+      displacements.size()*sizeof(uint32_t));
+  out.append(reinterpret_cast<const char*>(slots.data()),
+      slots.size()*sizeof(table_slot));
+  out += pool;
+}
+
+
+bool JournalAbbreviations::valid(std::string_view data, uint64_t size,
+    int64_t mtime)
+{
+  if (data.size() < sizeof(table_header))
+    return false;
+  const table_header *h = reinterpret_cast<const table_header*>(data.data());
+  return std::memcmp(h->magic, magic, sizeof(magic)) == 0 &&
+    h->size == size && h->mtime == mtime && h->buckets > 0 && h->slots > 0 &&
+    data.size() == sizeof(table_header) + uint64_t(h->buckets)*
+    sizeof(uint32_t) + uint64_t(h->slots)*sizeof(table_slot) + h->pool;
+}
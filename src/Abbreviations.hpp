@@ -0,0 +1,73 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ABBREVIATIONS_H
+#define ABBREVIATIONS_H
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <string_view>
+
+// Dictionary of journal abbreviations in a minimal perfect hash table. A
+// dictionary has one "Full Name;Abbrev." or "Full Name = Abbrev." per line,
+// lines starting with '#' are comments. The names are matched by a normalized
+// key without case, punctuation, spaces and LaTeX markup. The table of
+// a dictionary is built once, written next to it as <dictionary>.phf and
+// mapped into memory by later runs.
+class JournalAbbreviations
+{
+  public:
+    // Constructor
+    JournalAbbreviations();
+
+    // Destructor, unmaps the table
+    ~JournalAbbreviations();
+
+    // Load the table of the dictionary 'filename', it is built if it is
+    // missing or out of date. Returns false if the dictionary cannot be read.
+    bool load(const std::string &filename);
+
+    // Returns the abbreviation of the journal 'name' or an empty view
+    std::string_view find(std::string_view name) const;
+
+  private:
+    // Mapped table or nullptr if it is kept in 'built'
+    const char *mapped;
+    size_t mapped_size;
+
+    // Table that could not be written next to the dictionary
+    std::string built;
+
+    // Table in use
+    std::string_view table;
+
+    // Build the table of the dictionary 'is' in 'out', the header records
+    // 'size' and 'mtime' of the dictionary
+    static void build(std::istream &is, uint64_t size, int64_t mtime,
+        std::string &out);
+
+    // Returns true if 'data' is a complete table for a dictionary with
+    // 'size' and 'mtime'
+    static bool valid(std::string_view data, uint64_t size, int64_t mtime);
+};
+
+#endif
@@ -19,15 +19,119 @@
  */
 
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <queue>
 #include <sstream>
-#include <boost/algorithm/string/predicate.hpp>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include "CaseFold.hpp"
+#include "CompactStore.hpp"
 #include "Constants.hpp"
 #include "DataStructure.hpp"
+#include "Diagnostics.hpp"
+#include "Duplicates.hpp"
+#include "KeyTemplate.hpp"
+#include "Macros.hpp"
+#include "Merger.hpp"
+#include "Names.hpp"
 #include "Parser.hpp"
+#include "Schema.hpp"
 #include "Strings.hpp"
+#include "Transform.hpp"
 #include "Bibliography.hpp"
 
-namespace bstring = boost::algorithm;
+// Access to a vector of bibEntry with the same interface as CompactStore,
+// the operations below are implemented once for both
+class EntryVector
+{
+  public:
+    EntryVector(std::vector<bibEntry> &_bib) : bib(_bib) {}
+    size_t size() const { return bib.size(); }
+    std::string_view type(size_t i) const { return bib[i].type; }
+    std::string_view key(size_t i) const { return bib[i].key; }
+    size_t count(size_t i) const { return bib[i].element.size(); }
+    std::string_view field(size_t i, size_t j) const
+      { return bib[i].element[j].field; }
+    std::string_view value(size_t i, size_t j) const
+      { return bib[i].element[j].value; }
+    bool expression(size_t i, size_t j) const
+      { return bib[i].element[j].expression; }
+    size_t source(size_t i) const { return bib[i].source; }
+    uint64_t offset(size_t i) const { return bib[i].offset; }
+    std::string_view get_field_value(size_t i, std::string_view field) const
+    {
+      for (const bibElement &bEl : bib[i].element)
+        if (CaseFold::equals(bEl.field, field))
+          return bEl.value;
+      return std::string_view();
+    }
+    void set_key(size_t i, std::string_view key) { bib[i].key = key; }
+    void set_value(size_t i, size_t j, std::string_view value)
+      { bib[i].element[j].value = value; }
+    void clear(size_t i) { bib[i].element.clear(); }
+    void remove_empty()
+    {
+      bib.erase(std::remove_if(bib.begin(), bib.end(),
+            [] (const bibEntry &bEn) -> bool {
+              return bEn.element.empty();
+            }), bib.end());
+    }
+    void permute(const std::vector<size_t> &order)
+    {
+      std::vector<bibEntry> sorted;
+      sorted.reserve(order.size());
+      for (size_t i : order)
+        sorted.push_back(std::move(bib[i]));
+      bib.swap(sorted);
+    }
+
+  private:
+    std::vector<bibEntry> &bib;
+};
+
+
+// Writes 'str' preceded by its length
+static void write_string(std::ostream &os, std::string_view str)
+{
+  uint32_t len = str.size();
+  os.write(reinterpret_cast<const char*>(&len), sizeof(len));
+  os.write(str.data(), len);
+}
+
+
+// Reads a string written by write_string()
+static bool read_string(std::istream &is, std::string &str)
+{
+  uint32_t len;
+  if (!is.read(reinterpret_cast<char*>(&len), sizeof(len)))
+    return false;
+  str.resize(len);
+  return bool(is.read(&str[0], len));
+}
+
+
+// Reads an entry written by Bibliography::write_run()
+static bool read_run_entry(std::istream &is, bibEntry &bEn)
+{
+  uint32_t count;
+  if (!read_string(is, bEn.type) || !read_string(is, bEn.key) ||
+      !is.read(reinterpret_cast<char*>(&count), sizeof(count)))
+    return false;
+  bEn.element.resize(count);
+  for (bibElement &bEl : bEn.element) {
+    char expression;
+    if (!read_string(is, bEl.field) || !read_string(is, bEl.value) ||
+        !is.get(expression))
+      return false;
+    bEl.expression = expression;
+  }
+  return true;
+}
+
 
 std::string Bibliography::clean_key(std::string key) const
 {
@@ -48,34 +152,13 @@ std::string Bibliography::clean_key(std::string key) const
 }
 
 
-std::string Bibliography::get_lastname(std::string author) const
+std::string Bibliography::get_lastname(std::string_view author) const
 {
-  // get the first author
-  size_t found = author.find(" and ");
-  if (found != std::string::npos)
-    author = author.substr(0, found);
-
-  // get last name
-  found = author.find(",");
-  if (found != std::string::npos)
-    author = author.substr(0, found);
-  else {
-    std::stringstream author_ss(author);
-    while (author_ss >> author);
-  }
-
-
-  if (author.empty()) {
-    std::cerr << Strings::tr(Strings::ERR_EMPTY_AUTHOR) << std::endl;
-    return "";
-  }
-
-  // return last name of first author
-  return author;
+  return names->first_lastname(author);
 }
 
 
-bool Bibliography::is_numerical(const std::string& s) const
+bool Bibliography::is_numerical(std::string_view s) const
 {
   size_t found = s.find_first_not_of("1234567890");
   return (found==std::string::npos);
@@ -92,75 +175,126 @@ void Bibliography::print_bib(std::ostream &os) const
 void Bibliography::print_bib(std::vector<std::string> only,
     std::ostream &os) const
 {
-  check_consistency();
+  if (store)
+    print_bib(*store, only, os);
+  else
+    print_bib(EntryVector(*bib), only, os);
+}
+
+
+template <class Store>
+void Bibliography::print_bib(const Store &st,
+    const std::vector<std::string> &only, std::ostream &os) const
+{
+  check_consistency(st);
+  // macros are defined before they are used
+  macros->print(os, !print_expanded);
+  // fields selected by 'only' can be inherited through crossref
+  std::vector<size_t> parents = crossref_parents(st, true);
+  std::vector<std::vector<size_t>> sources;
+  if (!parents.empty())
+    for (const std::string &po : only)
+      sources.push_back(field_sources(st, parents, po));
+  // elements of the current entry which are printed as pairs of entry and
+  // element index
+  std::vector<std::pair<size_t, size_t>> printed;
+  // iterate over all entries
+  for (size_t i = 0, n = st.size(); i < n; ++i)
+    print_entry(st, i, only, printed, os, &sources);
+  os.flush();
+}
+
+
+template <class Store>
+void Bibliography::print_entry(const Store &st, size_t i,
+    const std::vector<std::string> &only,
+    std::vector<std::pair<size_t, size_t>> &printed, std::ostream &os,
+    const std::vector<std::vector<size_t>> *sources) const
+{
   bool print_all = only.empty();
-  // convert list to lowercase
-  if (!print_all)
-    for (std::string& s : only)
-      std::transform(s.begin(), s.end(), s.begin(), ::tolower);
-  // iterate over all entries (use copies)
-  for (bibEntry bEn : *bib) {
-    // delete all entries which are not printed
-    if (!print_all) {
-      bEn.element.erase(
-          std::remove_if(bEn.element.begin(), bEn.element.end(),
-            [&] (bibElement bEl) -> bool {
-              std::transform(bEl.field.begin(), bEl.field.end(),
-                bEl.field.begin(), ::tolower);
-              for (const std::string &po : only) {
-                if (po == bEl.field) 
-                  return false;
-              }
-              return true;
-            }),
-          bEn.element.end());
-    }
-
-    // search for longest field name
-    unsigned int longest_field = 0;
-    if (right_aligned) {
-      for (const bibElement &bEl : bEn.element)
-        if (bEl.field.length() > longest_field)
-          longest_field = bEl.field.length();
-    }
-
-    // print key
-    os << '@' << bEn.type << '{' << bEn.key;
-    // print elements
-    for (const bibElement& bEl : bEn.element) {
-      os << ",\n";
-      // Use no field delimiters if value is a numeric
-      bool print_delimiter = true;
-      if (is_numerical(bEl.value))
-        print_delimiter = false;
-      // Or if the month field uses three-letter abbreviations
-      std::string field = bEl.field;
-      std::transform(field.begin(), field.end(), field.begin(), ::tolower);
-      if ( (field == "month") &&
-          Constants::is_valid_month_abbreviation(bEl.value) )
-        print_delimiter = false;
-      // construct line
-      std::string line;
-      if (right_aligned) {
-        for (unsigned int i = 0, end = longest_field-field.length();
-            i < end; ++i)
-          line.push_back(' ');
+  // skip all elements which are not printed (case insensitive)
+  printed.clear();
+  for (size_t j = 0, m = st.count(i); j < m; ++j) {
+    if (print_all || std::any_of(only.begin(), only.end(),
+          [&] (const std::string &po) -> bool {
+            return CaseFold::equals(po, st.field(i, j));
+          }))
+      printed.emplace_back(i, j);
+  }
+
+  // selected fields that the entry does not define are taken from the
+  // nearest crossref parent, 'sources' has one vector per field in 'only'
+  if (!print_all && sources && !sources->empty()) {
+    size_t own = printed.size();
+    for (size_t f = 0; f < only.size(); ++f) {
+      size_t k = (*sources)[f][i];
+      if (k == i || k == no_parent ||
+          std::any_of(printed.begin(), printed.begin()+own,
+            [&] (const std::pair<size_t, size_t> &p) -> bool {
+              return CaseFold::equals(only[f], st.field(p.first, p.second));
+            }))
+        continue;
+      for (size_t j = 0, m = st.count(k); j < m; ++j) {
+        if (CaseFold::equals(only[f], st.field(k, j)) &&
+            !st.value(k, j).empty()) {
+          printed.emplace_back(k, j);
+          break;
+        }
       }
-      line += intend + bEl.field + " = ";
-      std::string intend_after_break;
-      for (unsigned int i = 0, length = line.length(); i < length; ++i)
-        intend_after_break.push_back(' ');
-      if (print_delimiter)
-        line += field_beg + bEl.value + field_end;
-      else
-        line += bEl.value;
-      // break after 'linebreak' characters
-      line = break_string(line, intend_after_break);
-      os << line;
     }
-    // finish entry
-    os << "\n}\n" << std::endl;
   }
+
+  // search for longest field name
+  size_t longest_field = 0;
+  if (right_aligned) {
+    for (const std::pair<size_t, size_t> &p : printed)
+      longest_field = std::max(longest_field,
+          st.field(p.first, p.second).length());
+  }
+
+  // print key
+  os << '@' << st.type(i) << '{' << st.key(i);
+  // print elements
+  for (const std::pair<size_t, size_t> &p : printed) {
+    std::string_view field = st.field(p.first, p.second);
+    std::string_view value = st.value(p.first, p.second);
+    os << ",\n";
+    // expressions are printed as they are unless they can be expanded
+    bool expression = st.expression(p.first, p.second);
+    std::string expanded;
+    if (expression && print_expanded && macros->expand(value, expanded)) {
+      value = expanded;
+      expression = false;
+    }
+    // Use no field delimiters if value is a numeric or an expression
+    bool print_delimiter = !expression;
+    if (is_numerical(value))
+      print_delimiter = false;
+    // Or if the month field uses three-letter abbreviations
+    if (CaseFold::equals(field, "month") &&
+        Constants::is_valid_month_abbreviation(value) )
+      print_delimiter = false;
+    // construct line
+    std::string line;
+    if (right_aligned)
+      line.append(longest_field-field.length(), ' ');
+    line += intend;
+    line += field;
+    line += " = ";
+    std::string intend_after_break(line.length(), ' ');
+    if (print_delimiter) {
+      line += field_beg;
+      line += value;
+      line += field_end;
+    }
+    else
+      line += value;
+    // break after 'linebreak' characters
+    line = break_string(line, intend_after_break);
+    os << line;
+  }
+  // finish entry
+  os << "\n}\n\n";
 }
 
 
@@ -168,8 +302,9 @@ std::string Bibliography::break_string(std::string str,
     const std::string &intend) const
 {
   std::vector<std::string> lines;
-  bool unbreakable = false;
   size_t minlen = intend.size();
+  // there is no place to break a line that the intendation fills
+  bool unbreakable = minlen >= linebreak;
   while ((str.length() > linebreak) && !unbreakable) {
     for (unsigned int i = linebreak; i >= minlen; --i) {
       if (str[i] == ' ') {
@@ -203,6 +338,15 @@ std::string Bibliography::break_string(std::string str,
 
 
 Bibliography::Bibliography() :
+  store(nullptr),
+  merger(nullptr),
+  names(new NameCache),
+  schema(new Schema),
+  macros(new MacroTable),
+  diagnostics(new Diagnostics),
+  print_expanded(false),
+  crossref(true),
+  checked(true),
   intend("  "),
   linebreak(79),
   field_beg('{'),
@@ -215,18 +359,130 @@ Bibliography::Bibliography() :
 Bibliography::~Bibliography()
 {
   delete bib;
+  delete store;
+  delete merger;
+  delete names;
+  delete diagnostics;
 }
 
 
-void Bibliography::add(std::istream &is)
+void Bibliography::add(std::istream &is, const std::string &source)
 {
   // create parsing object
-  Parser parser;
+  Parser parser(macros.get());
+  parser.set_projection(projection);
+  if (projection)
+    parser.set_hashes(&element_hashes);
+  parser.set_source(diagnostics->add_source(source));
 
   // add the stream to the bibliography
-  parser.add(is, *bib);
+  if (store) {
+    // reserve the remaining size of the stream, if it is known
+    std::istream::pos_type pos = is.tellg();
+    if (pos != std::istream::pos_type(-1) && is.seekg(0, std::ios::end)) {
+      store->reserve(is.tellg() - pos);
+      is.seekg(pos);
+    }
+    is.clear();
+    parser.add(is, *store);
+    delete_redundant_entries(*store);
+    store->shrink_to_fit();
+  }
+  else {
+    parser.add(is, *bib);
+    EntryVector entries(*bib);
+    delete_redundant_entries(entries);
+  }
+}
+
+
+void Bibliography::add(std::vector<bibEntry> &entries)
+{
+  expand();
+  std::move(entries.begin(), entries.end(), std::back_inserter(*bib));
+  entries.clear();
+  EntryVector added(*bib);
+  if (checked)
+    delete_redundant_entries(added);
+}
+
+
+void Bibliography::set_projection(std::function<bool(std::string_view)> keep)
+{
+  if (!keep) {
+    projection = nullptr;
+    element_hashes.clear();
+    return;
+  }
+  // crossref is needed to resolve the parents, title to report empty keys
+  projection = [keep] (std::string_view field) -> bool {
+    return CaseFold::equals(field, "crossref") ||
+      CaseFold::equals(field, "title") || keep(field);
+  };
+}
+
+
+void Bibliography::use_compact_storage()
+{
+  if (!store)
+    store = new CompactStore;
+  // move entries that were added before
+  for (const bibEntry &bEn : *bib)
+    store->push_back(bEn);
+  bib->clear();
+}
+
+
+void Bibliography::expand()
+{
+  if (!store)
+    return;
+  bib->resize(store->size());
+  for (size_t i = 0; i < store->size(); ++i)
+    store->get(i, (*bib)[i]);
+  delete store;
+  store = nullptr;
+}
+
 
-  delete_redundant_entries();
+void Bibliography::merge(std::istream &is, const std::string &source)
+{
+  expand();
+  if (!merger)
+    merger = new Merger(Merger::UNION_FIELDS);
+
+  // parse the stream separately and join it into the bibliography
+  Parser parser(macros.get());
+  parser.set_source(diagnostics->add_source(source));
+  std::vector<bibEntry> incoming;
+  parser.add(is, incoming);
+  merger->join(*bib, incoming, source);
+}
+
+
+void Bibliography::set_merge_policy(const char policy)
+{
+  Merger::Policy p;
+  if (policy == 'F')
+    p = Merger::PREFER_FIRST;
+  else if (policy == 'N')
+    p = Merger::PREFER_NEWEST;
+  else if (policy == 'U')
+    p = Merger::UNION_FIELDS;
+  else {
+    std::cerr << Strings::tr(Strings::ERR_UNKNOWN_MERGE_POLICY)
+      << policy << std::endl;
+    return;
+  }
+  delete merger;
+  merger = new Merger(p);
+}
+
+
+void Bibliography::write_merge_report(std::ostream &os) const
+{
+  if (merger)
+    merger->write_report(os);
 }
 
 
@@ -293,7 +549,10 @@ void Bibliography::create_entry()
   }
 
   // add newly created entry to bibliography
-  bib->push_back(bEn);
+  if (store)
+    store->push_back(bEn);
+  else
+    bib->push_back(bEn);
 }
 
 void Bibliography::ask_for_fields(bibEntry &bEn,
@@ -332,198 +591,362 @@ void Bibliography::ask_for_fields(bibEntry &bEn,
 
 void Bibliography::check_consistency() const
 {
-  if (bib->empty()) {
-    std::cerr << Strings::tr(Strings::ERR_EMPTY_BIB);
+  if (store)
+    check_consistency(*store);
+  else
+    check_consistency(EntryVector(*bib));
+}
+
+
+template <class Store>
+void Bibliography::check_consistency(const Store &st) const
+{
+  if (!checked)
+    return;
+  if (st.size() == 0) {
+    diagnostics->report(Diagnostics::EMPTY_BIBLIOGRAPHY, "", "", 0, 0);
     return;
   }
 
   // check if keys are empty
-  for (const bibEntry& bEn : *bib) {
-    if (bEn.key.empty()) {
-        std::cerr << Strings::tr(Strings::ERR_EMPTY_KEY)
-          << get_field_value(bEn, "title") << "\"\n";
-    }
+  for (size_t i = 0, n = st.size(); i < n; ++i) {
+    if (st.key(i).empty())
+      warn(st, i, Diagnostics::EMPTY_KEY, st.get_field_value(i, "title"));
   }
 
-  // check if every key is unique
-  for (auto it1 = bib->begin(), end = bib->end(); it1 != end-1; ++it1) {
-    for (auto it2 = it1+1; it2 != end; ++it2) {
-      if (it1->key == it2->key) {
-        std::cerr << Strings::tr(Strings::ERR_DOUBLE_KEY_1) << it1->key
-          << Strings::tr(Strings::ERR_DOUBLE_KEY_2);
-      }
+  // check if every key is unique, every definition of a duplicate key is
+  // reported, the first one when the second is found
+  std::unordered_map<std::string_view, size_t> keys;
+  keys.reserve(st.size());
+  for (size_t i = 0, n = st.size(); i < n; ++i) {
+    auto ins = keys.emplace(st.key(i), i);
+    if (ins.second)
+      continue;
+    if (ins.first->second != no_parent) {
+      warn(st, ins.first->second, Diagnostics::DUPLICATE_KEY);
+      ins.first->second = no_parent;
     }
+    warn(st, i, Diagnostics::DUPLICATE_KEY);
   }
 
 }
 
 
-std::string Bibliography::get_field_value(const bibEntry &bE,
-    std::string field) const
+const std::string& Bibliography::get_field_value(const bibEntry &bE,
+    std::string_view field) const
 {
-  // transform to lower case
-  std::transform(field.begin(), field.end(), field.begin(), ::tolower);
-  // search for entry
+  static const std::string empty;
+  // search for entry (case insensitive)
   for (const bibElement& bEl : bE.element) {
-    std::string current = bEl.field;
-    std::transform(current.begin(), current.end(), current.begin(), ::tolower);
-    if (current == field)
+    if (CaseFold::equals(bEl.field, field))
       return bEl.value;
   }
   // return empty string if field was not found
-  return "";
+  return empty;
 }
 
 void Bibliography::create_keys()
 {
-  // iterate over all entries in the bibliography
-  for (auto it = bib->begin(), end = bib->end(); it != end; ++it) {
-    // get lastname
-    std::string author = get_lastname(get_field_value(*it, "author"));
-
-    // get the last two digits of the year
-    std::string year = get_field_value(*it, "year");
-    if (year.length() >= 2)
-      year = year.substr(year.length()-2, 2);
-
-    // key is author plus year
-    it->key = author + year;
-
-    // add identifier (a,b,c...) to the key
-    char id = 'a';
-    for (auto it2 = bib->begin(); it2 != it; ++it2)
-      if (it->key == it2->key.substr(0,it2->key.length()-1))
-        ++id;
-    if (id > 'z') {
-      std::cerr << Strings::tr(Strings::ERR_RAN_OUT_OF_IDS_1) << author
-        << Strings::tr(Strings::ERR_RAN_OUT_OF_IDS_2) << year
-        << Strings::tr(Strings::ERR_RAN_OUT_OF_IDS_3) << std::endl;
-      break;
+  create_keys(KeyTemplate());
+}
+
+
+void Bibliography::create_keys(const KeyTemplate &scheme)
+{
+  if (store)
+    create_keys(*store, scheme);
+  else {
+    EntryVector entries(*bib);
+    create_keys(entries, scheme);
+  }
+}
+
+
+template <class Store>
+void Bibliography::create_keys(Store &st, const KeyTemplate &scheme)
+{
+  // the crossref fields as entry, element and parent, the first entry with
+  // a key is the parent
+  std::vector<std::array<size_t, 3>> children;
+  for (size_t i = 0; i < st.size(); ++i)
+    for (size_t j = 0, m = st.count(i); j < m; ++j)
+      if (CaseFold::equals(st.field(i, j), "crossref"))
+        children.push_back({i, j, no_parent});
+  if (!children.empty()) {
+    std::unordered_map<std::string_view, size_t, CaseFold::hasher,
+      CaseFold::equal_to> index;
+    for (size_t i = 0; i < st.size(); ++i)
+      index.emplace(st.key(i), i);
+    for (std::array<size_t, 3> &child : children) {
+      auto it = index.find(st.value(child[0], child[1]));
+      if (it != index.end())
+        child[2] = it->second;
     }
-    it->key += id;
+  }
 
+  // all keys are created and counted first, so the letters are added in a
+  // second pass without comparing any two keys. Keys are compared case
+  // insensitively, like the keys of the crossref fields.
+  const std::vector<std::string> &fields = scheme.fields();
+  size_t author = std::find(fields.begin(), fields.end(), "author") -
+    fields.begin();
+  std::vector<std::string_view> values(fields.size());
+  std::vector<std::string> keys(st.size());
+  std::unordered_map<std::string_view, size_t, CaseFold::hasher,
+    CaseFold::equal_to> count;
+  for (size_t i = 0; i < st.size(); ++i) {
+    for (size_t f = 0; f < fields.size(); ++f)
+      values[f] = st.get_field_value(i, fields[f]);
+    if (author < fields.size() && values[author].empty())
+      warn(st, i, Diagnostics::EMPTY_AUTHOR);
     // clean all not allowed characters
-    it->key = clean_key(it->key);
+    keys[i] = clean_key(scheme.evaluate(values, *names));
   }
+  for (const std::string &key : keys)
+    ++count[key];
+
+  // letters a to z, then aa, ab and so on. A key with letters that is taken
+  // by another key is skipped, every letter is tried once per key, so this
+  // stays linear.
+  std::unordered_set<std::string_view, CaseFold::hasher, CaseFold::equal_to>
+    taken(keys.begin(), keys.end());
+  std::deque<std::string> lettered;
+  std::unordered_map<std::string_view, size_t, CaseFold::hasher,
+    CaseFold::equal_to> next;
+  std::string key;
+  for (size_t i = 0; i < st.size(); ++i) {
+    key = keys[i];
+    if (scheme.always_adds_letter() || count[keys[i]] > 1) {
+      do {
+        key = keys[i];
+        size_t id = next[keys[i]]++;
+        size_t pos = key.size();
+        for (++id; id > 0; id = (id-1) / 26)
+          key.insert(pos, 1, char('a' + (id-1) % 26));
+      } while (taken.count(key));
+      lettered.push_back(key);
+      taken.insert(lettered.back());
+    }
+    st.set_key(i, key);
+  }
+
+  // the children refer to the new keys of their parents
+  for (const std::array<size_t, 3> &child : children)
+    if (child[2] != no_parent) {
+      key = st.key(child[2]);
+      st.set_value(child[0], child[1], key);
+    }
 }
 
 
 void Bibliography::change_case(const char case_t, const char case_f)
 {
-  // operation for the types
-  int (*touplo_t)(int);
-  if (case_t == 'U')
-    touplo_t= &std::toupper;
-  else if (case_t == 'L')
-    touplo_t= &std::tolower;
-  else if (case_t == 'S')
-    touplo_t= &std::tolower;
+  Transform t;
+  if (t.set_case(case_t, case_f))
+    transform(t);
+}
+
+
+void Bibliography::erase_field(std::string field)
+{
+  Transform t;
+  t.erase_field(field);
+  transform(t);
+}
+
+
+void Bibliography::sort_bib(std::vector<std::string> criteria)
+{
+  // the hashes are no longer aligned with the entries
+  element_hashes.clear();
+  if (store)
+    store->permute(sort_order(*store, criteria));
   else {
-    std::cerr << Strings::tr(Strings::ERR_UNKNOWN_CHANGE_CASE_T)
-      << case_t << std::endl;
-    return;
+    EntryVector entries(*bib);
+    entries.permute(sort_order(entries, criteria));
   }
+}
 
-  // operation for the fields
-  int (*touplo_f)(int);
-  if (case_f == 'U')
-    touplo_f= &std::toupper;
-  else if (case_f == 'L')
-    touplo_f= &std::tolower;
-  else if (case_f == 'S')
-    touplo_f= &std::tolower;
-  else {
-    std::cerr << Strings::tr(Strings::ERR_UNKNOWN_CHANGE_CASE_F)
-      << case_f << std::endl;
-    return;
+
+template <class Store>
+std::vector<size_t> Bibliography::sort_order(const Store &st,
+    std::vector<std::string> criteria) const
+{
+  // the lower case criteria are compared to the special values
+  for (std::string& cur_crit : criteria)
+    CaseFold::to_lower(cur_crit);
+
+  // the names are parsed once per entry and not in every comparison
+  // fields inherited through crossref are compared too, their sources are
+  // found once for every criterion
+  std::vector<size_t> parents = crossref_parents(st, false);
+  std::vector<std::vector<size_t>> sources(criteria.size());
+  std::vector<std::string> lastnames;
+  for (size_t c = 0; c < criteria.size(); ++c) {
+    if (criteria[c] == "type" || criteria[c] == "key")
+      continue;
+    if (criteria[c] != "firstauthor") {
+      sources[c] = field_sources(st, parents, criteria[c]);
+      continue;
+    }
+    // the names are parsed once per entry and not in every comparison
+    std::vector<size_t> authors = field_sources(st, parents, "author");
+    lastnames.resize(st.size());
+    for (size_t i = 0; i < lastnames.size(); ++i)
+      if (authors[i] != no_parent)
+        lastnames[i] = get_lastname(st.get_field_value(authors[i], "author"));
   }
 
-  for (bibEntry& bEn : *bib) {
-    std::transform(bEn.type.begin(), bEn.type.end(), bEn.type.begin(),
-        touplo_t);
-    if (case_t == 'S')
-      bEn.type[0] = toupper(bEn.type[0]);
-    for (bibElement& bEl : bEn.element) {
-      std::transform(bEl.field.begin(), bEl.field.end(), bEl.field.begin(),
-          touplo_f);
-      if (case_f == 'S')
-        bEl.field[0] = toupper(bEl.field[0]);
+  // check if entry 'i1' is smaller than 'i2' using the given criteria
+  auto cmp_after_criteria = [&] (size_t i1, size_t i2) -> bool
+    {
+      return compare_entries(st, i1, i2, criteria, &lastnames, &sources) < 0;
+    };
+
+  // sort bibliography stable
+  std::vector<size_t> order(st.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(), cmp_after_criteria);
+  return order;
+}
+
+
+template <class Store>
+int Bibliography::compare_entries(const Store &st, size_t i1, size_t i2,
+    const std::vector<std::string> &criteria,
+    const std::vector<std::string> *lastnames,
+    const std::vector<std::vector<size_t>> *sources) const
+{
+  for (size_t c = 0; c < criteria.size(); ++c) {
+    const std::string &cur_crit = criteria[c];
+    int cmp;
+    if (cur_crit == "type")
+      cmp = CaseFold::compare(st.type(i1), st.type(i2));
+    else if (cur_crit == "key")
+      cmp = CaseFold::compare(st.key(i1), st.key(i2));
+    else if (cur_crit == "firstauthor" && lastnames)
+      cmp = CaseFold::compare((*lastnames)[i1], (*lastnames)[i2]);
+    else if (cur_crit == "firstauthor")
+      cmp = CaseFold::compare(get_lastname(st.get_field_value(i1, "author")),
+          get_lastname(st.get_field_value(i2, "author")));
+    else if (sources) {
+      size_t s1 = (*sources)[c][i1], s2 = (*sources)[c][i2];
+      cmp = CaseFold::compare(
+          s1 == no_parent ? std::string_view() : st.get_field_value(s1, cur_crit),
+          s2 == no_parent ? std::string_view() : st.get_field_value(s2, cur_crit));
     }
+    else
+      cmp = CaseFold::compare(st.get_field_value(i1, cur_crit),
+          st.get_field_value(i2, cur_crit));
+    if (cmp != 0)
+      return cmp;
   }
+  return 0;
 }
 
 
-void Bibliography::erase_field(std::string field)
+void Bibliography::write_run(std::ostream &os) const
 {
-  std::transform(field.begin(), field.end(), field.begin(), ::tolower);
-  auto compare = [&] (bibElement& el) -> bool {
-    std::string cur = el.field;
-    std::transform(cur.begin(), cur.end(), cur.begin(), ::tolower);
-    if (cur == field) return true;
-    else return false;
-  };
-  for (bibEntry& bEn : *bib)
-    bEn.element.erase( std::remove_if(bEn.element.begin(), bEn.element.end(),
-        compare), bEn.element.end() );
+  if (store)
+    write_run(*store, os);
+  else
+    write_run(EntryVector(*bib), os);
 }
 
 
-void Bibliography::sort_bib(std::vector<std::string> criteria)
+template <class Store>
+void Bibliography::write_run(const Store &st, std::ostream &os) const
+{
+  check_consistency(st);
+  for (size_t i = 0, n = st.size(); i < n; ++i) {
+    write_string(os, st.type(i));
+    write_string(os, st.key(i));
+    uint32_t count = st.count(i);
+    os.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (size_t j = 0; j < count; ++j) {
+      write_string(os, st.field(i, j));
+      write_string(os, st.value(i, j));
+      os.put(st.expression(i, j));
+    }
+  }
+  os.flush();
+}
+
+
+void Bibliography::merge_runs(std::vector<std::istream*> &runs,
+    std::vector<std::string> criteria, std::vector<std::string> only,
+    std::ostream &os) const
 {
-  // check if 'bE1' is smaller than 'bE2' using the given criteria
-  auto cmp_after_criteria =
-    [&] (const bibEntry& bE1, const bibEntry& bE2) -> bool
+  for (std::string& cur_crit : criteria)
+    CaseFold::to_lower(cur_crit);
+
+  // the current entry of every run
+  std::vector<bibEntry> heads(runs.size());
+  EntryVector st(heads);
+  // the run with the smallest entry is on top, equal entries are taken from
+  // the earlier run to keep the sort stable
+  auto after = [&] (size_t r1, size_t r2) -> bool
     {
-      for (std::string& cur_crit : criteria) {
-        std::transform(cur_crit.begin(), cur_crit.end(), cur_crit.begin(),
-            ::tolower);
-        std::string str1("");
-        std::string str2("");
-        if (cur_crit == "type") {
-          str1 = bE1.type;
-          str2 = bE2.type;
-        }
-        else if (cur_crit == "key") {
-          str1 = bE1.key;
-          str2 = bE2.key;
-        }
-        else if (cur_crit == "firstauthor") {
-          str1 = get_field_value(bE1, "author");
-          str1 = get_lastname(str1);
-          str2 = get_field_value(bE2, "author");
-          str2 = get_lastname(str2);
-        }
-        else {
-          str1 = get_field_value(bE1, cur_crit);
-          str2 = get_field_value(bE2, cur_crit);
-        }
-        if (bstring::iequals(str1, str2)) {
-          continue;
-        }
-        return bstring::ilexicographical_compare(str1, str2);
-      }
-      return false;
+      int cmp = compare_entries(st, r1, r2, criteria);
+      return cmp > 0 || (cmp == 0 && r1 > r2);
     };
-  
-  // sort bibliography stable
-  std::stable_sort(bib->begin(), bib->end(), cmp_after_criteria);
+  std::priority_queue<size_t, std::vector<size_t>, decltype(after)>
+    queue(after);
+  for (size_t r = 0; r < runs.size(); ++r)
+    if (read_run_entry(*runs[r], heads[r]))
+      queue.push(r);
+
+  // macros are defined before they are used
+  macros->print(os, !print_expanded);
+  std::vector<std::pair<size_t, size_t>> printed;
+  while (!queue.empty()) {
+    size_t r = queue.top();
+    queue.pop();
+    print_entry(st, r, only, printed, os);
+    if (read_run_entry(*runs[r], heads[r]))
+      queue.push(r);
+  }
+  os.flush();
 }
 
 
 void Bibliography::sort_elements()
 {
-  // define compare function
-  auto compare_field =
-    [] (const bibElement& bEl1, const bibElement& bEl2) -> bool 
-    {
-      if (bEl1.field < bEl2.field)
-        return true;
-      return false;
-    };
+  Transform t;
+  t.sort_elements();
+  transform(t);
+}
+
 
-  // sort elements in each entry
-  for (bibEntry& bEn : *bib) {
-    std::sort(bEn.element.begin(), bEn.element.end(), compare_field);
+void Bibliography::transform(const Transform &t)
+{
+  if (!store) {
+    for (bibEntry &bEn : *bib)
+      t.apply(bEn, true, macros.get());
+    return;
+  }
+  // the names are shared by all entries, their case is changed once and the
+  // elements are changed in place unless there are edits
+  if (!t.has_edits()) {
+    store->rename([&t] (std::string &name, bool type) {
+        t.change_case(name, type);
+      });
+    store->update(
+        [&t] (std::string_view field) { return t.keeps(field); },
+        [&t] (std::string_view field) { return t.changes_value(field); },
+        [&] (std::string_view field, std::string_view value,
+          bool &expression, std::string &result) {
+          return t.change_value(field, value, expression, macros.get(),
+              result);
+        }, t.sorts());
+    return;
+  }
+  bibEntry bEn;
+  for (size_t i = 0, n = store->size(); i < n; ++i) {
+    store->get(i, bEn);
+    t.apply(bEn, true, macros.get());
+    store->replace(i, bEn);
   }
 }
 
@@ -567,83 +990,375 @@ void Bibliography::set_field_delimiter(char beg, char end)
 }
 
 
-void Bibliography::show_missing_fields(bool only_required) const
+bool Bibliography::load_schema(std::istream &is, const std::string &source)
+{
+  return schema->load(is, source);
+}
+
+
+bool Bibliography::is_schema_field(std::string_view field) const
+{
+  return schema->field_id(field) >= 0;
+}
+
+
+void Bibliography::use_schema(const Bibliography &other)
+{
+  schema = other.schema;
+}
+
+
+void Bibliography::show_missing_fields(bool only_required,
+    std::ostream &os) const
+{
+  if (store)
+    show_missing_fields(*store, only_required, os);
+  else
+    show_missing_fields(EntryVector(*bib), only_required, os);
+}
+
+
+template <class Store>
+void Bibliography::show_missing_fields(const Store &st,
+    bool only_required, std::ostream &os) const
 {
-  // check for missing required fields
-  for (const bibEntry& bEn : *bib) {
-    std::vector<std::string> required =
-      Constants::get_required_values(bEn.type);
-    for (const std::string& current : required) {
-      bool has_required_field = false;
-      std::istringstream current_ss(current);
-      for (std::string _current; std::getline(current_ss, _current, ' '); )
-        if (!(get_field_value(bEn, _current).empty()))
-          has_required_field = true;
-      if (!has_required_field)
-        std::cerr << bEn.key << Strings::tr(Strings::OUT_MISSES_REQUIRED)
-          << current << "\"" << std::endl;
+  // the fields of an entry as bitmask over the field IDs of the schema, only
+  // the first element of a field counts
+  int crossref_id = schema->field_id("crossref");
+  auto own_fields = [&] (size_t i) -> Schema::mask {
+    Schema::mask present, seen;
+    for (size_t j = 0, m = st.count(i); j < m; ++j) {
+      int id = schema->field_id(st.field(i, j));
+      if (id < 0 || seen.test(id))
+        continue;
+      seen.set(id);
+      if (!st.value(i, j).empty())
+        present.set(id);
     }
-    if (only_required)
-      continue;
-    // check for missing optional fields
-    std::vector<std::string> optional =
-      Constants::get_optional_values(bEn.type);
-    for (const std::string& current : optional) {
-      bool has_optional_field = false;
-      std::istringstream current_ss(current);
-      for (std::string _current; std::getline(current_ss, _current, ' '); )
-        if (!(get_field_value(bEn, _current).empty()))
-          has_optional_field = true;
-      if (!has_optional_field)
-        std::cerr << bEn.key << Strings::tr(Strings::OUT_MISSES_OPTIONAL)
-          << current << "\"" << std::endl;
+    return present;
+  };
+
+  // entries also have the fields of their crossref parents, the parents are
+  // resolved before their children
+  std::vector<size_t> parents = crossref_parents(st, true);
+  std::vector<Schema::mask> inherited;
+  std::vector<char> done;
+  if (!parents.empty()) {
+    inherited.resize(st.size());
+    done.resize(st.size(), 0);
+  }
+  std::vector<size_t> chain;
+  std::string out;
+  for (size_t i = 0, n = st.size(); i < n; ++i) {
+    Schema::mask present;
+    if (parents.empty())
+      present = own_fields(i);
+    else {
+      for (size_t e = i; e != no_parent && !done[e]; e = parents[e])
+        chain.push_back(e);
+      for (auto c = chain.rbegin(); c != chain.rend(); ++c) {
+        inherited[*c] = own_fields(*c);
+        if (parents[*c] != no_parent) {
+          Schema::mask parent = inherited[parents[*c]];
+          if (crossref_id >= 0)
+            parent.reset(crossref_id);
+          inherited[*c] |= parent;
+        }
+        done[*c] = 1;
+      }
+      chain.clear();
+      present = inherited[i];
+    }
+
+    schema->check(st.type(i), present, only_required,
+        [&] (std::string_view name, bool required) {
+          Diagnostics::Category c = required ?
+            Diagnostics::MISSING_REQUIRED : Diagnostics::MISSING_OPTIONAL;
+          warn(st, i, c, name);
+          out += Diagnostics::message(c, st.key(i), name);
+          out += '\n';
+        });
+    // the report is written in large blocks
+    if (out.size() >= (1 << 16)) {
+      os.write(out.data(), out.size());
+      out.clear();
     }
   }
+  os.write(out.data(), out.size());
+  os.flush();
 }
 
 
-void Bibliography::show_missing_fields(std::vector<std::string> fields) const
+void Bibliography::show_missing_fields(std::vector<std::string> fields,
+    std::ostream &os) const
 {
-  for (const bibEntry& bEn : *bib) {
-    for (std::string& current : fields) {
-      if (get_field_value(bEn, current).empty())
-        std::cerr << bEn.key << Strings::tr(Strings::OUT_MISSING_FIELD)
-          << current << "\"" << std::endl;
+  if (store)
+    show_missing_fields(*store, fields, os);
+  else
+    show_missing_fields(EntryVector(*bib), fields, os);
+}
+
+
+template <class Store>
+void Bibliography::show_missing_fields(const Store &st,
+    const std::vector<std::string> &fields, std::ostream &os) const
+{
+  std::vector<size_t> parents = crossref_parents(st, true);
+  std::vector<std::vector<size_t>> sources;
+  for (const std::string& current : fields)
+    sources.push_back(field_sources(st, parents, current));
+  std::string out;
+  for (size_t i = 0, n = st.size(); i < n; ++i) {
+    for (size_t f = 0; f < fields.size(); ++f) {
+      const std::string &current = fields[f];
+      if (sources[f][i] == no_parent) {
+        warn(st, i, Diagnostics::MISSING_FIELD, current);
+        out += Diagnostics::message(Diagnostics::MISSING_FIELD, st.key(i),
+            current);
+        out += '\n';
+      }
+    }
+    // the report is written in large blocks
+    if (out.size() >= (1 << 16)) {
+      os.write(out.data(), out.size());
+      out.clear();
     }
   }
+  os.write(out.data(), out.size());
+  os.flush();
 }
 
 
-void Bibliography::abbreviate_month()
+void Bibliography::expand_macros()
+{
+  print_expanded = true;
+}
+
+
+void Bibliography::resolve_crossref(bool resolve)
+{
+  crossref = resolve;
+}
+
+
+void Bibliography::use_macros(std::shared_ptr<MacroTable> table)
+{
+  macros = table;
+}
+
+
+void Bibliography::check_entries(bool check)
+{
+  checked = check;
+}
+
+
+void Bibliography::inline_crossref()
 {
-  // try to find the correct abbreviation
-  for (bibEntry& bEn : *bib) {
-    for (bibElement& bEl : bEn.element) {
-      std::string field = bEl.field;
-      std::transform(field.begin(), field.end(), field.begin(), ::tolower);
-      if (field == "month")
-        bEl.value = Constants::find_month_abbreviation(bEl.value);
+  expand();
+  std::vector<size_t> parents = crossref_parents(EntryVector(*bib), true);
+  // parents are inlined before their children, so every entry only copies
+  // the fields of its direct parent
+  std::vector<char> done(bib->size(), 0);
+  std::vector<size_t> chain;
+  for (size_t i = 0, n = bib->size(); i < n; ++i) {
+    for (size_t e = i; e != no_parent && !done[e]; e = parents[e])
+      chain.push_back(e);
+    for (auto c = chain.rbegin(); c != chain.rend(); ++c) {
+      done[*c] = 1;
+      if (parents[*c] == no_parent)
+        continue;
+      std::vector<bibElement> &element = (*bib)[*c].element;
+      element.erase(std::remove_if(element.begin(), element.end(),
+            [] (const bibElement &bEl) -> bool {
+              return CaseFold::equals(bEl.field, "crossref");
+            }), element.end());
+      // own values win, empty values are replaced
+      for (const bibElement &inherited : (*bib)[parents[*c]].element) {
+        if (inherited.value.empty() ||
+            CaseFold::equals(inherited.field, "crossref"))
+          continue;
+        auto own = std::find_if(element.begin(), element.end(),
+            [&] (const bibElement &bEl) -> bool {
+              return CaseFold::equals(bEl.field, inherited.field);
+            });
+        if (own == element.end())
+          element.push_back(inherited);
+        else if (own->value.empty())
+          own->value = inherited.value;
+      }
     }
+    chain.clear();
   }
 }
 
 
-void Bibliography::delete_redundant_entries()
+template <class Store>
+void Bibliography::warn(const Store &st, size_t i,
+    Diagnostics::Category category, std::string_view detail) const
+{
+  diagnostics->report(category, st.key(i), detail, st.source(i),
+      st.offset(i));
+}
+
+
+template <class Store>
+std::vector<size_t> Bibliography::crossref_parents(const Store &st,
+    bool report) const
+{
+  if (!crossref)
+    return std::vector<size_t>();
+
+  // the first entry with a key is used if a key is defined more than once
+  std::unordered_map<std::string_view, size_t, CaseFold::hasher,
+    CaseFold::equal_to> index;
+  index.reserve(st.size());
+  for (size_t i = 0, n = st.size(); i < n; ++i)
+    index.emplace(st.key(i), i);
+
+  std::vector<size_t> parents(st.size(), no_parent);
+  for (size_t i = 0, n = st.size(); i < n; ++i) {
+    std::string_view parent = st.get_field_value(i, "crossref");
+    if (parent.empty())
+      continue;
+    auto it = index.find(parent);
+    if (it != index.end())
+      parents[i] = it->second;
+    else if (report)
+      warn(st, i, Diagnostics::UNKNOWN_CROSSREF, parent);
+  }
+
+  // follow every chain once: 0 unvisited, 1 on the current chain, 2 done
+  std::vector<char> state(st.size(), 0);
+  std::vector<size_t> chain;
+  for (size_t i = 0, n = st.size(); i < n; ++i) {
+    size_t e = i;
+    for (; e != no_parent && state[e] == 0; e = parents[e]) {
+      state[e] = 1;
+      chain.push_back(e);
+    }
+    // the chain leads back to itself, drop the link that closes the cycle
+    if (e != no_parent && state[e] == 1) {
+      parents[chain.back()] = no_parent;
+      if (report)
+        warn(st, chain.back(), Diagnostics::CROSSREF_CYCLE);
+    }
+    for (size_t c : chain)
+      state[c] = 2;
+    chain.clear();
+  }
+  return parents;
+}
+
+
+template <class Store>
+std::vector<size_t> Bibliography::field_sources(const Store &st,
+    const std::vector<size_t> &parents, std::string_view field) const
+{
+  // the crossref field itself is never inherited
+  bool inherit = !parents.empty() && !CaseFold::equals(field, "crossref");
+  std::vector<size_t> sources(st.size(), no_parent);
+  std::vector<char> done(st.size(), 0);
+  std::vector<size_t> chain;
+  for (size_t i = 0, n = st.size(); i < n; ++i) {
+    // go up until an entry defines the field or its source is known
+    size_t e = i;
+    while (e != no_parent && !done[e]) {
+      if (!st.get_field_value(e, field).empty()) {
+        sources[e] = e;
+        done[e] = 1;
+        break;
+      }
+      chain.push_back(e);
+      e = inherit ? parents[e] : no_parent;
+    }
+    size_t source = (e == no_parent) ? no_parent : sources[e];
+    for (size_t c : chain) {
+      sources[c] = source;
+      done[c] = 1;
+    }
+    chain.clear();
+  }
+  return sources;
+}
+
+
+void Bibliography::abbreviate_month()
+{
+  Transform t;
+  t.abbreviate_month();
+  transform(t);
+}
+
+
+size_t Bibliography::element_hash(std::string_view field,
+    std::string_view value) const
+{
+  return CaseFold::hash(field) * 31 + std::hash<std::string_view>()(value);
+}
+
+
+template <class Store>
+void Bibliography::delete_redundant_entries(Store &st)
 {
-  for (bibEntry &bEn: *bib) {
-    for (const bibEntry &cmp : *bib) {
+  // the skipped elements of projected entries are only known by their hashes,
+  // entries added without them cannot be checked
+  if (projection) {
+    if (element_hashes.size() == st.size())
+      delete_redundant_projected(st);
+    return;
+  }
+
+  // index all elements by field and value, an entry can only be a subset of
+  // the entries that contain each of its elements
+  std::vector< std::pair<size_t, size_t> > index;
+  std::unordered_map<std::string_view, unsigned int, CaseFold::hasher,
+    CaseFold::equal_to> type_count;
+  for (size_t i = 0, n = st.size(); i < n; ++i) {
+    for (size_t j = 0, m = st.count(i); j < m; ++j)
+      index.push_back(std::make_pair(
+            element_hash(st.field(i, j), st.value(i, j)), i));
+    ++type_count[st.type(i)];
+  }
+  std::sort(index.begin(), index.end());
+
+  for (size_t i = 0, n = st.size(); i < n; ++i) {
+    size_t size = st.count(i);
+    // entries without elements are redundant if the type is used elsewhere
+    if (size == 0) {
+      if (type_count[st.type(i)] > 1)
+        warn(st, i, Diagnostics::REDUNDANT_ENTRY);
+      continue;
+    }
+    // use the element shared by the fewest entries to find candidates
+    auto first = index.end(), last = index.end();
+    for (size_t j = 0; j < size; ++j) {
+      auto range = std::equal_range(index.begin(), index.end(),
+          std::make_pair(element_hash(st.field(i, j), st.value(i, j)),
+            size_t(0)),
+          [] (const std::pair<size_t, size_t> &p1,
+            const std::pair<size_t, size_t> &p2) -> bool {
+            return p1.first < p2.first;
+          });
+      if (first == index.end() || range.second-range.first < last-first) {
+        first = range.first;
+        last = range.second;
+      }
+    }
+    for (auto it = first; it != last; ++it) {
+      size_t cmp = it->second;
       // do not compare to itself
-      if (&bEn == &cmp) {
+      if (cmp == i) {
         continue;
       }
       // do not compare to smaller entries (greater is allowed)
-      if (cmp.element.size() < bEn.element.size()) {
+      if (st.count(cmp) < size) {
         continue;
       }
       // compare elements, continue if mismatch
       bool field_mismatch = false;
-      for (const bibElement &bEl : bEn.element) {
-        if (bEl.value != get_field_value(cmp, bEl.field)) {
+      for (size_t j = 0; j < size; ++j) {
+        if (st.value(i, j) != st.get_field_value(cmp, st.field(i, j))) {
           field_mismatch = true;
           break;
         }
@@ -652,27 +1367,114 @@ void Bibliography::delete_redundant_entries()
         continue;
       }
       // compare types
-      std::string type1(bEn.type), type2(cmp.type);
-      std::transform(type1.begin(), type1.end(), type1.begin(), ::tolower);
-      std::transform(type2.begin(), type2.end(), type2.begin(), ::tolower);
-      if (type1 != type2) {
+      if (!CaseFold::equals(st.type(i), st.type(cmp))) {
         continue;
       }
-      // if we are still here, bEn is a subset of an other entry
+      // if we are still here, entry 'i' is a subset of an other entry
       // clear element vector of redundant entries
-      bEn.element.clear();
-      std::cerr << Strings::tr(Strings::ERR_REDUNDANT_ENTRY_1) << bEn.key
-        << Strings::tr(Strings::ERR_REDUNDANT_ENTRY_2);
+      st.clear(i);
+      warn(st, i, Diagnostics::REDUNDANT_ENTRY);
       break;
     }
     // no match was found
   }
 
-  //delete entries with empty element vector
-  bib->erase( std::remove_if(bib->begin(), bib->end(),
-      // check if bEn is empty
-      [](const bibEntry &bEn) -> bool {
-        return bEn.element.empty();
+  //delete entries without elements
+  st.remove_empty();
+}
+
+
+template <class Store>
+void Bibliography::delete_redundant_projected(Store &st)
+{
+  // index the hashes of all elements, an entry can only be a subset of the
+  // entries that contain each of its elements
+  std::vector< std::pair<size_t, size_t> > index;
+  std::unordered_map<std::string_view, unsigned int, CaseFold::hasher,
+    CaseFold::equal_to> type_count;
+  for (size_t i = 0, n = st.size(); i < n; ++i) {
+    std::vector<size_t> &hashes = element_hashes[i];
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+    for (size_t h : hashes)
+      index.push_back(std::make_pair(h, i));
+    ++type_count[st.type(i)];
+  }
+  std::sort(index.begin(), index.end());
+
+  std::vector<bool> removed(st.size(), false);
+  for (size_t i = 0, n = st.size(); i < n; ++i) {
+    const std::vector<size_t> &hashes = element_hashes[i];
+    // entries without elements are redundant if the type is used elsewhere
+    if (hashes.empty()) {
+      if (type_count[st.type(i)] > 1)
+        warn(st, i, Diagnostics::REDUNDANT_ENTRY);
+      removed[i] = true;
+      continue;
+    }
+    // use the element shared by the fewest entries to find candidates
+    auto first = index.end(), last = index.end();
+    for (size_t h : hashes) {
+      auto range = std::equal_range(index.begin(), index.end(),
+          std::make_pair(h, size_t(0)),
+          [] (const std::pair<size_t, size_t> &p1,
+            const std::pair<size_t, size_t> &p2) -> bool {
+            return p1.first < p2.first;
+          });
+      if (first == index.end() || range.second-range.first < last-first) {
+        first = range.first;
+        last = range.second;
       }
-      ), bib->end() );
+    }
+    for (auto it = first; it != last; ++it) {
+      size_t cmp = it->second;
+      const std::vector<size_t> &other = element_hashes[cmp];
+      if (cmp == i || removed[cmp] || other.size() < hashes.size())
+        continue;
+      // all elements must be contained, the kept ones are compared directly
+      if (!std::includes(other.begin(), other.end(), hashes.begin(),
+            hashes.end()))
+        continue;
+      bool field_mismatch = false;
+      for (size_t j = 0, m = st.count(i); j < m; ++j) {
+        if (st.value(i, j) != st.get_field_value(cmp, st.field(i, j))) {
+          field_mismatch = true;
+          break;
+        }
+      }
+      if (field_mismatch || !CaseFold::equals(st.type(i), st.type(cmp)))
+        continue;
+      warn(st, i, Diagnostics::REDUNDANT_ENTRY);
+      removed[i] = true;
+      break;
+    }
+  }
+
+  // delete the redundant entries and their hashes
+  std::vector<size_t> order;
+  for (size_t i = 0; i < removed.size(); ++i)
+    if (!removed[i])
+      order.push_back(i);
+  if (order.size() == removed.size())
+    return;
+  st.permute(order);
+  std::vector< std::vector<size_t> > kept;
+  kept.reserve(order.size());
+  for (size_t i : order)
+    kept.push_back(std::move(element_hashes[i]));
+  element_hashes.swap(kept);
+}
+
+
+void Bibliography::find_duplicates(double threshold, std::ostream &os) const
+{
+  // the finder works on entries, copy them from the compact storage
+  std::vector<bibEntry> copy;
+  if (store) {
+    copy.resize(store->size());
+    for (size_t i = 0; i < store->size(); ++i)
+      store->get(i, copy[i]);
+  }
+  DuplicateFinder finder(store ? copy : *bib);
+  finder.report(threshold, os);
 }
@@ -21,12 +21,26 @@
 #ifndef BIBLIOGRAPHY_H
 #define BIBLIOGRAPHY_H
 
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
+#include "Diagnostics.hpp"
 
 // Forward declaration of user-defined types
+class bibElement;
 class bibEntry;
+class CompactStore;
+class KeyTemplate;
+class MacroTable;
+class Merger;
+class NameCache;
+class Schema;
+class Transform;
 
 class Bibliography
 {
@@ -37,8 +51,33 @@ class Bibliography
     // Destructor
     ~Bibliography();
 
-    // Add the content of a stream to the bibliography
-    void add(std::istream &is);
+    // Not copyable, the storages, the caches and the diagnostics are owned
+    // and deleted by the destructor
+    Bibliography(const Bibliography&) = delete;
+    Bibliography& operator=(const Bibliography&) = delete;
+
+    // Add the content of a stream to the bibliography, 'source' names it in
+    // the diagnostics
+    void add(std::istream &is, const std::string &source = "-");
+
+    // Move the entries in 'entries' to the bibliography
+    void add(std::vector<bibEntry> &entries);
+
+    // Keep all entries in a memory efficient storage, should be called
+    // before any other function
+    void use_compact_storage();
+
+    // Join the content of a stream into the bibliography, entries that
+    // already exist (same DOI or key) are combined using the merge policy.
+    // 'source' identifies the stream in the conflict report.
+    void merge(std::istream &is, const std::string &source);
+
+    // Set the policy used by merge()
+    // Valid values: F (prefer first), N (prefer newest), U (union of fields)
+    void set_merge_policy(const char policy);
+
+    // Print the conflicts found by merge() to 'os'
+    void write_merge_report(std::ostream &os) const;
 
     // Create new entry with the standard fields
     void create_entry();
@@ -47,6 +86,10 @@ class Bibliography
     // last name of the first author + last two digits of the year + {a,b,c...}
     void create_keys();
 
+    // Changes all keys to 'scheme', letters (a,b,...,z,aa,...) are added in
+    // the order of the entries to keys that occur more than once
+    void create_keys(const KeyTemplate &scheme);
+
     // Changes every bibEntry.type in 'bib' to lower (case_t=='L'),
     // upper case (case_t=='U') or start case (case_t='S')
     // Change the case of every bibEntry.type to 'case_t'
@@ -65,12 +108,28 @@ class Bibliography
     // Sort the elements of every entry in alphabetical order
     void sort_elements();
 
-    // Prints missing required fields of each entry
+    // Apply the per-entry transformations 't' in one pass over all entries
+    void transform(const Transform &t);
+
+    // Read required and optional fields of entry types from the schema file
+    // 'is', returns false if the file has errors
+    bool load_schema(std::istream &is, const std::string &source);
+
+    // True if 'field' is required or optional in any type of the schema
+    bool is_schema_field(std::string_view field) const;
+
+    // Use the schemas loaded into 'other' instead of loading them again, the
+    // schemas are shared
+    void use_schema(const Bibliography &other);
+
+    // Prints missing required fields of each entry to 'os'
     // if 'only_required' == false optional missing fields are shown too
-    void show_missing_fields(bool only_required = true) const;
+    void show_missing_fields(bool only_required = true,
+        std::ostream &os = std::cerr) const;
 
     // Show all entries that do not define the fields in 'fields'
-    void show_missing_fields(std::vector<std::string> fields) const;
+    void show_missing_fields(std::vector<std::string> fields,
+        std::ostream &os = std::cerr) const;
 
     // Set intendation used before every bibElement
     void set_intendation(const std::string &str);
@@ -90,13 +149,90 @@ class Bibliography
     // Print only the field defined in 'print_only' (case insensitive)
     void print_bib(std::vector<std::string> only, std::ostream &os) const;
 
+    // Write all entries to 'os' in a binary format, used for the sorted runs
+    // of an external sort
+    void write_run(std::ostream &os) const;
+
+    // Merge the runs written by write_run(), each sorted after 'criteria',
+    // and print the entries (only the fields in 'only' if not empty) to 'os'
+    void merge_runs(std::vector<std::istream*> &runs,
+        std::vector<std::string> criteria, std::vector<std::string> only,
+        std::ostream &os) const;
+
     // Try to find the correct abbreviations for the month field
     void abbreviate_month();
 
+    // Print the values of the @string macros instead of the macros, the
+    // @string definitions are left out
+    void expand_macros();
+
+    // Inherit fields through crossref (default), should be disabled if the
+    // bibliography holds only a part of the entries
+    void resolve_crossref(bool resolve);
+
+    // Use the @string macros and @preambles of 'table', which is shared with
+    // other bibliographies holding a part of the same entries. Definitions
+    // of the table that were not printed yet are printed by print_bib() and
+    // merge_runs().
+    void use_macros(std::shared_ptr<MacroTable> table);
+
+    // Delete redundant entries and report empty and duplicate keys (default),
+    // should be disabled if the entries were checked while they were read
+    void check_entries(bool check);
+
+    // Copy the fields an entry inherits from its crossref parents into the
+    // entry and remove its crossref field
+    void inline_crossref();
+
+    // Parse only the fields for which 'keep' returns true in the following
+    // calls of add(), crossref and title are always kept. The skipped fields
+    // are hashed while parsing to check the entries for redundancy.
+    void set_projection(std::function<bool(std::string_view)> keep);
+
+    // Print clusters of probable duplicates with a similarity of at least
+    // 'threshold' to the stream 'os'
+    void find_duplicates(double threshold, std::ostream &os) const;
+
+    // Warnings about the entries found so far
+    const Diagnostics& get_diagnostics() const { return *diagnostics; }
+
   private:
     // Internal representation of the bibliography
     std::vector<bibEntry> *bib;
 
+    // Compact storage used instead of 'bib' after use_compact_storage()
+    CompactStore *store;
+
+    // Joins entries in merge(), only allocated if merge() is used
+    Merger *merger;
+
+    // Parsed author names, filled on first use
+    NameCache *names;
+
+    // Required and optional fields of the entry types
+    std::shared_ptr<Schema> schema;
+
+    // @string macros and @preambles of all added streams
+    std::shared_ptr<MacroTable> macros;
+
+    // Warnings of the checks, which are const
+    Diagnostics *diagnostics;
+
+    // Fields parsed by add(), all fields if empty
+    std::function<bool(std::string_view)> projection;
+
+    // Hashes of all elements of the projected entries, one vector per entry
+    std::vector< std::vector<size_t> > element_hashes;
+
+    // Expand macros on output, standard value false
+    bool print_expanded;
+
+    // Inherit fields through crossref, standard value true
+    bool crossref;
+
+    // Check redundancy and keys, standard value true
+    bool checked;
+
     // Use intendation, standard value "  "
     std::string intend;
 
@@ -111,22 +247,78 @@ class Bibliography
     // Use left or right alignment for the field names (default right)
     bool right_aligned;
     
-    // Returns the last name of the first author
-    std::string get_lastname(std::string author) const;
+    // Returns the last name of the first author in the field value 'author'
+    std::string get_lastname(std::string_view author) const;
 
     // Returns the value of 'field' in the bibEntry 'bE'
     // 'field' is case insensitive
-    std::string get_field_value(const bibEntry& bE, std::string field) const;
+    const std::string& get_field_value(const bibEntry& bE,
+        std::string_view field) const;
 
     // Removes all characters not allowed in the key of a bibtex entry
     std::string clean_key(std::string key) const;
 
     // Checks if the given string is a numerical value
-    bool is_numerical(const std::string &s) const;
+    bool is_numerical(std::string_view s) const;
 
     // Do some basic consistency checking
     void check_consistency() const;
 
+    // Move all entries from the compact storage back to 'bib'
+    void expand();
+
+    // Implementations of the public functions for both storages, 'Store' is
+    // CompactStore or EntryVector
+    template <class Store>
+    void print_bib(const Store &st, const std::vector<std::string> &only,
+        std::ostream &os) const;
+    template <class Store>
+    void print_entry(const Store &st, size_t i,
+        const std::vector<std::string> &only,
+        std::vector<std::pair<size_t, size_t>> &printed, std::ostream &os,
+        const std::vector<std::vector<size_t>> *sources = nullptr) const;
+    template <class Store>
+    void check_consistency(const Store &st) const;
+    template <class Store>
+    std::vector<size_t> sort_order(const Store &st,
+        std::vector<std::string> criteria) const;
+    template <class Store>
+    int compare_entries(const Store &st, size_t i1, size_t i2,
+        const std::vector<std::string> &criteria,
+        const std::vector<std::string> *lastnames = nullptr,
+        const std::vector<std::vector<size_t>> *sources = nullptr) const;
+    template <class Store>
+    void write_run(const Store &st, std::ostream &os) const;
+    template <class Store>
+    void create_keys(Store &st, const KeyTemplate &scheme);
+    template <class Store>
+    void show_missing_fields(const Store &st, bool only_required,
+        std::ostream &os) const;
+    template <class Store>
+    void show_missing_fields(const Store &st,
+        const std::vector<std::string> &fields, std::ostream &os) const;
+
+    // Record a warning about entry 'i' of 'st'
+    template <class Store>
+    void warn(const Store &st, size_t i, Diagnostics::Category category,
+        std::string_view detail = std::string_view()) const;
+
+    // Returns the index of the crossref parent of every entry or 'no_parent'
+    // using a hash index of the keys. Links to unknown keys and links that
+    // close a cycle are dropped and reported if 'report' is true.
+    template <class Store>
+    std::vector<size_t> crossref_parents(const Store &st, bool report) const;
+
+    // Returns for every entry the index of the entry that provides the value
+    // of 'field': the entry itself, its nearest crossref parent with a non
+    // empty value or 'no_parent'. Every chain is followed only once.
+    template <class Store>
+    std::vector<size_t> field_sources(const Store &st,
+        const std::vector<size_t> &parents, std::string_view field) const;
+
+    // Marks an entry without crossref parent
+    static constexpr size_t no_parent = static_cast<size_t>(-1);
+
     // Insert line breaks into 'str' such that every line contains 'linebreak'
     // characters or less. Insert 'intend' before every new line.
     std::string break_string(std::string str, const std::string &intend) const;
@@ -137,7 +329,16 @@ class Bibliography
       const;
 
     // Delete redundant entries, i.e. entrys that are a subset of another entry
-    void delete_redundant_entries();
+    template <class Store>
+    void delete_redundant_entries(Store &st);
+
+    // Delete redundant projected entries, which are compared by the hashes
+    // of all their elements
+    template <class Store>
+    void delete_redundant_projected(Store &st);
+
+    // Returns a hash of the lower case 'field' and 'value'
+    size_t element_hash(std::string_view field, std::string_view value) const;
 
 };
 
@@ -0,0 +1,149 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CASEFOLD_H
+#define CASEFOLD_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// Locale independent ASCII case folding. All functions work on eight bytes
+// at once and never copy their arguments. Bytes >= 0x80 are left unchanged.
+class CaseFold
+{
+  public:
+    // returns the lower case of the ASCII character 'c'
+    static char to_lower(char c)
+      { return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c; }
+
+    // returns the upper case of the ASCII character 'c'
+    static char to_upper(char c)
+      { return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c; }
+
+    // converts 'str' to lower case in place
+    static void to_lower(std::string &str)
+      { transform(&str[0], str.size(), 'A'); }
+
+    // converts 'str' to upper case in place
+    static void to_upper(std::string &str)
+      { transform(&str[0], str.size(), 'a'); }
+
+    // case insensitive equality of 's1' and 's2'
+    static bool equals(std::string_view s1, std::string_view s2)
+    {
+      if (s1.size() != s2.size())
+        return false;
+      size_t i = 0, len = s1.size();
+      for (; i+8 <= len; i += 8)
+        if (lower8(load(s1.data()+i)) != lower8(load(s2.data()+i)))
+          return false;
+      for (; i < len; ++i)
+        if (to_lower(s1[i]) != to_lower(s2[i]))
+          return false;
+      return true;
+    }
+
+    // case insensitive three-way comparison, returns <0, 0 or >0
+    static int compare(std::string_view s1, std::string_view s2)
+    {
+      size_t len = s1.size() < s2.size() ? s1.size() : s2.size();
+      size_t i = 0;
+      // skip equal blocks, the differing byte is compared below
+      while (i+8 <= len &&
+          lower8(load(s1.data()+i)) == lower8(load(s2.data()+i)))
+        i += 8;
+      for (; i < len; ++i) {
+        unsigned char c1 = to_lower(s1[i]), c2 = to_lower(s2[i]);
+        if (c1 != c2)
+          return c1 < c2 ? -1 : 1;
+      }
+      if (s1.size() == s2.size())
+        return 0;
+      return s1.size() < s2.size() ? -1 : 1;
+    }
+
+    // case insensitive hash of 'str'
+    static size_t hash(std::string_view str)
+    {
+      uint64_t h = 0xcbf29ce484222325ULL ^ str.size();
+      size_t i = 0, len = str.size();
+      for (; i+8 <= len; i += 8) {
+        h = (h ^ lower8(load(str.data()+i))) * 0x100000001b3ULL;
+        h ^= h >> 29;
+      }
+      for (; i < len; ++i)
+        h = (h ^ static_cast<unsigned char>(to_lower(str[i])))
+          * 0x100000001b3ULL;
+      return h ^ (h >> 32);
+    }
+
+    // function objects for unordered containers and sorting
+    struct hasher {
+      size_t operator()(std::string_view str) const { return hash(str); }
+    };
+    struct equal_to {
+      bool operator()(std::string_view s1, std::string_view s2) const
+        { return equals(s1, s2); }
+    };
+    struct less {
+      bool operator()(std::string_view s1, std::string_view s2) const
+        { return compare(s1, s2) < 0; }
+    };
+
+  private:
+    // unaligned load of eight bytes
+    static uint64_t load(const char *p)
+    {
+      uint64_t x;
+      std::memcpy(&x, p, sizeof(x));
+      return x;
+    }
+
+    // sets the high bit of every byte of 'x' in the range [first, first+25]
+    static uint64_t in_range(uint64_t x, unsigned char first)
+    {
+      const uint64_t ones = 0x0101010101010101ULL;
+      const uint64_t high = 0x8080808080808080ULL;
+      uint64_t low7 = x & ~high;
+      uint64_t ge_first = low7 + ones * (0x80 - first);
+      uint64_t gt_last = low7 + ones * (0x80 - first - 26);
+      return (ge_first ^ gt_last) & ~x & high;
+    }
+
+    // converts all upper case letters of the eight bytes in 'x' to lower case
+    static uint64_t lower8(uint64_t x) { return x | (in_range(x, 'A') >> 2); }
+
+    // flips the case of all letters in 'p' that start at 'first' ('A' or 'a')
+    static void transform(char *p, size_t len, unsigned char first)
+    {
+      size_t i = 0;
+      for (; i+8 <= len; i += 8) {
+        uint64_t x = load(p+i);
+        x ^= in_range(x, first) >> 2;
+        std::memcpy(p+i, &x, sizeof(x));
+      }
+      for (; i < len; ++i)
+        p[i] = (first == 'A') ? to_lower(p[i]) : to_upper(p[i]);
+    }
+};
+
+#endif
@@ -0,0 +1,179 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+// Benchmark of the case insensitive field handling on a field-heavy
+// workload, run by 'make bench-fields'. Every operation is timed with
+// CaseFold and with the lower case copies made by ::tolower that it
+// replaced. Exits with 1 if CaseFold is slower.
+
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "CaseFold.hpp"
+
+struct field {
+  std::string name;
+  std::string value;
+};
+
+typedef std::vector<std::vector<field>> entries;
+
+// entries with 'fields' fields each, names in mixed case as found in files
+static entries generate(size_t count, size_t fields)
+{
+  static const char *names[] = {"Author", "TITLE", "journal", "Year",
+    "Volume", "NUMBER", "pages", "Month", "DOI", "url", "Abstract",
+    "Keywords", "publisher", "ISSN", "Note", "Editor"};
+  const size_t name_cnt = sizeof(names)/sizeof(names[0]);
+  std::mt19937 gen(42);
+  entries result(count);
+  for (std::vector<field> &fl : result)
+    for (size_t i = 0; i < fields; ++i) {
+      std::string value(8 + gen() % 24, ' ');
+      for (char &c : value)
+        c = "abcdefghijKLMNOPQRST"[gen() % 20];
+      fl.push_back({names[(i + gen() % 3) % name_cnt], value});
+    }
+  return result;
+}
+
+// value of the field 'name' like get_field_value before CaseFold
+static std::string lookup_copy(const std::vector<field> &fl,
+    std::string name)
+{
+  std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+  for (const field &f : fl) {
+    std::string current = f.name;
+    std::transform(current.begin(), current.end(), current.begin(),
+        ::tolower);
+    if (current == name)
+      return f.value;
+  }
+  return "";
+}
+
+// value of the field 'name' like get_field_value with CaseFold
+static const std::string& lookup_fold(const std::vector<field> &fl,
+    std::string_view name)
+{
+  static const std::string empty;
+  for (const field &f : fl)
+    if (CaseFold::equals(f.name, name))
+      return f.value;
+  return empty;
+}
+
+// milliseconds taken by 'run'
+template<typename F>
+static double measure(F run)
+{
+  auto start = std::chrono::steady_clock::now();
+  run();
+  std::chrono::duration<double, std::milli> elapsed =
+    std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+int main()
+{
+  const entries bib = generate(100000, 16);
+  const char *queries[] = {"author", "Title", "YEAR", "pages", "missing"};
+  size_t sink = 0;
+  double copy_ms = 0, fold_ms = 0;
+
+  // field lookups, the work of --only, --erase-field and the reports
+  double copy_t = measure([&] {
+      for (const std::vector<field> &fl : bib)
+        for (const char *q : queries)
+          sink += lookup_copy(fl, q).size();
+    });
+  double fold_t = measure([&] {
+      for (const std::vector<field> &fl : bib)
+        for (const char *q : queries)
+          sink += lookup_fold(fl, q).size();
+    });
+  std::cout << "field lookup:  tolower " << copy_t << " ms, CaseFold "
+    << fold_t << " ms\n";
+  copy_ms += copy_t;
+  fold_ms += fold_t;
+
+  // sorting by a field value, the work of --sort-bib
+  std::vector<size_t> order(bib.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::vector<size_t> sorted = order;
+  copy_t = measure([&] {
+      std::sort(sorted.begin(), sorted.end(), [&] (size_t i1, size_t i2) {
+          std::string v1 = lookup_copy(bib[i1], "title");
+          std::string v2 = lookup_copy(bib[i2], "title");
+          std::transform(v1.begin(), v1.end(), v1.begin(), ::tolower);
+          std::transform(v2.begin(), v2.end(), v2.begin(), ::tolower);
+          return v1 < v2;
+        });
+    });
+  sink += sorted.front();
+  sorted = order;
+  fold_t = measure([&] {
+      std::sort(sorted.begin(), sorted.end(), [&] (size_t i1, size_t i2) {
+          return CaseFold::compare(lookup_fold(bib[i1], "title"),
+              lookup_fold(bib[i2], "title")) < 0;
+        });
+    });
+  sink += sorted.front();
+  std::cout << "sort by field: tolower " << copy_t << " ms, CaseFold "
+    << fold_t << " ms\n";
+  copy_ms += copy_t;
+  fold_ms += fold_t;
+
+  // counting field names, the work of the field tables and schemas
+  copy_t = measure([&] {
+      std::unordered_map<std::string, size_t> count;
+      for (const std::vector<field> &fl : bib)
+        for (const field &f : fl) {
+          std::string name = f.name;
+          std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+          ++count[name];
+        }
+      sink += count.size();
+    });
+  fold_t = measure([&] {
+      std::unordered_map<std::string_view, size_t, CaseFold::hasher,
+        CaseFold::equal_to> count;
+      for (const std::vector<field> &fl : bib)
+        for (const field &f : fl)
+          ++count[f.name];
+      sink += count.size();
+    });
+  std::cout << "field names:   tolower " << copy_t << " ms, CaseFold "
+    << fold_t << " ms\n";
+  copy_ms += copy_t;
+  fold_ms += fold_t;
+
+  std::cout << "total:         tolower " << copy_ms << " ms, CaseFold "
+    << fold_ms << " ms (" << copy_ms / fold_ms << "x, checksum " << sink
+    << ")\n";
+  return fold_ms < copy_ms ? 0 : 1;
+}
@@ -0,0 +1,57 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef CHUNKBUFFER_H
+#define CHUNKBUFFER_H
+
+#include <streambuf>
+#include <string>
+#include "SpscQueue.hpp"
+
+// Stream buffer that reads the chunks of a queue, the stream ends when the
+// queue is closed
+class ChunkBuffer : public std::streambuf
+{
+  public:
+    // Constructor
+    ChunkBuffer(SpscQueue<std::string> &_chunks) : chunks(_chunks) {}
+
+  protected:
+    int_type underflow() override
+    {
+      // skip empty chunks
+      do {
+        if (!chunks.pop(current))
+          return traits_type::eof();
+      } while (current.empty());
+      setg(&current[0], &current[0], &current[0]+current.size());
+      return traits_type::to_int_type(current[0]);
+    }
+
+  private:
+    // Source of the chunks
+    SpscQueue<std::string> &chunks;
+
+    // Chunk that is read at the moment
+    std::string current;
+};
+
+#endif
@@ -0,0 +1,179 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <utility>
+#include "CaseFold.hpp"
+#include "DataStructure.hpp"
+#include "CompactStore.hpp"
+
+void CompactStore::reserve(size_t bytes)
+{
+  buffer.reserve(buffer.size() + bytes);
+}
+
+
+uint64_t CompactStore::append(std::string_view str)
+{
+  uint64_t off = buffer.size();
+  buffer.append(str.data(), str.size());
+  return off;
+}
+
+
+uint32_t CompactStore::intern(const std::string &name,
+    std::vector<std::string> &names,
+    std::unordered_map<std::string, uint32_t> &ids)
+{
+  auto ins = ids.insert(std::make_pair(name, uint32_t(names.size())));
+  if (ins.second)
+    names.push_back(name);
+  return ins.first->second;
+}
+
+
+void CompactStore::push_back(const bibEntry &bEn)
+{
+  entry e;
+  e.key_off = append(bEn.key);
+  e.key_len = bEn.key.size();
+  e.type_id = intern(bEn.type, type_names, type_ids);
+  e.first = elements.size();
+  e.count = bEn.element.size();
+  e.offset = bEn.offset;
+  e.source = (bEn.source <= 0xffff) ? bEn.source : 0;
+  for (const bibElement &bEl : bEn.element) {
+    element el;
+    el.value_off = append(bEl.value);
+    el.value_len = bEl.value.size();
+    el.field_id = intern(bEl.field, field_names, field_ids);
+    el.expression = bEl.expression;
+    elements.push_back(el);
+  }
+  entries.push_back(e);
+}
+
+
+void CompactStore::get(size_t i, bibEntry &bEn) const
+{
+  bEn.type = type(i);
+  bEn.key = key(i);
+  bEn.source = source(i);
+  bEn.offset = offset(i);
+  bEn.element.resize(count(i));
+  for (size_t j = 0; j < count(i); ++j) {
+    bEn.element[j].field = field(i, j);
+    bEn.element[j].value = value(i, j);
+    bEn.element[j].expression = expression(i, j);
+  }
+}
+
+
+std::string_view CompactStore::get_field_value(size_t i,
+    std::string_view field) const
+{
+  const entry &e = entries[i];
+  for (uint32_t j = e.first, end = e.first+e.count; j < end; ++j)
+    if (CaseFold::equals(field_names[elements[j].field_id], field))
+      return view(elements[j].value_off, elements[j].value_len);
+  return std::string_view();
+}
+
+
+void CompactStore::set_key(size_t i, std::string_view key)
+{
+  // reuse the old space if the new key fits
+  if (key.size() > entries[i].key_len)
+    entries[i].key_off = append(key);
+  else
+    buffer.replace(entries[i].key_off, key.size(), key.data(), key.size());
+  entries[i].key_len = key.size();
+}
+
+
+void CompactStore::set_value(size_t i, size_t j, std::string_view value)
+{
+  element &el = elements[entries[i].first+j];
+  if (value.size() > el.value_len)
+    el.value_off = append(value);
+  else
+    buffer.replace(el.value_off, value.size(), value.data(), value.size());
+  el.value_len = value.size();
+}
+
+
+void CompactStore::remove_empty()
+{
+  entries.erase(std::remove_if(entries.begin(), entries.end(),
+        [] (const entry &e) -> bool { return e.count == 0; }),
+      entries.end());
+}
+
+
+void CompactStore::permute(const std::vector<size_t> &order)
+{
+  std::vector<entry> sorted;
+  sorted.reserve(order.size());
+  for (size_t i : order)
+    sorted.push_back(entries[i]);
+  entries.swap(sorted);
+}
+
+
+void CompactStore::replace(size_t i, const bibEntry &bEn)
+{
+  // elements that do not fit into the old ones are appended
+  entry &e = entries[i];
+  if (bEn.element.size() > e.count) {
+    e.first = elements.size();
+    elements.resize(elements.size() + bEn.element.size(), element());
+  }
+  e.count = bEn.element.size();
+  e.type_id = intern(bEn.type, type_names, type_ids);
+  e.offset = bEn.offset;
+  e.source = (bEn.source <= 0xffff) ? bEn.source : 0;
+  set_key(i, bEn.key);
+  for (size_t j = 0; j < bEn.element.size(); ++j) {
+    const bibElement &bEl = bEn.element[j];
+    element &el = elements[e.first+j];
+    el.field_id = intern(bEl.field, field_names, field_ids);
+    el.expression = bEl.expression;
+    set_value(i, j, bEl.value);
+  }
+}
+
+
+void CompactStore::reindex()
+{
+  type_ids.clear();
+  for (size_t i = 0; i < type_names.size(); ++i)
+    type_ids.insert(std::make_pair(type_names[i], uint32_t(i)));
+  field_ids.clear();
+  for (size_t i = 0; i < field_names.size(); ++i)
+    field_ids.insert(std::make_pair(field_names[i], uint32_t(i)));
+}
+
+
+void CompactStore::shrink_to_fit()
+{
+  // the buffer is not shrunk, the copy would double the peak memory usage
+  entries.shrink_to_fit();
+  elements.shrink_to_fit();
+}
@@ -0,0 +1,217 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPACTSTORE_H
+#define COMPACTSTORE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Forward declaration of user-defined types
+class bibEntry;
+
+// Memory efficient storage of a bibliography: all keys and values are kept
+// in one contiguous buffer, entries and elements are flat arrays of offsets
+// and type and field names are interned.
+class CompactStore
+{
+  public:
+    // Reserve space for 'bytes' bytes of keys and values
+    void reserve(size_t bytes);
+
+    // Append a copy of 'bEn'
+    void push_back(const bibEntry &bEn);
+
+    // Copy the entry 'i' into 'bEn'
+    void get(size_t i, bibEntry &bEn) const;
+
+    // Number of entries
+    size_t size() const { return entries.size(); }
+
+    // Type and key of entry 'i'
+    std::string_view type(size_t i) const
+      { return type_names[entries[i].type_id]; }
+    std::string_view key(size_t i) const
+      { return view(entries[i].key_off, entries[i].key_len); }
+
+    // Number of elements of entry 'i'
+    size_t count(size_t i) const { return entries[i].count; }
+
+    // Source and byte offset of entry 'i' in it
+    size_t source(size_t i) const { return entries[i].source; }
+    uint64_t offset(size_t i) const { return entries[i].offset; }
+
+    // Field and value of the element 'j' of entry 'i'
+    std::string_view field(size_t i, size_t j) const
+      { return field_names[elements[entries[i].first+j].field_id]; }
+    std::string_view value(size_t i, size_t j) const
+    {
+      const element &el = elements[entries[i].first+j];
+      return view(el.value_off, el.value_len);
+    }
+
+    // True if the value of element 'j' of entry 'i' is an expression
+    bool expression(size_t i, size_t j) const
+      { return elements[entries[i].first+j].expression; }
+
+    // Returns the value of 'field' (case insensitive) in entry 'i'
+    std::string_view get_field_value(size_t i, std::string_view field) const;
+
+    // Set the key of entry 'i'
+    void set_key(size_t i, std::string_view key);
+
+    // Set the value of element 'j' of entry 'i'
+    void set_value(size_t i, size_t j, std::string_view value);
+
+    // Remove all elements of entry 'i'
+    void clear(size_t i) { entries[i].count = 0; }
+
+    // Remove all entries without elements
+    void remove_empty();
+
+    // Reorder the entries, entry 'order[i]' becomes entry 'i'
+    void permute(const std::vector<size_t> &order);
+
+    // Replace entry 'i' by 'bEn', the space of its elements and values is
+    // reused where the new ones fit
+    void replace(size_t i, const bibEntry &bEn);
+
+    // Visit every entry once: the elements for which 'keep(field)' is false
+    // are removed, for the fields where 'select(field)' is true
+    // 'edit(field, value, expression, result)' returns true if the value
+    // changes to 'result', it may change the flag 'expression'. The elements
+    // are sorted by field if 'sort' is true. 'keep' and 'select' are called
+    // once per field name.
+    template <class Keep, class Select, class Edit>
+    void update(Keep keep, Select select, Edit edit, bool sort);
+
+    // Call 'f(name, type)' for every type name ('type' is true) and field
+    // name, 'f' may modify the name
+    template <class F>
+    void rename(F f);
+
+    // Release unused capacity of the entries and elements after all entries
+    // were added
+    void shrink_to_fit();
+
+  private:
+    // An entry refers to its key in 'buffer' and to 'count' elements
+    // starting at 'first', sources beyond 65535 are unknown
+    struct entry {
+      uint64_t key_off;
+      uint32_t key_len;
+      uint32_t type_id;
+      uint32_t first;
+      uint32_t count;
+      uint64_t offset : 48;
+      uint64_t source : 16;
+    };
+
+    // An element refers to an interned field name and to its value
+    struct element {
+      uint64_t value_off;
+      uint32_t value_len;
+      uint32_t field_id : 31;
+      uint32_t expression : 1;
+    };
+
+    // Keys and values of all entries
+    std::string buffer;
+
+    // Entries in the current order and the elements of all entries
+    std::vector<entry> entries;
+    std::vector<element> elements;
+
+    // Interned type and field names
+    std::vector<std::string> type_names;
+    std::vector<std::string> field_names;
+    std::unordered_map<std::string, uint32_t> type_ids;
+    std::unordered_map<std::string, uint32_t> field_ids;
+
+    // Returns the view on 'len' bytes at 'off' of the buffer
+    std::string_view view(uint64_t off, uint32_t len) const
+      { return std::string_view(buffer.data()+off, len); }
+
+    // Appends 'str' to the buffer and returns its offset
+    uint64_t append(std::string_view str);
+
+    // Returns the id of 'name', adds it to the table if necessary
+    uint32_t intern(const std::string &name, std::vector<std::string> &names,
+        std::unordered_map<std::string, uint32_t> &ids);
+
+    // Rebuilds the maps from names to ids after the names were modified
+    void reindex();
+};
+
+
+template <class Keep, class Select, class Edit>
+void CompactStore::update(Keep keep, Select select, Edit edit, bool sort)
+{
+  std::vector<char> kept(field_names.size()), selected(field_names.size());
+  bool changed = sort;
+  for (size_t id = 0; id < field_names.size(); ++id) {
+    kept[id] = keep(std::string_view(field_names[id]));
+    selected[id] = select(std::string_view(field_names[id]));
+    changed |= !kept[id] || selected[id];
+  }
+  if (!changed)
+    return;
+  std::string value;
+  for (size_t i = 0, n = entries.size(); i < n; ++i) {
+    entry &e = entries[i];
+    auto first = elements.begin()+e.first;
+    auto last = std::remove_if(first, first+e.count,
+        [&] (const element &el) -> bool { return !kept[el.field_id]; });
+    e.count = last - first;
+    for (size_t j = 0; j < e.count; ++j) {
+      element &el = elements[e.first+j];
+      bool expression = el.expression;
+      if (selected[el.field_id] &&
+          edit(std::string_view(field_names[el.field_id]),
+            view(el.value_off, el.value_len), expression, value)) {
+        set_value(i, j, value);
+        el.expression = expression;
+      }
+    }
+    if (sort)
+      std::sort(first, last,
+          [&] (const element &el1, const element &el2) -> bool {
+            return field_names[el1.field_id] < field_names[el2.field_id];
+          });
+  }
+}
+
+
+template <class F>
+void CompactStore::rename(F f)
+{
+  // the names are shared by all entries, each of them is renamed once
+  for (std::string &name : type_names)
+    f(name, true);
+  for (std::string &name : field_names)
+    f(name, false);
+  reindex();
+}
+
+#endif
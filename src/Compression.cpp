@@ -0,0 +1,407 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef BIBF_ZSTD
+#include <zstd.h>
+#endif
+#include "Strings.hpp"
+#include "Compression.hpp"
+
+// Size of the chunks that are read, decompressed and compressed at once
+static const size_t chunk_size = 1 << 16;
+
+// Stream buffer that compresses everything written to it into 'os'
+class CompressBuffer : public std::streambuf
+{
+  public:
+    // Constructor
+    CompressBuffer(std::ostream &_os, Compression _format);
+
+    // Destructor
+    ~CompressBuffer();
+
+    // Compress the remaining data and end the compressed stream
+    void finish();
+
+  protected:
+    int_type overflow(int_type c) override;
+    int sync() override;
+
+  private:
+    std::ostream &os;
+    Compression format;
+
+    // Uncompressed data and compressed output
+    std::string in;
+    std::string out;
+
+    // Compression state
+    z_stream zs;
+#ifdef BIBF_ZSTD
+    ZSTD_CCtx *cctx;
+#endif
+
+    // Compress the put area, 'end' ends the compressed stream
+    void compress(bool end);
+};
+
+
+CompressBuffer::CompressBuffer(std::ostream &_os, Compression _format) :
+  os(_os),
+  format(_format),
+  in(chunk_size, '\0'),
+  out(chunk_size, '\0')
+{
+  std::memset(&zs, 0, sizeof(zs));
+  if (format == Compression::GZIP)
+    deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15+16, 8,
+        Z_DEFAULT_STRATEGY);
+#ifdef BIBF_ZSTD
+  else
+    cctx = ZSTD_createCCtx();
+#endif
+  setp(&in[0], &in[0]+in.size());
+}
+
+
+CompressBuffer::~CompressBuffer()
+{
+  if (format == Compression::GZIP)
+    deflateEnd(&zs);
+#ifdef BIBF_ZSTD
+  else
+    ZSTD_freeCCtx(cctx);
+#endif
+}
+
+
+CompressBuffer::int_type CompressBuffer::overflow(int_type c)
+{
+  compress(false);
+  if (!traits_type::eq_int_type(c, traits_type::eof()))
+    sputc(traits_type::to_char_type(c));
+  return traits_type::not_eof(c);
+}
+
+
+int CompressBuffer::sync()
+{
+  compress(false);
+  return os.flush() ? 0 : -1;
+}
+
+
+void CompressBuffer::finish()
+{
+  compress(true);
+  os.flush();
+}
+
+
+void CompressBuffer::compress(bool end)
+{
+  size_t len = pptr() - pbase();
+  if (format == Compression::GZIP) {
+    zs.next_in = reinterpret_cast<Bytef*>(pbase());
+    zs.avail_in = len;
+    // continue as long as the output is filled completely
+    do {
+      zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+      zs.avail_out = out.size();
+      deflate(&zs, end ? Z_FINISH : Z_NO_FLUSH);
+      os.write(&out[0], out.size() - zs.avail_out);
+    } while (zs.avail_out == 0);
+  }
+#ifdef BIBF_ZSTD
+  else {
+    ZSTD_inBuffer ib = {pbase(), len, 0};
+    size_t remaining;
+    do {
+      ZSTD_outBuffer ob = {&out[0], out.size(), 0};
+      remaining = ZSTD_compressStream2(cctx, &ob, &ib,
+          end ? ZSTD_e_end : ZSTD_e_continue);
+      os.write(&out[0], ob.pos);
+    } while (!ZSTD_isError(remaining) &&
+        (end ? remaining != 0 : ib.pos < ib.size));
+  }
+#endif
+  setp(&in[0], &in[0]+in.size());
+}
+
+
+// Returns the compression format given by the magic number 'magic'
+static Compression detect(const unsigned char magic[4])
+{
+  if (magic[0] == 0x1f && magic[1] == 0x8b)
+    return Compression::GZIP;
+  if (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f &&
+      magic[3] == 0xfd)
+    return Compression::ZSTD;
+  return Compression::NONE;
+}
+
+
+InputFile::InputFile(const std::string &filename) :
+  std::istream(nullptr),
+  file(filename.c_str(), std::ios::binary),
+  name(filename),
+  from_stdin(false),
+  chunks(16),
+  buffer(chunks)
+{
+  start();
+}
+
+
+InputFile::InputFile() :
+  std::istream(nullptr),
+  name("-"),
+  from_stdin(true),
+  chunks(16),
+  buffer(chunks)
+{
+  start();
+}
+
+
+void InputFile::start()
+{
+  // stdin cannot be read again, its first bytes are passed on from 'head'
+  unsigned char magic[4] = {0, 0, 0, 0};
+  if (from_stdin) {
+    char data[sizeof(magic)];
+    size_t n = 0;
+    for (size_t k; n < sizeof(data) && (k = fill(data+n, sizeof(data)-n));)
+      n += k;
+    head.assign(data, n);
+    std::memcpy(magic, data, n);
+  }
+  else {
+    file.read(reinterpret_cast<char*>(magic), sizeof(magic));
+    file.clear();
+    file.seekg(0);
+  }
+  format = detect(magic);
+  switch (format) {
+    case Compression::NONE:
+      if (from_stdin) {
+        rdbuf(&buffer);
+        worker = std::thread(&InputFile::copy, this);
+      }
+      else
+        rdbuf(file.rdbuf());
+      break;
+    case Compression::GZIP:
+      rdbuf(&buffer);
+      worker = std::thread(&InputFile::inflate_gzip, this);
+      break;
+    case Compression::ZSTD:
+      rdbuf(&buffer);
+      worker = std::thread(&InputFile::inflate_zstd, this);
+      break;
+  }
+}
+
+
+size_t InputFile::fill(char *data, size_t size)
+{
+  if (!head.empty()) {
+    size_t n = head.copy(data, size);
+    head.erase(0, n);
+    return n;
+  }
+  if (!from_stdin) {
+    file.read(data, size);
+    return file.gcount();
+  }
+  // whatever is available is passed on, a slow producer must not hold back
+  // the data that was already received
+  ssize_t n;
+  while ((n = ::read(STDIN_FILENO, data, size)) == -1 && errno == EINTR)
+    ;
+  return n > 0 ? n : 0;
+}
+
+
+InputFile::~InputFile()
+{
+  if (worker.joinable()) {
+    // discard the rest, the thread may wait for space in the queue
+    for (std::string chunk; chunks.pop(chunk);)
+      ;
+    worker.join();
+  }
+}
+
+
+Compression InputFile::compression() const
+{
+  return format;
+}
+
+
+void InputFile::inflate_gzip()
+{
+  z_stream zs;
+  std::memset(&zs, 0, sizeof(zs));
+  // detect gzip and zlib headers automatically
+  inflateInit2(&zs, 15+32);
+  std::string in(chunk_size, '\0');
+  int ret = Z_OK;
+  // a full output chunk may leave more output without further input
+  bool full = false;
+  while (true) {
+    if (zs.avail_in == 0 && !full) {
+      zs.next_in = reinterpret_cast<Bytef*>(&in[0]);
+      zs.avail_in = fill(&in[0], in.size());
+      if (zs.avail_in == 0)
+        break;
+    }
+    std::string out(chunk_size, '\0');
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = out.size();
+    ret = inflate(&zs, Z_NO_FLUSH);
+    if (ret != Z_OK && ret != Z_STREAM_END)
+      break;
+    full = (zs.avail_out == 0);
+    out.resize(out.size() - zs.avail_out);
+    if (!out.empty())
+      chunks.push(std::move(out));
+    // a file may consist of several gzip members
+    if (ret == Z_STREAM_END)
+      inflateReset(&zs);
+  }
+  // the file must end after a complete member
+  if (ret != Z_STREAM_END)
+    std::cerr << Strings::tr(Strings::ERR_DECOMPRESS) << name << "\n";
+  inflateEnd(&zs);
+  chunks.close();
+}
+
+
+void InputFile::inflate_zstd()
+{
+#ifdef BIBF_ZSTD
+  ZSTD_DStream *ds = ZSTD_createDStream();
+  std::string in(chunk_size, '\0');
+  ZSTD_inBuffer ib = {&in[0], 0, 0};
+  size_t ret = 0;
+  // a full output chunk may leave more output without further input
+  bool full = false;
+  while (true) {
+    if (ib.pos == ib.size && !full) {
+      ib.size = fill(&in[0], in.size());
+      ib.pos = 0;
+      if (ib.size == 0)
+        break;
+    }
+    std::string out(chunk_size, '\0');
+    ZSTD_outBuffer ob = {&out[0], out.size(), 0};
+    ret = ZSTD_decompressStream(ds, &ob, &ib);
+    if (ZSTD_isError(ret))
+      break;
+    full = (ob.pos == ob.size);
+    out.resize(ob.pos);
+    if (!out.empty())
+      chunks.push(std::move(out));
+  }
+  // 0 is returned after a complete frame
+  if (ret != 0)
+    std::cerr << Strings::tr(Strings::ERR_DECOMPRESS) << name << "\n";
+  ZSTD_freeDStream(ds);
+#else
+  std::cerr << Strings::tr(Strings::ERR_NO_ZSTD) << name << "\n";
+#endif
+  chunks.close();
+}
+
+
+void InputFile::copy()
+{
+  std::string chunk(chunk_size, '\0');
+  for (size_t n; (n = fill(&chunk[0], chunk.size())) > 0;) {
+    chunk.resize(n);
+    chunks.push(std::move(chunk));
+    chunk.assign(chunk_size, '\0');
+  }
+  chunks.close();
+}
+
+
+OutputFile::OutputFile() :
+  std::ostream(nullptr),
+  buffer(nullptr)
+{
+}
+
+
+OutputFile::~OutputFile()
+{
+  close();
+}
+
+
+void OutputFile::open(const std::string &filename, bool append)
+{
+  auto ends_with = [&filename] (const std::string &ext) -> bool {
+    return filename.size() > ext.size() &&
+      filename.compare(filename.size()-ext.size(), ext.size(), ext) == 0;
+  };
+#ifndef BIBF_ZSTD
+  // the file is not created, plain text must not look compressed
+  if (ends_with(".zst")) {
+    std::cerr << Strings::tr(Strings::ERR_NO_ZSTD) << filename << "\n";
+    setstate(std::ios::failbit);
+    return;
+  }
+#endif
+  file.open(filename.c_str(),
+      append ? std::ios::binary | std::ios::app : std::ios::binary);
+  if (ends_with(".gz"))
+    buffer = new CompressBuffer(file, Compression::GZIP);
+#ifdef BIBF_ZSTD
+  else if (ends_with(".zst"))
+    buffer = new CompressBuffer(file, Compression::ZSTD);
+#endif
+  if (buffer)
+    rdbuf(buffer);
+  else
+    rdbuf(file.rdbuf());
+}
+
+
+void OutputFile::close()
+{
+  if (!file.is_open())
+    return;
+  if (buffer) {
+    buffer->finish();
+    rdbuf(nullptr);
+    delete buffer;
+    buffer = nullptr;
+  }
+  file.close();
+}
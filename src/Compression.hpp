@@ -0,0 +1,118 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <thread>
+#include "ChunkBuffer.hpp"
+#include "SpscQueue.hpp"
+
+// Forward declaration of user-defined types
+class CompressBuffer;
+
+// Compression formats, detected by the magic number of input files and the
+// extension (.gz, .zst) of output files. zstd needs BIBF_ZSTD at build time.
+enum class Compression {NONE, GZIP, ZSTD};
+
+// Input file stream that transparently decompresses gzip and zstd files in a
+// separate thread, so that decompression overlaps parsing
+class InputFile : public std::istream
+{
+  public:
+    // Constructor, opens 'filename'
+    InputFile(const std::string &filename);
+
+    // Constructor, reads stdin, which is passed on as it arrives
+    InputFile();
+
+    // Destructor, waits for the decompression thread
+    ~InputFile();
+
+    // Compression format of the file
+    Compression compression() const;
+
+  private:
+    // The (compressed) file or stdin, the bytes of stdin read to detect the
+    // format are kept in 'head'
+    std::ifstream file;
+    std::string name;
+    Compression format;
+    bool from_stdin;
+    std::string head;
+
+    // Decompressed chunks and the buffer reading them
+    SpscQueue<std::string> chunks;
+    ChunkBuffer buffer;
+
+    // Decompression thread
+    std::thread worker;
+
+    // Detect the format and start reading
+    void start();
+
+    // Read at most 'size' bytes of the input into 'data', returns the number
+    // of bytes read, 0 at the end
+    size_t fill(char *data, size_t size);
+
+    // Decompress the input into 'chunks'
+    void inflate_gzip();
+    void inflate_zstd();
+
+    // Copy uncompressed stdin into 'chunks'
+    void copy();
+};
+
+// Output file stream that compresses the output if the name ends with .gz or
+// .zst
+class OutputFile : public std::ostream
+{
+  public:
+    // Constructor
+    OutputFile();
+
+    // Destructor, closes the file
+    ~OutputFile();
+
+    // Open 'filename', the compression is chosen by the extension. With
+    // 'append' the output is added to the end of the file, a compressed file
+    // gets another member. A .zst file is not opened without BIBF_ZSTD.
+    void open(const std::string &filename, bool append = false);
+
+    // Returns true if the file is open
+    bool is_open() const { return file.is_open(); }
+
+    // Finish the compressed stream and close the file
+    void close();
+
+  private:
+    // The (compressed) file
+    std::ofstream file;
+
+    // Compressing buffer, nullptr for uncompressed output
+    CompressBuffer *buffer;
+};
+
+#endif
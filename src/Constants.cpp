@@ -19,58 +19,117 @@
  */
 
 #include <algorithm>
+#include <initializer_list>
+#include "CaseFold.hpp"
 #include "Constants.hpp"
 
-typedef std::vector<int> veci;
-typedef std::pair<veci, veci> pveci;
-
-const std::array<std::string, 27> Constants::standard_entry_fields {{
-  /*00*/ "address",
-  /*01*/ "annote",
-  /*02*/ "author",
-  /*03*/ "booktitle",
-  /*04*/ "chapter",
-  /*05*/ "crossref",
-  /*06*/ "edition",
-  /*07*/ "editor",
-  /*08*/ "howpublished",
-  /*09*/ "institution",
-  /*10*/ "journal",
-  /*11*/ "key",
-  /*12*/ "month",
-  /*13*/ "note",
-  /*14*/ "number",
-  /*15*/ "organization",
-  /*16*/ "pages",
-  /*17*/ "publisher",
-  /*18*/ "school",
-  /*19*/ "series",
-  /*20*/ "title",
-  /*21*/ "type",
-  /*22*/ "volume",
-  /*23*/ "year",
-  /*24*/ "author editor",
-  /*25*/ "volume number",
-  /*26*/ "chapter pages"
+// Creates a field_spec from a space separated list of alternatives
+static constexpr Constants::field_spec make_field(std::string_view name)
+{
+  Constants::field_spec spec {name, {{name, ""}}, 1};
+  size_t space = name.find(' ');
+  if (space != std::string_view::npos) {
+    spec.alternatives[0] = name.substr(0, space);
+    spec.alternatives[1] = name.substr(space+1);
+    spec.count = 2;
+  }
+  return spec;
+}
+
+constexpr const std::array<Constants::field_spec, 27>
+  Constants::standard_entry_fields
+{{
+  /*00*/ make_field("address"),
+  /*01*/ make_field("annote"),
+  /*02*/ make_field("author"),
+  /*03*/ make_field("booktitle"),
+  /*04*/ make_field("chapter"),
+  /*05*/ make_field("crossref"),
+  /*06*/ make_field("edition"),
+  /*07*/ make_field("editor"),
+  /*08*/ make_field("howpublished"),
+  /*09*/ make_field("institution"),
+  /*10*/ make_field("journal"),
+  /*11*/ make_field("key"),
+  /*12*/ make_field("month"),
+  /*13*/ make_field("note"),
+  /*14*/ make_field("number"),
+  /*15*/ make_field("organization"),
+  /*16*/ make_field("pages"),
+  /*17*/ make_field("publisher"),
+  /*18*/ make_field("school"),
+  /*19*/ make_field("series"),
+  /*20*/ make_field("title"),
+  /*21*/ make_field("type"),
+  /*22*/ make_field("volume"),
+  /*23*/ make_field("year"),
+  /*24*/ make_field("author editor"),
+  /*25*/ make_field("volume number"),
+  /*26*/ make_field("chapter pages")
 }};
 
-const std::map<std::string, pveci> Constants::standard_types {
-  {"article", pveci(veci{2, 20, 10, 23}, veci{22, 14, 16, 12, 13})},
-  {"book", pveci(veci{24, 20, 17, 23}, veci{25, 19, 0, 6, 12, 13})},
-  {"booklet", pveci(veci{20}, veci{0, 8, 0, 12, 23, 13})},
-  {"inbook", pveci(veci{24, 20, 26, 17, 23}, veci{25, 19, 21, 0, 6, 12, 13})},
-  {"incollection", pveci(veci{2, 20, 3, 23},
-      veci{7, 25, 19, 16, 0, 12, 15, 17, 13})},
-  {"inproceedings", pveci(veci{2, 20, 3, 23},
-      veci{7, 25, 19, 16, 0, 12, 15, 17, 13})},
-  {"manual", pveci(veci{20}, veci{2, 16, 0, 6, 12, 23, 13})},
-  {"masterthesis", pveci(veci{2, 20, 18, 23}, veci{21, 0, 12, 13})},
-  {"misc", pveci(veci{}, veci{2, 20, 8, 12, 23, 13})},
-  {"phdthesis", pveci(veci{2, 20, 18, 23}, veci{21, 0, 12, 13})},
-  {"proceedings", pveci(veci{20, 23}, veci{7, 25, 19, 0, 17, 13, 12, 15})},
-  {"techreport", pveci(veci{2, 20, 9, 23}, veci{21, 14, 0, 12, 13})},
-  {"unpublished", pveci(veci{2, 20, 13}, veci{12, 23})}
-};
+constexpr const std::array<Constants::type_spec, 13> Constants::standard_types
+= [] () constexpr {
+  typedef std::initializer_list<unsigned char> il;
+  auto type = [] (std::string_view name, il required, il optional) {
+    type_spec t {name, {}, 0, {}, 0};
+    for (unsigned char i : required)
+      t.required[t.n_required++] = i;
+    for (unsigned char i : optional)
+      t.optional[t.n_optional++] = i;
+    return t;
+  };
+  return std::array<type_spec, 13> {{
+    type("article", {2, 20, 10, 23}, {22, 14, 16, 12, 13}),
+    type("book", {24, 20, 17, 23}, {25, 19, 0, 6, 12, 13}),
+    type("booklet", {20}, {0, 8, 0, 12, 23, 13}),
+    type("inbook", {24, 20, 26, 17, 23}, {25, 19, 21, 0, 6, 12, 13}),
+    type("incollection", {2, 20, 3, 23},
+        {7, 25, 19, 16, 0, 12, 15, 17, 13}),
+    type("inproceedings", {2, 20, 3, 23},
+        {7, 25, 19, 16, 0, 12, 15, 17, 13}),
+    type("manual", {20}, {2, 16, 0, 6, 12, 23, 13}),
+    type("masterthesis", {2, 20, 18, 23}, {21, 0, 12, 13}),
+    type("misc", {}, {2, 20, 8, 12, 23, 13}),
+    type("phdthesis", {2, 20, 18, 23}, {21, 0, 12, 13}),
+    type("proceedings", {20, 23}, {7, 25, 19, 0, 17, 13, 12, 15}),
+    type("techreport", {2, 20, 9, 23}, {21, 14, 0, 12, 13}),
+    type("unpublished", {2, 20, 13}, {12, 23})
+  }};
+}();
+
+constexpr unsigned int Constants::type_hash(std::string_view type,
+    unsigned int seed)
+{
+  // FNV-1a of the lower case type
+  unsigned int h = 2166136261u ^ seed;
+  for (char c : type) {
+    if (c >= 'A' && c <= 'Z')
+      c += 'a' - 'A';
+    h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+  }
+  return (h ^ (h >> 16)) % 32;
+}
+
+constexpr const Constants::type_table Constants::type_hash_table
+= [] () constexpr {
+  // search for a seed that maps every type to a different slot
+  for (unsigned int seed = 0; seed < 10000; ++seed) {
+    type_table table {seed, {}};
+    for (signed char &slot : table.slots)
+      slot = -1;
+    bool collision = false;
+    for (size_t i = 0; i < standard_types.size() && !collision; ++i) {
+      signed char &slot = table.slots[type_hash(standard_types[i].name, seed)];
+      collision = (slot != -1);
+      slot = i;
+    }
+    if (!collision)
+      return table;
+  }
+  // not a constant expression, fails at compile time
+  throw "no perfect hash for the standard types";
+}();
 
 const std::array<std::string, 12> Constants::month_abbreviations {{
   "jan", "feb", "mar", "apr", "may", "jun",
@@ -78,29 +137,62 @@ const std::array<std::string, 12> Constants::month_abbreviations {{
 }};
 
 
+const Constants::type_spec* Constants::find_type(std::string_view type)
+{
+  signed char i = type_hash_table.slots[type_hash(type, type_hash_table.seed)];
+  if (i < 0)
+    return nullptr;
+  // compare case insensitive
+  std::string_view name = standard_types[i].name;
+  if (name.size() != type.size())
+    return nullptr;
+  for (size_t j = 0; j < name.size(); ++j)
+    if (name[j] != CaseFold::to_lower(type[j]))
+      return nullptr;
+  return &standard_types[i];
+}
+
+Constants::field_list Constants::get_required_fields(std::string_view type)
+{
+  const type_spec *t = find_type(type);
+  if (!t)
+    return field_list();
+  return field_list(t->required.data(), t->required.data()+t->n_required);
+}
+
+Constants::field_list Constants::get_optional_fields(std::string_view type)
+{
+  const type_spec *t = find_type(type);
+  if (!t)
+    return field_list();
+  return field_list(t->optional.data(), t->optional.data()+t->n_optional);
+}
+
+std::vector<std::string_view> Constants::get_types()
+{
+  std::vector<std::string_view> types;
+  for (const type_spec &t : standard_types)
+    types.push_back(t.name);
+  return types;
+}
+
 std::vector<std::string> Constants::get_required_values(std::string type)
 {
-  std::transform(type.begin(), type.end(), type.begin(), ::tolower);
   std::vector<std::string> required;
-  auto it = standard_types.find(type);
-  if (it != standard_types.end())
-    for (int i : it->second.first)
-      required.push_back(standard_entry_fields[i]);
+  for (const field_spec &spec : get_required_fields(type))
+    required.push_back(std::string(spec.name));
   return required;
 }
 
 std::vector<std::string> Constants::get_optional_values(std::string type)
 {
-  std::transform(type.begin(), type.end(), type.begin(), ::tolower);
   std::vector<std::string> optional;
-  auto it = standard_types.find(type);
-  if (it != standard_types.end())
-    for (int i : it->second.second)
-      optional.push_back(standard_entry_fields[i]);
+  for (const field_spec &spec : get_optional_fields(type))
+    optional.push_back(std::string(spec.name));
   return optional;
 }
 
-bool Constants::is_valid_month_abbreviation(const std::string& s)
+bool Constants::is_valid_month_abbreviation(std::string_view s)
 {
   for (const std::string& abbrev : month_abbreviations) 
     if (abbrev == s)
@@ -111,7 +203,7 @@ bool Constants::is_valid_month_abbreviation(const std::string& s)
 std::string Constants::find_month_abbreviation(const std::string& s)
 {
   std::string _s = s.substr(0, 3);
-  std::transform(_s.begin(), _s.end(), _s.begin(), ::tolower);
+  CaseFold::to_lower(_s);
   for (const std::string& abbrev : month_abbreviations)
     if (abbrev == _s)
       return _s;
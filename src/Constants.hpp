@@ -22,36 +22,111 @@
 #define CONSTANTS_H
 
 #include <array>
-#include <map>
+#include <cstddef>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class Constants
 {
   public:
+    // Specification of a required or optional field: 'name' is the field as
+    // shown to the user, e.g. "author editor", and at least one of the 'count'
+    // pre-split 'alternatives' has to be present
+    struct field_spec {
+      std::string_view name;
+      std::array<std::string_view, 2> alternatives;
+      unsigned int count;
+    };
+
+    // Non-allocating view on the required or optional fields of a type
+    class field_list {
+      public:
+        class iterator {
+          public:
+            constexpr iterator(const unsigned char *_p) : p(_p) {}
+            const field_spec& operator*() const
+              { return standard_entry_fields[*p]; }
+            iterator& operator++() { ++p; return *this; }
+            bool operator!=(const iterator &other) const
+              { return p != other.p; }
+          private:
+            const unsigned char *p;
+        };
+
+        constexpr field_list() : first(nullptr), last(nullptr) {}
+        constexpr field_list(const unsigned char *_first,
+            const unsigned char *_last) : first(_first), last(_last) {}
+        iterator begin() const { return iterator(first); }
+        iterator end() const { return iterator(last); }
+        bool empty() const { return first == last; }
+        size_t size() const { return last - first; }
+
+      private:
+        const unsigned char *first;
+        const unsigned char *last;
+    };
+
+    // returns the required fields of the given type (case insensitive)
+    static field_list get_required_fields(std::string_view type);
+
+    // returns the optional fields of the given type (case insensitive)
+    static field_list get_optional_fields(std::string_view type);
+
     // returns the required fields of the given type (case insensitive)
     static std::vector<std::string> get_required_values(std::string type);
 
     // returns the optional fields of the given type (case insensitive)
     static std::vector<std::string> get_optional_values(std::string type);
 
+    // returns the names of all standard types
+    static std::vector<std::string_view> get_types();
+
     // checks if 's' is a valid month abbreviation
-    static bool is_valid_month_abbreviation(const std::string& s);
+    static bool is_valid_month_abbreviation(std::string_view s);
 
     // tries to find the matching abbreviation to 's'
     static std::string find_month_abbreviation(const std::string& s);
 
   private:
+    // Maximum number of required or optional fields of a type
+    static const size_t max_fields = 10;
+
+    // Required and optional fields of a type as indices into
+    // 'standard_entry_fields'
+    struct type_spec {
+      std::string_view name;
+      std::array<unsigned char, max_fields> required;
+      unsigned int n_required;
+      std::array<unsigned char, max_fields> optional;
+      unsigned int n_optional;
+    };
+
     // Standard entry fields
-    static const std::array<std::string, 27> standard_entry_fields;
+    static const std::array<field_spec, 27> standard_entry_fields;
 
     // Required and optional fields for every type
-    static const std::map< std::string, std::pair< std::vector<int>,
-                 std::vector<int> > > standard_types;
-    
+    static const std::array<type_spec, 13> standard_types;
+
+    // Perfect hash table of the type names, computed at compile time:
+    // 'slots' maps the hash of a type name to its index in 'standard_types'
+    // (or -1), 'seed' is chosen such that no two types collide
+    struct type_table {
+      unsigned int seed;
+      std::array<signed char, 32> slots;
+    };
+    static const type_table type_hash_table;
+
     // Three-letter abbreviations for the months
     static const std::array<std::string, 12> month_abbreviations;
 
+    // Returns the slot of the (case insensitive) 'type' in 'type_hash_table'
+    static constexpr unsigned int type_hash(std::string_view type,
+        unsigned int seed);
+
+    // Returns the specification of 'type' or nullptr if it is unknown
+    static const type_spec* find_type(std::string_view type);
+
 };
 
 #endif
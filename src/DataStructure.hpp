@@ -21,6 +21,7 @@
 #ifndef DATASTRUCTURE_H
 #define DATASTRUCTURE_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -28,6 +29,9 @@ struct bibElement
 {
   std::string field;
   std::string value;
+  // 'value' is a BibTeX expression of macros, numbers and {strings} joined
+  // by '#' that is printed as it is, e.g. jan # {~10}
+  bool expression = false;
 };
 
 struct bibEntry
@@ -35,6 +39,10 @@ struct bibEntry
   std::string type;
   std::string key;
   std::vector<bibElement> element;
+  // source the entry was read from (0 if unknown) and byte offset of its
+  // '@' in the source, used in diagnostics
+  size_t source = 0;
+  uint64_t offset = 0;
 };
 
 #endif
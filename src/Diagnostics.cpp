@@ -0,0 +1,267 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <unordered_map>
+#include "Diagnostics.hpp"
+#include "Exporter.hpp"
+#include "Strings.hpp"
+
+const char *const Diagnostics::names[CATEGORY_CNT] = {
+  "empty-bibliography",
+  "empty-key",
+  "duplicate-key",
+  "unknown-crossref",
+  "crossref-cycle",
+  "redundant-entry",
+  "empty-author",
+  "missing-required",
+  "missing-optional",
+  "missing-field"
+};
+
+
+Diagnostics::Diagnostics() :
+  sources(1)
+{
+}
+
+
+size_t Diagnostics::add_source(const std::string &name)
+{
+  auto found = std::find(sources.begin()+1, sources.end(), name);
+  if (found != sources.end())
+    return found - sources.begin();
+  sources.push_back(name);
+  return sources.size()-1;
+}
+
+
+void Diagnostics::report(Category category, std::string_view key,
+    std::string_view detail, size_t source, uint64_t offset)
+{
+  // a warning is the same if it is about the same entry, the checks may run
+  // more than once
+  std::string id;
+  id.reserve(key.size() + detail.size() + 32);
+  id += char(category);
+  id += std::to_string(source);
+  id += ':';
+  id += std::to_string(offset);
+  id += ':';
+  id.append(key.data(), key.size());
+  id += '\0';
+  id.append(detail.data(), detail.size());
+  if (!seen.insert(std::move(id)).second)
+    return;
+  records.push_back(record{category, std::string(key), std::string(detail),
+      source, offset});
+}
+
+
+void Diagnostics::merge(const Diagnostics &other)
+{
+  for (const record &r : other.records)
+    report(r.category, r.key, r.detail,
+        r.source ? add_source(other.sources[r.source]) : 0, r.offset);
+}
+
+
+void Diagnostics::locate(const std::vector<std::string> &names,
+    const std::vector<uint64_t> &starts)
+{
+  if (names.empty())
+    return;
+  std::vector<size_t> ids;
+  for (const std::string &name : names)
+    ids.push_back(add_source(name));
+  for (record &r : records) {
+    if (r.source)
+      continue;
+    size_t k = std::upper_bound(starts.begin(), starts.end(), r.offset) -
+      starts.begin();
+    k = (k == 0) ? 0 : k-1;
+    r.source = ids[k];
+    r.offset -= starts[k];
+  }
+}
+
+
+std::string Diagnostics::message(Category category, std::string_view key,
+    std::string_view detail)
+{
+  std::string text;
+  auto add = [&text] (std::string_view str) {
+      text.append(str.data(), str.size());
+    };
+  switch (category) {
+    case EMPTY_BIBLIOGRAPHY:
+      add(Strings::tr(Strings::ERR_EMPTY_BIB));
+      break;
+    case EMPTY_KEY:
+      add(Strings::tr(Strings::ERR_EMPTY_KEY));
+      add(detail);
+      add("\"");
+      break;
+    case DUPLICATE_KEY:
+      add(Strings::tr(Strings::ERR_DOUBLE_KEY_1));
+      add(key);
+      add(Strings::tr(Strings::ERR_DOUBLE_KEY_2));
+      break;
+    case UNKNOWN_CROSSREF:
+      add(Strings::tr(Strings::ERR_DOUBLE_KEY_1));
+      add(key);
+      add(Strings::tr(Strings::ERR_CROSSREF_NOT_FOUND));
+      add(detail);
+      add("\"");
+      break;
+    case CROSSREF_CYCLE:
+      add(Strings::tr(Strings::ERR_DOUBLE_KEY_1));
+      add(key);
+      add(Strings::tr(Strings::ERR_CROSSREF_CYCLE));
+      break;
+    case REDUNDANT_ENTRY:
+      add(Strings::tr(Strings::ERR_REDUNDANT_ENTRY_1));
+      add(key);
+      add(Strings::tr(Strings::ERR_REDUNDANT_ENTRY_2));
+      break;
+    case EMPTY_AUTHOR:
+      add(Strings::tr(Strings::ERR_EMPTY_AUTHOR));
+      break;
+    case MISSING_REQUIRED:
+    case MISSING_OPTIONAL:
+    case MISSING_FIELD:
+      add(key);
+      add(Strings::tr(category == MISSING_REQUIRED ?
+            Strings::OUT_MISSES_REQUIRED : category == MISSING_OPTIONAL ?
+            Strings::OUT_MISSES_OPTIONAL : Strings::OUT_MISSING_FIELD));
+      add(detail);
+      add("\"");
+      break;
+    case CATEGORY_CNT:
+      break;
+  }
+  if (!text.empty() && text.back() == '\n')
+    text.pop_back();
+  return text;
+}
+
+
+void Diagnostics::print(std::ostream &os, size_t limit) const
+{
+  if (records.empty())
+    return;
+  std::vector<std::vector<const record*>> by_category(CATEGORY_CNT);
+  for (const record &r : records)
+    by_category[r.category].push_back(&r);
+
+  std::string out;
+  bool omitted = false;
+  for (size_t c = 0; c < MISSING_REQUIRED; ++c) {
+    // equal messages of different entries are printed once with their
+    // number, e.g. empty author fields
+    std::vector<std::pair<std::string, size_t>> lines;
+    std::unordered_map<std::string, size_t> index;
+    for (const record *r : by_category[c]) {
+      std::string text = message(r->category, r->key, r->detail);
+      auto ins = index.emplace(text, lines.size());
+      if (ins.second)
+        lines.emplace_back(std::move(text), 0);
+      ++lines[ins.first->second].second;
+    }
+    size_t shown = (limit == 0) ? lines.size() : std::min(limit, lines.size());
+    for (size_t k = 0; k < shown; ++k) {
+      out += lines[k].first;
+      if (lines[k].second > 1)
+        out += " (" + std::to_string(lines[k].second) + "x)";
+      out += '\n';
+    }
+    if (shown < lines.size()) {
+      out += Strings::tr(Strings::OUT_DIAGNOSTICS_MORE_1);
+      out += std::to_string(lines.size() - shown);
+      out += Strings::tr(Strings::OUT_DIAGNOSTICS_MORE_2);
+      omitted = true;
+    }
+  }
+  if (omitted) {
+    out += Strings::tr(Strings::OUT_DIAGNOSTICS_SUMMARY);
+    const char *separator = "";
+    for (size_t c = 0; c < CATEGORY_CNT; ++c) {
+      if (by_category[c].empty())
+        continue;
+      out += separator;
+      out += names[c];
+      out += ' ';
+      out += std::to_string(by_category[c].size());
+      separator = ", ";
+    }
+    out += '\n';
+  }
+  os.write(out.data(), out.size());
+  os.flush();
+}
+
+
+void Diagnostics::write_json(std::ostream &os) const
+{
+  std::vector<size_t> counts(CATEGORY_CNT);
+  for (const record &r : records)
+    ++counts[r.category];
+  std::string out = "{\"counts\":{";
+  const char *separator = "";
+  for (size_t c = 0; c < CATEGORY_CNT; ++c) {
+    if (counts[c] == 0)
+      continue;
+    out += separator;
+    out += '"';
+    out += names[c];
+    out += "\":";
+    out += std::to_string(counts[c]);
+    separator = ",";
+  }
+  out += "},\"diagnostics\":[";
+  separator = "\n";
+  for (const record &r : records) {
+    out += separator;
+    out += "{\"category\":\"";
+    out += names[r.category];
+    out += "\",\"key\":\"";
+    Exporter::append_json(out, r.key);
+    out += '"';
+    if (!r.detail.empty()) {
+      out += ",\"detail\":\"";
+      Exporter::append_json(out, r.detail);
+      out += '"';
+    }
+    // the location is left out for entries that were not read from a file
+    if (r.source) {
+      out += ",\"file\":\"";
+      Exporter::append_json(out, sources[r.source]);
+      out += "\",\"offset\":";
+      out += std::to_string(r.offset);
+    }
+    out += '}';
+    separator = ",\n";
+  }
+  out += "\n]}\n";
+  os.write(out.data(), out.size());
+  os.flush();
+}
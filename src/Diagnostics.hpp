@@ -0,0 +1,115 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// Collects the warnings about entries instead of printing each one at once.
+// Every warning is recorded with its category, the key of the entry, a
+// detail (a field, title or key) and where the entry starts in its source.
+// Repeated reports of the same warning are recorded once. The warnings are
+// printed in one write, grouped by category and with the number of the ones
+// left out, or written as JSON report.
+class Diagnostics
+{
+  public:
+    // Kinds of warnings, the missing fields are the output of --show-missing
+    // and --missing-fields and are only counted by print()
+    enum Category {
+      EMPTY_BIBLIOGRAPHY,
+      EMPTY_KEY,
+      DUPLICATE_KEY,
+      UNKNOWN_CROSSREF,
+      CROSSREF_CYCLE,
+      REDUNDANT_ENTRY,
+      EMPTY_AUTHOR,
+      MISSING_REQUIRED,
+      MISSING_OPTIONAL,
+      MISSING_FIELD,
+      CATEGORY_CNT
+    };
+
+    // Constructor
+    Diagnostics();
+
+    // Returns the id of the source 'name', ids are greater than 0, 0 is an
+    // unknown source
+    size_t add_source(const std::string &name);
+
+    // Record a warning about the entry 'key' that starts at byte 'offset' of
+    // the source 'source'
+    void report(Category category, std::string_view key,
+        std::string_view detail, size_t source, uint64_t offset);
+
+    // Record the warnings of 'other'
+    void merge(const Diagnostics &other);
+
+    // Assign the warnings of an unknown source, which is the concatenation
+    // of the sources 'names' starting at the byte offsets 'starts', to these
+    // sources
+    void locate(const std::vector<std::string> &names,
+        const std::vector<uint64_t> &starts);
+
+    // True if no warning was recorded
+    bool empty() const { return records.empty(); }
+
+    // Returns the warning as text without line break
+    static std::string message(Category category, std::string_view key,
+        std::string_view detail);
+
+    // Print at most 'limit' different warnings of every category (all if
+    // 'limit' is 0) to 'os', repeated ones with their number. A summary of
+    // all categories follows if warnings were left out.
+    void print(std::ostream &os, size_t limit) const;
+
+    // Write all warnings and their number per category as JSON to 'os'
+    void write_json(std::ostream &os) const;
+
+  private:
+    struct record {
+      Category category;
+      std::string key;
+      std::string detail;
+      size_t source;
+      uint64_t offset;
+    };
+
+    // Names of the sources, the first one is unknown
+    std::vector<std::string> sources;
+
+    // Recorded warnings in the order of their first report
+    std::vector<record> records;
+
+    // Identities of the recorded warnings
+    std::unordered_set<std::string> seen;
+
+    // Names of the categories in the summary and the report
+    static const char *const names[CATEGORY_CNT];
+};
+
+#endif
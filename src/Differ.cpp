@@ -0,0 +1,293 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <thread>
+#include <unordered_map>
+#include "CaseFold.hpp"
+#include "Exporter.hpp"
+#include "Merger.hpp"
+#include "Parser.hpp"
+#include "Strings.hpp"
+#include "Differ.hpp"
+
+// Size of the blocks written to the output stream
+static const size_t block_size = 1 << 16;
+
+
+Differ::Differ(Format _format, std::ostream &_os) :
+  format(_format),
+  os(_os)
+{
+  buffer.reserve(2*block_size);
+}
+
+
+size_t Differ::compare(std::istream &old_is, std::istream &new_is)
+{
+  // both versions are parsed at the same time
+  std::thread reader([this, &old_is] {
+        Parser parser;
+        parser.add(old_is, old_bib);
+      });
+  Parser parser;
+  parser.add(new_is, new_bib);
+  reader.join();
+
+  joined.assign(old_bib.size(), none);
+  used.assign(new_bib.size(), false);
+  join_keys();
+  join_dois();
+
+  // removed and modified entries in the order of the old version, added
+  // entries in the order of the new version
+  size_t added = 0, removed = 0, modified = 0;
+  for (size_t i = 0; i < old_bib.size(); ++i) {
+    if (joined[i] == none) {
+      fields.clear();
+      for (size_t k = 0; k < old_bib.count(i); ++k)
+        add_field(i, k, none, none);
+      write_entry('-', i, none);
+      ++removed;
+    }
+    else if (compare_entries(i, joined[i])) {
+      write_entry('~', i, joined[i]);
+      ++modified;
+    }
+  }
+  for (size_t j = 0; j < new_bib.size(); ++j) {
+    if (used[j])
+      continue;
+    fields.clear();
+    for (size_t l = 0; l < new_bib.count(j); ++l)
+      add_field(none, none, j, l);
+    write_entry('+', none, j);
+    ++added;
+  }
+
+  if (format == TEXT) {
+    buffer += std::to_string(added);
+    buffer += Strings::tr(Strings::OUT_DIFF_ADDED);
+    buffer += std::to_string(removed);
+    buffer += Strings::tr(Strings::OUT_DIFF_REMOVED);
+    buffer += std::to_string(modified);
+    buffer += Strings::tr(Strings::OUT_DIFF_MODIFIED);
+  }
+  flush(true);
+  return added + removed + modified;
+}
+
+
+void Differ::join_keys()
+{
+  // entries of the new version with the same key form a chain in 'next',
+  // 'first' holds the first entry of every chain that is not joined yet
+  std::unordered_map<std::string_view, size_t, CaseFold::hasher,
+    CaseFold::equal_to> first;
+  first.reserve(new_bib.size());
+  std::vector<size_t> next(new_bib.size(), none);
+  for (size_t j = new_bib.size(); j-- > 0;) {
+    auto inserted = first.emplace(new_bib.key(j), j);
+    if (!inserted.second) {
+      next[j] = inserted.first->second;
+      inserted.first->second = j;
+    }
+  }
+
+  for (size_t i = 0; i < old_bib.size(); ++i) {
+    auto found = first.find(old_bib.key(i));
+    if (found == first.end() || found->second == none)
+      continue;
+    size_t j = found->second;
+    joined[i] = j;
+    used[j] = true;
+    found->second = next[j];
+  }
+}
+
+
+void Differ::join_dois()
+{
+  // only entries that were not joined by key are considered
+  std::unordered_map<std::string, size_t> dois;
+  for (size_t j = 0; j < new_bib.size(); ++j) {
+    if (used[j])
+      continue;
+    std::string_view doi = new_bib.get_field_value(j, "doi");
+    if (!doi.empty())
+      dois.emplace(Merger::normalize_doi(doi), j);
+  }
+  if (dois.empty())
+    return;
+
+  for (size_t i = 0; i < old_bib.size(); ++i) {
+    if (joined[i] != none)
+      continue;
+    std::string_view doi = old_bib.get_field_value(i, "doi");
+    if (doi.empty())
+      continue;
+    auto found = dois.find(Merger::normalize_doi(doi));
+    if (found == dois.end())
+      continue;
+    joined[i] = found->second;
+    used[found->second] = true;
+    dois.erase(found);
+  }
+}
+
+
+bool Differ::compare_entries(size_t i, size_t j)
+{
+  // every element of the old entry is compared with the first element of the
+  // new entry with the same field that was not matched yet
+  fields.clear();
+  size_t count = new_bib.count(j);
+  matched.assign(count, false);
+  for (size_t k = 0; k < old_bib.count(i); ++k) {
+    std::string_view field = old_bib.field(i, k);
+    size_t l = 0;
+    while (l < count &&
+        (matched[l] || !CaseFold::equals(field, new_bib.field(j, l))))
+      ++l;
+    if (l == count) {
+      add_field(i, k, none, none);
+      continue;
+    }
+    matched[l] = true;
+    if (old_bib.value(i, k) != new_bib.value(j, l) ||
+        old_bib.expression(i, k) != new_bib.expression(j, l))
+      add_field(i, k, j, l);
+  }
+  for (size_t l = 0; l < count; ++l)
+    if (!matched[l])
+      add_field(none, none, j, l);
+
+  return !fields.empty() || old_bib.key(i) != new_bib.key(j) ||
+    !CaseFold::equals(old_bib.type(i), new_bib.type(j));
+}
+
+
+void Differ::add_field(size_t i, size_t k, size_t j, size_t l)
+{
+  // field names are written in lower case
+  std::string_view field = (l != none) ? new_bib.field(j, l)
+                                       : old_bib.field(i, k);
+  if (format == JSONL) {
+    fields += fields.empty() ? "{\"field\":\"" : ",{\"field\":\"";
+    size_t begin = fields.size();
+    Exporter::append_json(fields, field);
+    for (size_t n = begin; n < fields.size(); ++n)
+      fields[n] = CaseFold::to_lower(fields[n]);
+    if (k != none) {
+      fields += "\",\"old\":\"";
+      append_value(old_bib, i, k);
+    }
+    if (l != none) {
+      fields += "\",\"new\":\"";
+      append_value(new_bib, j, l);
+    }
+    fields += "\"}";
+    return;
+  }
+  for (int side = 0; side < 2; ++side) {
+    const CompactStore &store = side ? new_bib : old_bib;
+    size_t entry = side ? j : i, element = side ? l : k;
+    if (element == none)
+      continue;
+    fields += side ? "  + " : "  - ";
+    for (char c : field)
+      fields += CaseFold::to_lower(c);
+    fields += " = ";
+    append_value(store, entry, element);
+    fields += '\n';
+  }
+}
+
+
+void Differ::append_value(const CompactStore &store, size_t i, size_t k)
+{
+  std::string_view value = store.value(i, k);
+  if (format == JSONL)
+    Exporter::append_json(fields, value);
+  else if (store.expression(i, k))
+    fields.append(value.data(), value.size());
+  else {
+    fields += '{';
+    fields.append(value.data(), value.size());
+    fields += '}';
+  }
+}
+
+
+void Differ::write_entry(char change, size_t i, size_t j)
+{
+  if (format == JSONL) {
+    buffer += change == '-' ? "{\"change\":\"removed\"" :
+      change == '+' ? "{\"change\":\"added\"" : "{\"change\":\"modified\"";
+    const CompactStore &store = (j != none) ? new_bib : old_bib;
+    size_t entry = (j != none) ? j : i;
+    buffer += ",\"type\":\"";
+    Exporter::append_json(buffer, store.type(entry));
+    buffer += "\",\"key\":\"";
+    Exporter::append_json(buffer, store.key(entry));
+    if (change == '~') {
+      buffer += "\",\"old_type\":\"";
+      Exporter::append_json(buffer, old_bib.type(i));
+      buffer += "\",\"old_key\":\"";
+      Exporter::append_json(buffer, old_bib.key(i));
+    }
+    buffer += "\",\"fields\":[";
+    buffer += fields;
+    buffer += "]}\n";
+  }
+  else {
+    const CompactStore &store = (i != none) ? old_bib : new_bib;
+    size_t entry = (i != none) ? i : j;
+    buffer += change;
+    buffer += " @";
+    buffer.append(store.type(entry));
+    buffer += '{';
+    buffer.append(store.key(entry));
+    buffer += '}';
+    // the new type and key of a modified entry if one of them changed
+    if (change == '~' && (old_bib.key(i) != new_bib.key(j) ||
+          old_bib.type(i) != new_bib.type(j))) {
+      buffer += " -> @";
+      buffer.append(new_bib.type(j));
+      buffer += '{';
+      buffer.append(new_bib.key(j));
+      buffer += '}';
+    }
+    buffer += '\n';
+    buffer += fields;
+  }
+  flush();
+}
+
+
+void Differ::flush(bool force)
+{
+  if (buffer.size() >= block_size || force) {
+    os.write(buffer.data(), buffer.size());
+    buffer.clear();
+  }
+  if (force)
+    os.flush();
+}
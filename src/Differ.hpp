@@ -0,0 +1,100 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef DIFFER_H
+#define DIFFER_H
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "CompactStore.hpp"
+
+// Semantic difference of two versions of a bibliography. Entries are joined
+// by key (case insensitive) and, if their keys changed, by DOI; the fields
+// of joined entries are compared by name (case insensitive). The order of
+// the entries and fields and the formatting do not matter. Time and memory
+// are linear in the size of the input.
+class Differ
+{
+  public:
+    // Output formats
+    enum Format {
+      TEXT,   // readable report with a summary line
+      JSONL   // one JSON object per added, removed or modified entry
+    };
+
+    // Constructor
+    Differ(Format _format, std::ostream &_os);
+
+    // Parse the old and the new version concurrently, join them and write
+    // the differences. Returns the number of changed entries.
+    size_t compare(std::istream &old_is, std::istream &new_is);
+
+  private:
+    Format format;
+    std::ostream &os;
+
+    // Both versions of the bibliography
+    CompactStore old_bib;
+    CompactStore new_bib;
+
+    // Joined entry of the new version for every entry of the old version or
+    // 'none', and whether an entry of the new version was joined
+    std::vector<size_t> joined;
+    std::vector<bool> used;
+
+    // Elements of the new entry that were matched while comparing
+    std::vector<bool> matched;
+
+    // Report of the current entry and the output that was not yet written
+    std::string fields;
+    std::string buffer;
+
+    static constexpr size_t none = size_t(-1);
+
+    // Join the entries by key and the remaining ones by DOI
+    void join_keys();
+    void join_dois();
+
+    // Compare the entries 'i' of the old and 'j' of the new version, returns
+    // true if they differ
+    bool compare_entries(size_t i, size_t j);
+
+    // Append the element 'k' of the old entry 'i' and the element 'l' of the
+    // new entry 'j' to 'fields', 'k' or 'l' is 'none' if the field was added
+    // or removed
+    void add_field(size_t i, size_t k, size_t j, size_t l);
+
+    // Append the value of element 'k' of entry 'i' of 'store' to 'fields'
+    void append_value(const CompactStore &store, size_t i, size_t k);
+
+    // Write a removed ('-'), added ('+') or modified ('~') entry with the
+    // report in 'fields', 'i' or 'j' is 'none' if the entry was added or
+    // removed
+    void write_entry(char change, size_t i, size_t j);
+
+    // Write 'buffer' to 'os' if it is large enough, or always if 'force'
+    void flush(bool force = false);
+};
+
+#endif
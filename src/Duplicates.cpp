@@ -0,0 +1,328 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <iterator>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <boost/algorithm/string/predicate.hpp>
+#include "CaseFold.hpp"
+#include "DataStructure.hpp"
+#include "Names.hpp"
+#include "Strings.hpp"
+#include "Duplicates.hpp"
+
+namespace bstring = boost::algorithm;
+
+// 64 bit finalizer of splitmix64, used to derive independent hash functions
+static uint64_t mix(uint64_t x)
+{
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// FNV-1a hash of 'len' bytes starting at 'p'
+static uint64_t fnv1a(const char *p, size_t len,
+    uint64_t h = 0xcbf29ce484222325ULL)
+{
+  for (size_t i = 0; i < len; ++i) {
+    h ^= static_cast<unsigned char>(p[i]);
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+
+DuplicateFinder::DuplicateFinder(const std::vector<bibEntry> &_bib) :
+  bib(_bib)
+{
+}
+
+
+const std::string& DuplicateFinder::get_field_value(const bibEntry &bEn,
+    const std::string &field) const
+{
+  static const std::string empty;
+  for (const bibElement &bEl : bEn.element)
+    if (CaseFold::equals(bEl.field, field))
+      return bEl.value;
+  return empty;
+}
+
+
+std::string DuplicateFinder::normalize(const std::string &str) const
+{
+  std::string result;
+  result.reserve(str.size());
+  bool space = true;
+  for (size_t i = 0, len = str.size(); i < len; ++i) {
+    unsigned char c = str[i];
+    // braces only protect the case, drop them
+    if (c == '{' || c == '}')
+      continue;
+    // skip the name of LaTeX commands (\emph, \"{o}, \&, ...)
+    if (c == '\\') {
+      if (i+1 < len && isalpha(static_cast<unsigned char>(str[i+1])))
+        while (i+1 < len && isalpha(static_cast<unsigned char>(str[i+1])))
+          ++i;
+      else
+        ++i;
+      continue;
+    }
+    // keep letters, digits and non-ASCII bytes, everything else separates
+    if (isalnum(c) || c >= 0x80) {
+      result.push_back(CaseFold::to_lower(c));
+      space = false;
+    }
+    else if (!space) {
+      result.push_back(' ');
+      space = true;
+    }
+  }
+  if (!result.empty() && result.back() == ' ')
+    result.pop_back();
+  return result;
+}
+
+
+std::string DuplicateFinder::normalize_id(std::string id) const
+{
+  CaseFold::to_lower(id);
+  id.erase(std::remove_if(id.begin(), id.end(),
+        [] (char c) -> bool { return isspace(c) || c == '{' || c == '}'; }),
+      id.end());
+  // strip common prefixes of DOIs and arXiv identifiers
+  for (const char *prefix : {"https://doi.org/", "http://doi.org/",
+      "https://dx.doi.org/", "http://dx.doi.org/", "doi:", "arxiv:"}) {
+    if (bstring::starts_with(id, prefix)) {
+      id.erase(0, std::char_traits<char>::length(prefix));
+      break;
+    }
+  }
+  // ignore the version of an eprint (e.g. 1234.5678v2)
+  size_t v = id.find_last_of('v');
+  if (v != std::string::npos && v > 0 && v+1 < id.size() &&
+      isdigit(static_cast<unsigned char>(id[v-1])) &&
+      id.find_first_not_of("0123456789", v+1) == std::string::npos)
+    id.erase(v);
+  return id;
+}
+
+
+std::vector<std::string> DuplicateFinder::get_lastnames(
+    const std::string &author) const
+{
+  std::vector<std::string> names;
+  for (const bibName &bN : NameCache::parse(author)) {
+    std::string name = normalize(bN.last);
+    if (!name.empty())
+      names.push_back(name);
+  }
+  std::sort(names.begin(), names.end());
+  names.erase(std::unique(names.begin(), names.end()), names.end());
+  return names;
+}
+
+
+void DuplicateFinder::compute_signature(const std::string &title,
+    uint32_t *sig) const
+{
+  std::fill(sig, sig+num_hashes, UINT32_MAX);
+  size_t len = title.size();
+  size_t count = len < shingle_length ? 1 : len-shingle_length+1;
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t h = fnv1a(title.data()+i, std::min<size_t>(shingle_length, len));
+    for (unsigned int k = 0; k < num_hashes; ++k) {
+      uint32_t m =
+        static_cast<uint32_t>(mix(h ^ (k * 0xa0761d6478bd642fULL)));
+      if (m < sig[k])
+        sig[k] = m;
+    }
+  }
+}
+
+
+double DuplicateFinder::similarity(size_t i, size_t j) const
+{
+  // estimated Jaccard similarity of the title shingles
+  const uint32_t *s1 = &signatures[i*num_hashes];
+  const uint32_t *s2 = &signatures[j*num_hashes];
+  unsigned int equal = 0;
+  for (unsigned int k = 0; k < num_hashes; ++k)
+    if (s1[k] == s2[k])
+      ++equal;
+  double sim = static_cast<double>(equal) / num_hashes;
+
+  // Jaccard similarity of the last names, if both entries have authors
+  const std::vector<std::string> &a1 = authors[i], &a2 = authors[j];
+  if (a1.empty() || a2.empty())
+    return sim;
+  std::vector<std::string> common;
+  std::set_intersection(a1.begin(), a1.end(), a2.begin(), a2.end(),
+      std::back_inserter(common));
+  double author_sim = static_cast<double>(common.size()) /
+    (a1.size() + a2.size() - common.size());
+  return 0.7*sim + 0.3*author_sim;
+}
+
+
+size_t DuplicateFinder::find(size_t i)
+{
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+
+void DuplicateFinder::join(size_t i, size_t j, double sim, char why)
+{
+  for (size_t k : {i, j}) {
+    if (sim > score[k]) {
+      score[k] = sim;
+      reason[k] = why;
+    }
+  }
+  size_t ri = find(i), rj = find(j);
+  if (ri == rj)
+    return;
+  // the smaller index is the representative, this keeps the output ordered
+  if (ri < rj)
+    parent[rj] = ri;
+  else
+    parent[ri] = rj;
+}
+
+
+void DuplicateFinder::match_exact(const std::vector<std::string> &ids,
+    char why)
+{
+  std::unordered_map<std::string, size_t> first;
+  first.reserve(ids.size());
+  for (size_t i = 0; i < ids.size(); ++i) {
+    if (ids[i].empty())
+      continue;
+    auto ins = first.insert(std::make_pair(ids[i], i));
+    if (!ins.second)
+      join(ins.first->second, i, 1.0, why);
+  }
+}
+
+
+void DuplicateFinder::report(double threshold, std::ostream &os)
+{
+  size_t n = bib.size();
+  titles.resize(n);
+  authors.resize(n);
+  signatures.assign(n*num_hashes, UINT32_MAX);
+  parent.resize(n);
+  score.assign(n, 0.0);
+  reason.assign(n, ' ');
+  for (size_t i = 0; i < n; ++i)
+    parent[i] = i;
+
+  // normalize entries and compute signatures
+  std::vector<std::string> dois(n), eprints(n);
+  for (size_t i = 0; i < n; ++i) {
+    titles[i] = normalize(get_field_value(bib[i], "title"));
+    authors[i] = get_lastnames(get_field_value(bib[i], "author"));
+    dois[i] = normalize_id(get_field_value(bib[i], "doi"));
+    eprints[i] = normalize_id(get_field_value(bib[i], "eprint"));
+    if (!titles[i].empty())
+      compute_signature(titles[i], &signatures[i*num_hashes]);
+  }
+
+  // exact matches of identifiers
+  match_exact(dois, 'd');
+  match_exact(eprints, 'e');
+
+  // locality sensitive hashing: entries are candidates if they agree in
+  // all rows of at least one band
+  const unsigned int rows = num_hashes / num_bands;
+  std::vector<std::pair<uint64_t, size_t>> buckets;
+  buckets.reserve(n*num_bands);
+  for (size_t i = 0; i < n; ++i) {
+    if (titles[i].empty())
+      continue;
+    for (unsigned int b = 0; b < num_bands; ++b) {
+      const char *band = reinterpret_cast<const char*>(
+          &signatures[i*num_hashes + b*rows]);
+      buckets.push_back(std::make_pair(
+            fnv1a(band, rows*sizeof(uint32_t), mix(b)), i));
+    }
+  }
+  std::sort(buckets.begin(), buckets.end());
+
+  // verify the candidates of every bucket
+  for (size_t begin = 0, end; begin < buckets.size(); begin = end) {
+    end = begin+1;
+    while (end < buckets.size() && buckets[end].first == buckets[begin].first)
+      ++end;
+    size_t size = end - begin;
+    for (size_t a = begin; a < end; ++a) {
+      // compare all pairs of small groups, large groups along a chain
+      size_t last = size <= max_group_size ? end : std::min(a+2, end);
+      for (size_t b = a+1; b < last; ++b) {
+        size_t i = buckets[a].second, j = buckets[b].second;
+        if (i == j)
+          continue;
+        double sim = similarity(i, j);
+        if (sim >= threshold)
+          join(i, j, sim, 't');
+      }
+    }
+  }
+
+  // collect clusters with more than one entry
+  std::map<size_t, std::vector<size_t>> clusters;
+  for (size_t i = 0; i < n; ++i)
+    if (find(i) != i || score[i] > 0.0)
+      clusters[find(i)].push_back(i);
+
+  // print clusters
+  std::ios::fmtflags flags = os.flags();
+  std::streamsize precision = os.precision();
+  os << std::fixed << std::setprecision(2);
+  unsigned int number = 0;
+  for (const auto &cluster : clusters) {
+    if (cluster.second.size() < 2)
+      continue;
+    os << Strings::tr(Strings::OUT_DUPLICATE_CLUSTER) << ++number << " ("
+      << cluster.second.size() << Strings::tr(Strings::OUT_DUPLICATE_ENTRIES)
+      << ")\n";
+    for (size_t i : cluster.second) {
+      os << "  " << bib[i].key << " (" << bib[i].type << ") " << score[i];
+      if (reason[i] == 'd')
+        os << " doi";
+      else if (reason[i] == 'e')
+        os << " eprint";
+      else
+        os << " title";
+      os << "\n";
+    }
+  }
+  os.flags(flags);
+  os.precision(precision);
+}
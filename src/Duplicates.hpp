@@ -0,0 +1,103 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DUPLICATES_H
+#define DUPLICATES_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Forward declaration of user-defined types
+class bibEntry;
+
+class DuplicateFinder
+{
+  public:
+    // Constructor, 'bib' must outlive the DuplicateFinder
+    DuplicateFinder(const std::vector<bibEntry> &bib);
+
+    // Search for near-duplicates and print clusters of entries whose
+    // similarity is at least 'threshold' (0..1) to 'os'
+    void report(double threshold, std::ostream &os);
+
+  private:
+    // Number of MinHash functions per signature
+    static const unsigned int num_hashes = 32;
+
+    // The signature is divided into 'num_bands' bands for LSH
+    static const unsigned int num_bands = 8;
+
+    // Length of the character shingles of the normalized title
+    static const unsigned int shingle_length = 4;
+
+    // Groups of entries sharing a band that are larger than this are
+    // only compared along a chain to stay sub-quadratic
+    static const unsigned int max_group_size = 64;
+
+    // Bibliography to search in
+    const std::vector<bibEntry> &bib;
+
+    // Normalized titles and sorted last names of all authors
+    std::vector<std::string> titles;
+    std::vector<std::vector<std::string>> authors;
+
+    // MinHash signatures of the titles, 'num_hashes' values per entry
+    std::vector<uint32_t> signatures;
+
+    // Union-find parent array used to build the clusters
+    std::vector<size_t> parent;
+
+    // Best score and reason with which an entry was added to a cluster
+    std::vector<double> score;
+    std::vector<char> reason;
+
+    // Returns the value of 'field' in 'bEn' (case insensitive)
+    const std::string& get_field_value(const bibEntry &bEn,
+        const std::string &field) const;
+
+    // Strips braces and LaTeX commands, converts to lower case and
+    // replaces punctuation by single spaces
+    std::string normalize(const std::string &str) const;
+
+    // Normalizes a DOI or eprint identifier for exact matching
+    std::string normalize_id(std::string id) const;
+
+    // Returns the sorted, normalized last names of all authors in 'author'
+    std::vector<std::string> get_lastnames(const std::string &author) const;
+
+    // Computes the MinHash signature of 'title' into 'sig'
+    void compute_signature(const std::string &title, uint32_t *sig) const;
+
+    // Returns the combined title and author similarity of 'i' and 'j'
+    double similarity(size_t i, size_t j) const;
+
+    // Merges entries with identical (nonempty) identifiers
+    void match_exact(const std::vector<std::string> &ids, char why);
+
+    // Merges the clusters of 'i' and 'j' and records 'sim'
+    void join(size_t i, size_t j, double sim, char why);
+
+    // Returns the representative of the cluster of 'i'
+    size_t find(size_t i);
+};
+
+#endif
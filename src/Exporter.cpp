@@ -0,0 +1,200 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <iterator>
+#include "CaseFold.hpp"
+#include "DataStructure.hpp"
+#include "Macros.hpp"
+#include "Parser.hpp"
+#include "Exporter.hpp"
+
+// Size of the blocks written to the output stream
+static const size_t block_size = 1 << 16;
+
+// Fields written to TSV if no fields are selected
+static const char *default_columns[] = {"author", "title", "year"};
+
+
+Exporter::Exporter(Format _format, const std::vector<std::string> &_only,
+    std::ostream &_os) :
+  format(_format),
+  only(_only),
+  os(_os),
+  macros(new MacroTable)
+{
+  buffer.reserve(2*block_size);
+  if (format == TSV) {
+    if (only.empty())
+      only.assign(std::begin(default_columns), std::end(default_columns));
+    // header line
+    buffer += "type\tkey";
+    for (const std::string &field : only) {
+      buffer += '\t';
+      append_tsv(field);
+    }
+    buffer += '\n';
+  }
+}
+
+
+Exporter::~Exporter()
+{
+  flush(true);
+  delete macros;
+}
+
+
+void Exporter::add(std::istream &is)
+{
+  Parser parser(macros);
+  // parse one entry at a time
+  std::vector<bibEntry> parsed;
+  while (is) {
+    parser.add(is, parsed, 1);
+    for (const bibEntry &bEn : parsed)
+      write(bEn);
+    parsed.clear();
+  }
+}
+
+
+void Exporter::write(const bibEntry &bEn)
+{
+  if (format == JSONL) {
+    buffer += "{\"type\":\"";
+    append_json(buffer, bEn.type);
+    buffer += "\",\"key\":\"";
+    append_json(buffer, bEn.key);
+    buffer += "\",\"fields\":{";
+    bool first = true;
+    for (const bibElement &bEl : bEn.element) {
+      if (!only.empty() && column(bEl.field) == -1)
+        continue;
+      buffer += first ? "\"" : ",\"";
+      first = false;
+      // field names are written in lower case
+      size_t begin = buffer.size();
+      append_json(buffer, bEl.field);
+      for (size_t i = begin; i < buffer.size(); ++i)
+        buffer[i] = CaseFold::to_lower(buffer[i]);
+      buffer += "\":\"";
+      append_json(buffer, value(bEl));
+      buffer += '"';
+    }
+    buffer += "}}\n";
+  }
+  else {
+    append_tsv(bEn.type);
+    buffer += '\t';
+    append_tsv(bEn.key);
+    // the first element with the field of a column is used
+    columns.assign(only.size(), nullptr);
+    for (const bibElement &bEl : bEn.element) {
+      int c = column(bEl.field);
+      if (c != -1 && !columns[c])
+        columns[c] = &bEl;
+    }
+    for (const bibElement *bEl : columns) {
+      buffer += '\t';
+      if (bEl)
+        append_tsv(value(*bEl));
+    }
+    buffer += '\n';
+  }
+  flush();
+}
+
+
+std::string_view Exporter::value(const bibElement &bEl)
+{
+  if (bEl.expression && macros->expand(bEl.value, expanded))
+    return expanded;
+  return bEl.value;
+}
+
+
+void Exporter::flush(bool force)
+{
+  if (buffer.size() >= block_size || force) {
+    os.write(buffer.data(), buffer.size());
+    buffer.clear();
+  }
+  if (force)
+    os.flush();
+}
+
+
+void Exporter::append_json(std::string &out, std::string_view str)
+{
+  static const char hex[] = "0123456789abcdef";
+  // copy runs of characters that need no escaping at once
+  size_t run = 0;
+  for (size_t i = 0; i < str.size(); ++i) {
+    unsigned char c = str[i];
+    if (c >= 0x20 && c != '"' && c != '\\')
+      continue;
+    out.append(str.data()+run, i-run);
+    run = i+1;
+    out += '\\';
+    switch (c) {
+      case '"':  out += '"'; break;
+      case '\\': out += '\\'; break;
+      case '\n': out += 'n'; break;
+      case '\r': out += 'r'; break;
+      case '\t': out += 't'; break;
+      default:
+        out += "u00";
+        out += hex[c >> 4];
+        out += hex[c & 0xf];
+    }
+  }
+  out.append(str.data()+run, str.size()-run);
+}
+
+
+void Exporter::append_tsv(std::string_view str)
+{
+  size_t run = 0;
+  for (size_t i = 0; i < str.size(); ++i) {
+    char c = str[i];
+    if (c != '\t' && c != '\n' && c != '\r' && c != '\\')
+      continue;
+    buffer.append(str.data()+run, i-run);
+    run = i+1;
+    buffer += '\\';
+    switch (c) {
+      case '\t': buffer += 't'; break;
+      case '\n': buffer += 'n'; break;
+      case '\r': buffer += 'r'; break;
+      default:   buffer += '\\';
+    }
+  }
+  buffer.append(str.data()+run, str.size()-run);
+}
+
+
+int Exporter::column(std::string_view field) const
+{
+  for (size_t i = 0; i < only.size(); ++i)
+    if (CaseFold::equals(only[i], field))
+      return i;
+  return -1;
+}
@@ -0,0 +1,95 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Forward declaration of user-defined types
+class bibElement;
+class bibEntry;
+class MacroTable;
+
+// Streams entries in a machine readable format. Every entry is written as
+// soon as it is parsed, the memory usage does not depend on the input size.
+// Values that use @string macros are written expanded.
+class Exporter
+{
+  public:
+    // Output formats
+    enum Format {
+      JSONL,  // one JSON object per line
+      TSV     // tab separated values with a header line
+    };
+
+    // Constructor, only the fields in 'only' (case insensitive) are written,
+    // all fields if it is empty. TSV uses 'only' as columns.
+    Exporter(Format _format, const std::vector<std::string> &_only,
+        std::ostream &_os);
+
+    // Destructor, writes the remaining output
+    ~Exporter();
+
+    // Parse and write all entries of 'is'
+    void add(std::istream &is);
+
+    // Write the entry 'bEn'
+    void write(const bibEntry &bEn);
+
+    // Append 'str' to 'out' with JSON escaping
+    static void append_json(std::string &out, std::string_view str);
+
+  private:
+    Format format;
+    std::vector<std::string> only;
+    std::ostream &os;
+
+    // Output that was not yet written to 'os'
+    std::string buffer;
+
+    // @string macros of all added streams
+    MacroTable *macros;
+
+    // Elements of the TSV columns of the current entry
+    std::vector<const bibElement*> columns;
+
+    // Space for an expanded value
+    std::string expanded;
+
+    // Returns the value of 'bEl' with the macros expanded if possible
+    std::string_view value(const bibElement &bEl);
+
+    // Write 'buffer' to 'os' if it is large enough, or always if 'force'
+    void flush(bool force = false);
+
+    // Append 'str' to the buffer with TSV escaping
+    void append_tsv(std::string_view str);
+
+    // Returns the index of 'field' in 'only' or -1
+    int column(std::string_view field) const;
+};
+
+#endif
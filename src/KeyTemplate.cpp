@@ -0,0 +1,205 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cctype>
+#include "CaseFold.hpp"
+#include "KeyTemplate.hpp"
+#include "Names.hpp"
+
+KeyTemplate::KeyTemplate()
+{
+  compile("{author1:last}{year:-2}");
+  always = true;
+}
+
+
+bool KeyTemplate::compile(std::string_view scheme)
+{
+  std::vector<operation> ops;
+  std::vector<std::string> fields;
+  operation op{std::string(), std::string::npos, 0, NONE, {}};
+  for (size_t i = 0; i < scheme.size(); ++i) {
+    if (scheme[i] == '}')
+      return false;
+    if (scheme[i] != '{') {
+      op.literal += scheme[i];
+      continue;
+    }
+    size_t end = scheme.find('}', i);
+    if (end == std::string_view::npos)
+      return false;
+    std::string_view spec = scheme.substr(i+1, end-i-1);
+    i = end;
+
+    // the field, author and editor may be followed by the number of a name
+    size_t colon = spec.find(':');
+    std::string field(spec.substr(0, colon));
+    CaseFold::to_lower(field);
+    size_t digits = field.find_first_of("0123456789");
+    std::string_view base = std::string_view(field).substr(0, digits);
+    if (base == "author" || base == "editor") {
+      op.part = LAST;
+      if (digits != std::string::npos) {
+        if (field.find_first_not_of("0123456789", digits) !=
+            std::string::npos)
+          return false;
+        op.name = std::stoul(field.substr(digits));
+        if (op.name == 0)
+          return false;
+        field.erase(digits);
+      }
+    }
+    if (field.empty() || field.find('{') != std::string::npos)
+      return false;
+
+    // modifiers
+    while (colon != std::string_view::npos) {
+      size_t next = spec.find(':', colon+1);
+      std::string_view m = spec.substr(colon+1, next == std::string_view::npos
+          ? std::string_view::npos : next-colon-1);
+      colon = next;
+      Part part = NONE;
+      if (m == "first")
+        part = FIRST;
+      else if (m == "von")
+        part = VON;
+      else if (m == "last")
+        part = LAST;
+      else if (m == "jr")
+        part = JR;
+      if (part != NONE) {
+        if (op.part == NONE)
+          return false;
+        op.part = part;
+      }
+      else if (m == "lower")
+        op.modifiers.push_back(modifier{LOWER, 0});
+      else if (m == "upper")
+        op.modifiers.push_back(modifier{UPPER, 0});
+      else if (m == "firstword")
+        op.modifiers.push_back(modifier{FIRSTWORD, 0});
+      else {
+        // number of characters kept at the beginning or at the end
+        bool tail = !m.empty() && m[0] == '-';
+        std::string_view n = m.substr(tail ? 1 : 0);
+        if (n.empty() || n.size() > 9 ||
+            n.find_first_not_of("0123456789") != std::string_view::npos)
+          return false;
+        op.modifiers.push_back(modifier{tail ? TAIL : HEAD,
+            std::stoul(std::string(n))});
+      }
+    }
+
+    // every field is read once however often it is used
+    op.field = 0;
+    while (op.field < fields.size() && fields[op.field] != field)
+      ++op.field;
+    if (op.field == fields.size())
+      fields.push_back(field);
+    ops.push_back(std::move(op));
+    op = operation{std::string(), std::string::npos, 0, NONE, {}};
+  }
+  if (!op.literal.empty())
+    ops.push_back(std::move(op));
+
+  operations.swap(ops);
+  used.swap(fields);
+  always = false;
+  return true;
+}
+
+
+std::string KeyTemplate::evaluate(const std::vector<std::string_view> &values,
+    NameCache &names) const
+{
+  std::string key;
+  for (const operation &op : operations) {
+    key += op.literal;
+    if (op.field != std::string::npos)
+      key += field_value(op, values[op.field], names);
+  }
+  return key;
+}
+
+
+std::string KeyTemplate::field_value(const operation &op,
+    std::string_view value, NameCache &names) const
+{
+  std::string result;
+  if (op.part == NONE)
+    result = value;
+  else {
+    // the selected part of one or all names
+    const std::vector<bibName> &parsed = names.get(value);
+    for (size_t i = 0; i < parsed.size(); ++i) {
+      if (op.name != 0 && i+1 != op.name)
+        continue;
+      const bibName &name = parsed[i];
+      if (name.last == "others")
+        continue;
+      switch (op.part) {
+        case FIRST: result += name.first; break;
+        case VON: result += name.von; break;
+        case LAST: result += name.last; break;
+        case JR: result += name.jr; break;
+        case NONE: break;
+      }
+    }
+  }
+
+  // the modifiers see the characters of the key and the word separators,
+  // LaTeX markup like {\"u} is removed before
+  result.erase(std::remove_if(result.begin(), result.end(),
+        [] (char c) -> bool {
+          return !std::isalnum(static_cast<unsigned char>(c)) && c != ' ' &&
+            c != '~' && c != ':' && c != '.' && c != '-';
+        }), result.end());
+
+  for (const modifier &m : op.modifiers) {
+    switch (m.kind) {
+      case LOWER:
+        CaseFold::to_lower(result);
+        break;
+      case UPPER:
+        CaseFold::to_upper(result);
+        break;
+      case FIRSTWORD: {
+        size_t begin = result.find_first_not_of(" ~");
+        if (begin == std::string::npos)
+          result.clear();
+        else
+          result = result.substr(begin,
+              result.find_first_of(" ~", begin) - begin);
+        break;
+      }
+      case HEAD:
+        if (result.size() > m.n)
+          result.erase(m.n);
+        break;
+      case TAIL:
+        if (result.size() > m.n)
+          result.erase(0, result.size() - m.n);
+        break;
+    }
+  }
+  return result;
+}
@@ -0,0 +1,95 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef KEYTEMPLATE_H
+#define KEYTEMPLATE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Forward declaration of user-defined types
+class NameCache;
+
+// Scheme of the keys created by Bibliography::create_keys(), compiled once
+// into a sequence of operations that is evaluated for every entry without
+// parsing the scheme again. Text outside braces is copied, a field in braces
+// is replaced by its value after applying the modifiers in order:
+//
+//   {author1:last}{year}{title:firstword:lower}
+//
+// author and editor are split into names: authorN is the N-th name, author
+// all names joined, and first, von, last (default) or jr selects the part.
+// The modifiers lower, upper and firstword change the value, N keeps the
+// first and -N the last N characters. They see the value without LaTeX
+// markup, the characters not allowed in keys are removed by the caller.
+class KeyTemplate
+{
+  public:
+    // Constructor, the built-in scheme "{author1:last}{year:-2}" that adds a
+    // letter to every key
+    KeyTemplate();
+
+    // Compile 'scheme', returns false on a syntax error. Keys of a compiled
+    // scheme only get a letter if they occur more than once.
+    bool compile(std::string_view scheme);
+
+    // Fields read by the scheme in lower case, evaluate() takes their values
+    // in this order
+    const std::vector<std::string>& fields() const { return used; }
+
+    // True if every key gets a letter
+    bool always_adds_letter() const { return always; }
+
+    // Returns the key for the 'values' of fields(), author and editor are
+    // parsed by 'names'
+    std::string evaluate(const std::vector<std::string_view> &values,
+        NameCache &names) const;
+
+  private:
+    enum Part { NONE, FIRST, VON, LAST, JR };
+    enum Kind { LOWER, UPPER, FIRSTWORD, HEAD, TAIL };
+
+    struct modifier {
+      Kind kind;
+      size_t n;
+    };
+
+    // Literal text followed by a field, 'field' is npos if there is none.
+    // 'name' is the number of the name starting at 1 or 0 for all names.
+    struct operation {
+      std::string literal;
+      size_t field;
+      size_t name;
+      Part part;
+      std::vector<modifier> modifiers;
+    };
+
+    std::vector<operation> operations;
+    std::vector<std::string> used;
+    bool always;
+
+    // Returns the modified 'value' of 'op'
+    std::string field_value(const operation &op, std::string_view value,
+        NameCache &names) const;
+};
+
+#endif
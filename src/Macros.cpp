@@ -0,0 +1,120 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "Macros.hpp"
+
+void MacroTable::define(std::string_view name, const std::string &expr)
+{
+  auto it = macros.find(std::string(name));
+  if (it == macros.end()) {
+    macros.emplace(name, macro{definitions.size(), UNEXPANDED, ""});
+    definitions.emplace_back(name, expr);
+    return;
+  }
+  if (it->second.definition < done) {
+    it->second.definition = definitions.size();
+    definitions.emplace_back(name, expr);
+  }
+  else
+    definitions[it->second.definition].second = expr;
+  // other macros may be defined in terms of this one
+  for (auto &m : macros)
+    m.second.state = UNEXPANDED;
+}
+
+
+void MacroTable::add_preamble(const std::string &expr)
+{
+  definitions.emplace_back("", expr);
+}
+
+
+void MacroTable::add(const std::vector<definition> &defs)
+{
+  for (const definition &def : defs) {
+    if (def.first.empty())
+      add_preamble(def.second);
+    else
+      define(def.first, def.second);
+  }
+}
+
+
+std::vector<MacroTable::definition> MacroTable::pending()
+{
+  std::vector<definition> result(definitions.begin()+done,
+      definitions.end());
+  done = definitions.size();
+  return result;
+}
+
+
+bool MacroTable::expand(std::string_view expr, std::string &value)
+{
+  std::string result;
+  bool defined = true;
+  bool valid = for_each_part(expr,
+      [&] (std::string_view part, Part kind) {
+        if (kind != MACRO) {
+          result.append(part.data(), part.size());
+          return;
+        }
+        const std::string *expanded = lookup(part);
+        if (expanded)
+          result += *expanded;
+        else
+          defined = false;
+      });
+  if (!valid || !defined)
+    return false;
+  value.swap(result);
+  return true;
+}
+
+
+const std::string* MacroTable::lookup(std::string_view name)
+{
+  auto it = macros.find(std::string(name));
+  if (it == macros.end())
+    return nullptr;
+  macro &m = it->second;
+  if (m.state == UNEXPANDED) {
+    // a macro that is defined in terms of itself is undefined
+    m.state = EXPANDING;
+    std::string value;
+    bool ok = expand(definitions[m.definition].second, value);
+    m.value.swap(value);
+    m.state = ok ? EXPANDED : UNDEFINED;
+  }
+  return m.state == EXPANDED ? &m.value : nullptr;
+}
+
+
+void MacroTable::print(std::ostream &os, bool strings)
+{
+  for (; done < definitions.size(); ++done) {
+    const definition &def = definitions[done];
+    if (def.first.empty())
+      os << "@preamble{" << def.second << "}\n\n";
+    else if (strings || !lookup(def.first))
+      os << "@string{" << def.first << " = " << def.second << "}\n\n";
+  }
+}
@@ -0,0 +1,155 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MACROS_H
+#define MACROS_H
+
+#include <cctype>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "CaseFold.hpp"
+
+// The @string macros and @preambles of a bibliography. Macros are expanded
+// only when their value is needed and every macro is expanded only once.
+class MacroTable
+{
+  public:
+    // A definition as name (empty for a @preamble) and expression
+    typedef std::pair<std::string, std::string> definition;
+
+    // Define the macro 'name' (case insensitive) as the expression 'expr',
+    // a previous definition is replaced. A definition that was printed
+    // already is kept and the new one is added after it.
+    void define(std::string_view name, const std::string &expr);
+
+    // Add a @preamble with the expression 'expr'
+    void add_preamble(const std::string &expr);
+
+    // Add the definitions 'defs' as returned by pending()
+    void add(const std::vector<definition> &defs);
+
+    // Returns the definitions that were added since the last call of
+    // pending() or print() in the order they were read
+    std::vector<definition> pending();
+
+    // Expand the expression 'expr' into 'value', returns false and leaves
+    // 'value' unchanged if 'expr' uses an undefined macro
+    bool expand(std::string_view expr, std::string &value);
+
+    // Print the definitions and preambles that were added since the last
+    // call of pending() or print() in the order they were read, the @string
+    // definitions that can be expanded are left out if 'strings' is false
+    void print(std::ostream &os, bool strings);
+
+    // Kinds of the parts of an expression
+    enum Part { STRING, NUMBER, MACRO };
+
+    // Calls 'f' with every part of the expression 'expr' and returns false if
+    // 'expr' is not valid. A part is a {string}, a "string", a number or a
+    // macro name, 'f' gets the text without delimiters and the kind.
+    template <class F>
+    static bool for_each_part(std::string_view expr, F f);
+
+  private:
+    // A macro refers to its definition in 'definitions', 'value' is valid
+    // once 'state' is EXPANDED
+    enum State { UNEXPANDED, EXPANDING, EXPANDED, UNDEFINED };
+    struct macro {
+      size_t definition;
+      State state;
+      std::string value;
+    };
+
+    // Macro names and expressions in the order they were read, the name of a
+    // @preamble is empty
+    std::vector<definition> definitions;
+
+    // Number of definitions returned by pending() or printed
+    size_t done = 0;
+
+    // Macros by name
+    std::unordered_map<std::string, macro, CaseFold::hasher,
+      CaseFold::equal_to> macros;
+
+    // Returns the expanded value of the macro 'name' or nullptr if it is not
+    // defined or defined in terms of itself
+    const std::string* lookup(std::string_view name);
+};
+
+
+template <class F>
+bool MacroTable::for_each_part(std::string_view expr, F f)
+{
+  auto is_name_char = [] (char c) -> bool {
+    return isprint(static_cast<unsigned char>(c)) &&
+      !isspace(static_cast<unsigned char>(c)) &&
+      std::string_view("\"#%'(),={}").find(c) == std::string_view::npos;
+  };
+  size_t i = 0, n = expr.size();
+  while (true) {
+    while (i < n && isspace(static_cast<unsigned char>(expr[i])))
+      ++i;
+    if (i == n)
+      return false;
+    char c = expr[i];
+    size_t begin = i;
+    if (c == '{' || c == '"') {
+      // strings end at the closing delimiter outside of nested braces
+      int depth = (c == '{');
+      for (++i; i < n; ++i) {
+        if (expr[i] == '{')
+          ++depth;
+        else if (expr[i] == '}' && depth > 0 && --depth == 0 && c == '{')
+          break;
+        else if (expr[i] == '"' && depth == 0 && c == '"')
+          break;
+      }
+      if (i == n)
+        return false;
+      f(expr.substr(begin+1, i-begin-1), STRING);
+      ++i;
+    }
+    else if (isdigit(static_cast<unsigned char>(c))) {
+      while (i < n && isdigit(static_cast<unsigned char>(expr[i])))
+        ++i;
+      f(expr.substr(begin, i-begin), NUMBER);
+    }
+    else if (is_name_char(c)) {
+      while (i < n && is_name_char(expr[i]))
+        ++i;
+      f(expr.substr(begin, i-begin), MACRO);
+    }
+    else
+      return false;
+    while (i < n && isspace(static_cast<unsigned char>(expr[i])))
+      ++i;
+    if (i == n)
+      return true;
+    if (expr[i++] != '#')
+      return false;
+  }
+}
+
+#endif
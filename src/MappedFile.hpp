@@ -0,0 +1,41 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Helpers for the index files that are mapped into memory and checked
+// against the size and modification time of the file they were built from
+
+// Size and modification time of 'filename', returns false on errors
+bool file_stamp(const std::string &filename, uint64_t &size, int64_t &mtime);
+
+// Map 'filename' read only into memory, returns nullptr on errors and for
+// empty files
+const char* map_file(const std::string &filename, size_t &size);
+
+// Unmap the 'size' bytes at 'data' returned by map_file()
+void unmap_file(const char *data, size_t size);
+
+#endif
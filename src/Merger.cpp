@@ -0,0 +1,223 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <utility>
+#include <boost/algorithm/string/predicate.hpp>
+#include "CaseFold.hpp"
+#include "DataStructure.hpp"
+#include "Merger.hpp"
+
+namespace bstring = boost::algorithm;
+
+Merger::Merger(Policy _policy) :
+  policy(_policy)
+{
+}
+
+
+std::string Merger::normalize_doi(std::string_view doi)
+{
+  std::string result(doi);
+  CaseFold::to_lower(result);
+  for (const char *prefix : {"https://doi.org/", "http://doi.org/",
+      "https://dx.doi.org/", "http://dx.doi.org/", "doi:"}) {
+    if (bstring::starts_with(result, prefix)) {
+      result.erase(0, std::char_traits<char>::length(prefix));
+      break;
+    }
+  }
+  return result;
+}
+
+
+std::string Merger::get_doi(const bibEntry &bEn) const
+{
+  for (const bibElement &bEl : bEn.element)
+    if (CaseFold::equals(bEl.field, "doi"))
+      return normalize_doi(bEl.value);
+  return "";
+}
+
+
+std::string Merger::free_key(const std::string &key,
+    const std::unordered_set<std::string, CaseFold::hasher,
+      CaseFold::equal_to> &reserved) const
+{
+  std::string result;
+  for (size_t id = 1; ; ++id) {
+    result = key;
+    for (size_t n = id; n > 0; n = (n-1) / 26)
+      result.insert(key.size(), 1, char('a' + (n-1) % 26));
+    if (!key_index.count(result) && !reserved.count(result))
+      return result;
+  }
+}
+
+
+void Merger::join(std::vector<bibEntry> &bib,
+    std::vector<bibEntry> &incoming, const std::string &source)
+{
+  // entries that are already in 'bib' but were not joined yet
+  for (size_t pos = sources.size(); pos < bib.size(); ++pos) {
+    sources.push_back(source);
+    key_index.insert(std::make_pair(bib[pos].key, pos));
+    dois.push_back(get_doi(bib[pos]));
+    if (!dois.back().empty())
+      doi_index.insert(std::make_pair(dois.back(), pos));
+  }
+
+  key_index.reserve(key_index.size() + incoming.size());
+  // a renamed key must not take the key of a later incoming entry
+  std::unordered_set<std::string, CaseFold::hasher, CaseFold::equal_to>
+    reserved;
+  for (const bibEntry &bEn : incoming)
+    reserved.insert(bEn.key);
+  for (bibEntry &bEn : incoming) {
+    const std::string &key = bEn.key;
+    std::string doi = get_doi(bEn);
+
+    // look for a matching entry, by DOI first and by key second, entries
+    // with different DOIs never match
+    size_t pos = 0;
+    bool matched = false;
+    if (!doi.empty()) {
+      auto found = doi_index.find(doi);
+      if ((matched = (found != doi_index.end())))
+        pos = found->second;
+    }
+    if (!matched && !key.empty()) {
+      auto found = key_index.find(key);
+      if ((matched = (found != key_index.end())))
+        pos = found->second;
+      if (matched && !doi.empty() && !dois[pos].empty())
+        matched = false;
+    }
+    if (!matched) {
+      // new entry, a taken key belongs to an entry with another DOI and is
+      // renamed so that the keys stay unique
+      if (!key.empty() && key_index.count(key)) {
+        conflict c;
+        c.key = key;
+        c.field = "key";
+        c.kept = free_key(key, reserved);
+        c.dropped = key;
+        c.kept_source = source;
+        c.dropped_source = source;
+        bEn.key = c.kept;
+        conflicts.push_back(std::move(c));
+      }
+      // add it to the indices
+      pos = bib.size();
+      if (!key.empty())
+        key_index.insert(std::make_pair(key, pos));
+      if (!doi.empty())
+        doi_index.insert(std::make_pair(doi, pos));
+      sources.push_back(source);
+      dois.push_back(doi);
+      bib.push_back(std::move(bEn));
+      continue;
+    }
+
+    // matching entry, combine both and index the new key and DOI as well
+    if (!key.empty())
+      key_index.insert(std::make_pair(key, pos));
+    if (!doi.empty()) {
+      doi_index.insert(std::make_pair(doi, pos));
+      if (dois[pos].empty() || policy == PREFER_NEWEST)
+        dois[pos] = doi;
+    }
+    combine(bib[pos], pos, bEn, source);
+  }
+}
+
+
+void Merger::combine(bibEntry &old, size_t pos, bibEntry &bEn,
+    const std::string &source)
+{
+  bool prefer_new = (policy == PREFER_NEWEST);
+
+  // record a conflict, 'prefer_new' decides which value is kept
+  auto add_conflict = [&] (const std::string &field,
+      const std::string &old_value, const std::string &new_value) {
+    conflict c;
+    c.key = prefer_new ? bEn.key : old.key;
+    c.field = field;
+    c.kept = prefer_new ? new_value : old_value;
+    c.dropped = prefer_new ? old_value : new_value;
+    c.kept_source = prefer_new ? source : sources[pos];
+    c.dropped_source = prefer_new ? sources[pos] : source;
+    conflicts.push_back(c);
+  };
+
+  if (old.key != bEn.key)
+    add_conflict("key", old.key, bEn.key);
+  if (!CaseFold::equals(old.type, bEn.type))
+    add_conflict("type", old.type, bEn.type);
+
+  // compare all fields, DOIs are equal if their normalized forms are
+  auto find_field = [] (std::vector<bibElement> &elements,
+      const std::string &field) {
+    return std::find_if(elements.begin(), elements.end(),
+        [&] (const bibElement &cmp) -> bool {
+          return CaseFold::equals(cmp.field, field);
+        });
+  };
+  std::vector<bibElement> missing;
+  for (bibElement &bEl : bEn.element) {
+    auto it = find_field(old.element, bEl.field);
+    if (it == old.element.end()) {
+      if (policy == PREFER_FIRST)
+        add_conflict(bEl.field, "", bEl.value);
+      missing.push_back(bEl);
+    }
+    else if (CaseFold::equals(bEl.field, "doi") ?
+        normalize_doi(it->value) != normalize_doi(bEl.value) :
+        it->value != bEl.value)
+      add_conflict(it->field, it->value, bEl.value);
+  }
+
+  // fields that only the old entry has are dropped with it
+  if (prefer_new)
+    for (const bibElement &bEl : old.element)
+      if (find_field(bEn.element, bEl.field) == bEn.element.end())
+        add_conflict(bEl.field, bEl.value, "");
+
+  if (policy == PREFER_NEWEST) {
+    old = std::move(bEn);
+    sources[pos] = source;
+  }
+  else if (policy == UNION_FIELDS) {
+    for (bibElement &bEl : missing)
+      old.element.push_back(std::move(bEl));
+  }
+}
+
+
+void Merger::write_report(std::ostream &os) const
+{
+  if (conflicts.empty())
+    return;
+  os << "key\tfield\tkept\tkept_source\tdropped\tdropped_source\n";
+  for (const conflict &c : conflicts)
+    os << c.key << '\t' << c.field << '\t' << c.kept << '\t'
+      << c.kept_source << '\t' << c.dropped << '\t' << c.dropped_source
+      << '\n';
+}
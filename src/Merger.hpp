@@ -0,0 +1,102 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MERGER_H
+#define MERGER_H
+
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "CaseFold.hpp"
+
+// Forward declaration of user-defined types
+class bibEntry;
+
+class Merger
+{
+  public:
+    // How entries that occur in more than one file are combined
+    enum Policy {
+      PREFER_FIRST,   // keep the entry that was read first
+      PREFER_NEWEST,  // keep the entry that was read last
+      UNION_FIELDS    // keep all fields, the first value wins on conflicts
+    };
+
+    // Constructor
+    Merger(Policy _policy);
+
+    // Join the entries in 'incoming' (read from 'source') into 'bib'
+    // Entries are matched by DOI if both define one and by key otherwise. An
+    // entry that does not match but uses a taken key gets a letter suffix,
+    // which is reported as conflict.
+    void join(std::vector<bibEntry> &bib, std::vector<bibEntry> &incoming,
+        const std::string &source);
+
+    // Print all conflicts found while joining to 'os'
+    void write_report(std::ostream &os) const;
+
+    // Returns the lower case 'doi' without resolver prefix
+    static std::string normalize_doi(std::string_view doi);
+
+  private:
+    // A field that has different values in two joined entries
+    struct conflict {
+      std::string key;
+      std::string field;
+      std::string kept;
+      std::string dropped;
+      std::string kept_source;
+      std::string dropped_source;
+    };
+
+    // Policy used for joining
+    Policy policy;
+
+    // Position in the bibliography of every key (case insensitive) and DOI
+    std::unordered_map<std::string, size_t, CaseFold::hasher,
+      CaseFold::equal_to> key_index;
+    std::unordered_map<std::string, size_t> doi_index;
+
+    // Source and normalized DOI of every entry in the bibliography
+    std::vector<std::string> sources;
+    std::vector<std::string> dois;
+
+    // Conflicts found so far
+    std::vector<conflict> conflicts;
+
+    // Returns the lower case DOI of 'bEn' without resolver prefix
+    std::string get_doi(const bibEntry &bEn) const;
+
+    // Returns 'key' with the first letter suffix (a to z, then aa, ab and
+    // so on) that is neither taken by another entry nor in 'reserved'
+    std::string free_key(const std::string &key,
+        const std::unordered_set<std::string, CaseFold::hasher,
+          CaseFold::equal_to> &reserved) const;
+
+    // Combine 'bEn' with the entry 'old' according to the policy, fields that
+    // are not kept are reported as conflicts
+    void combine(bibEntry &old, size_t pos, bibEntry &bEn,
+        const std::string &source);
+};
+
+#endif
@@ -0,0 +1,223 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cctype>
+#include "Names.hpp"
+
+// Returns true if 'c' separates the words of a name
+static bool is_separator(char c)
+{
+  return isspace(static_cast<unsigned char>(c)) || c == '~' || c == '-';
+}
+
+
+const std::vector<bibName>& NameCache::get(std::string_view value)
+{
+  auto it = cache.find(std::string(value));
+  if (it != cache.end())
+    return it->second;
+  if (cache.size() >= max_size)
+    cache.clear();
+  return cache.emplace(value, parse(value)).first->second;
+}
+
+
+const std::string& NameCache::first_lastname(std::string_view value)
+{
+  static const std::string empty;
+  const std::vector<bibName> &names = get(value);
+  return names.empty() ? empty : names.front().last;
+}
+
+
+std::vector<bibName> NameCache::parse(std::string_view value)
+{
+  // split at every "and" that is a word at brace depth zero
+  std::vector<bibName> names;
+  size_t begin = 0;
+  int depth = 0;
+  for (size_t i = 0; i <= value.size(); ++i) {
+    bool split = (i == value.size());
+    if (!split) {
+      char c = value[i];
+      if (c == '{')
+        ++depth;
+      else if (c == '}')
+        --depth;
+      else if (depth == 0 && i > begin && i+4 < value.size() &&
+          isspace(static_cast<unsigned char>(c)) &&
+          (value[i+1] == 'a' || value[i+1] == 'A') &&
+          (value[i+2] == 'n' || value[i+2] == 'N') &&
+          (value[i+3] == 'd' || value[i+3] == 'D') &&
+          isspace(static_cast<unsigned char>(value[i+4])))
+        split = true;
+    }
+    if (!split)
+      continue;
+    bibName name = parse_name(value.substr(begin, i-begin));
+    if (!name.last.empty() || !name.first.empty())
+      names.push_back(std::move(name));
+    i += 4;
+    begin = i+1;
+  }
+  return names;
+}
+
+
+bibName NameCache::parse_name(std::string_view name)
+{
+  // split into words and the words into the parts separated by commas
+  std::vector<token> tokens;
+  std::vector<size_t> commas;
+  int depth = 0;
+  char sep = ' ';
+  size_t start = 0;
+  bool in_token = false;
+  for (size_t i = 0; i <= name.size(); ++i) {
+    char c = i < name.size() ? name[i] : ',';
+    bool end = (i == name.size());
+    if (depth == 0 && (end || c == ',' || is_separator(c))) {
+      if (in_token) {
+        tokens.push_back({name.substr(start, i-start), sep});
+        in_token = false;
+        sep = ' ';
+      }
+      // a '-' or '~' is kept as separator, spaces do not replace it
+      if (c == '-' || c == '~')
+        sep = c;
+      else if (c == ',' && !end) {
+        commas.push_back(tokens.size());
+        sep = ' ';
+      }
+      continue;
+    }
+    if (c == '{')
+      ++depth;
+    else if (c == '}' && depth > 0)
+      --depth;
+    if (!in_token) {
+      start = i;
+      in_token = true;
+    }
+  }
+
+  bibName bN;
+  size_t n = tokens.size();
+  if (n == 0)
+    return bN;
+
+  // the part before the first comma (or the whole name) ends with the last
+  // name, a von part consists of the words up to the last lower case word
+  auto von_end = [&] (size_t von_start, size_t last_end) -> size_t
+    {
+      for (size_t i = last_end-1; i > von_start; --i)
+        if (is_lower(tokens[i-1].text))
+          return i;
+      return von_start;
+    };
+
+  if (commas.empty()) {
+    // First von Last
+    size_t von_start = 0;
+    while (von_start < n-1 && !is_lower(tokens[von_start].text))
+      ++von_start;
+    size_t last_start;
+    if (von_start < n-1) {
+      last_start = von_end(von_start, n);
+    }
+    else {
+      // no von part, the last name contains all words joined by hyphens
+      von_start = n-1;
+      while (von_start > 0 && tokens[von_start].sep == '-')
+        --von_start;
+      last_start = von_start;
+    }
+    bN.first = join(tokens, 0, von_start);
+    bN.von = join(tokens, von_start, last_start);
+    bN.last = join(tokens, last_start, n);
+  }
+  else {
+    // von Last, First or von Last, Jr, First
+    size_t last_end = commas[0];
+    if (last_end == 0)
+      return bN;
+    size_t last_start = von_end(0, last_end);
+    bN.von = join(tokens, 0, last_start);
+    bN.last = join(tokens, last_start, last_end);
+    if (commas.size() == 1)
+      bN.first = join(tokens, commas[0], n);
+    else {
+      bN.jr = join(tokens, commas[0], commas[1]);
+      bN.first = join(tokens, commas[1], n);
+    }
+  }
+  return bN;
+}
+
+
+bool NameCache::is_lower(std::string_view tok)
+{
+  for (size_t i = 0; i < tok.size(); ++i) {
+    char c = tok[i];
+    if (isalpha(static_cast<unsigned char>(c)))
+      return islower(static_cast<unsigned char>(c));
+    if (c != '{')
+      continue;
+    // find the end of the group
+    size_t end = i+1;
+    for (int depth = 1; end < tok.size() && depth > 0; ++end)
+      depth += (tok[end] == '{') - (tok[end] == '}');
+    // groups without a leading backslash have no case
+    if (i+1 < tok.size() && tok[i+1] == '\\') {
+      // the case of special characters is that of the command if it is a
+      // foreign letter like \ss or \AA and else that of the first letter
+      size_t cmd = i+2;
+      while (cmd < end && isalpha(static_cast<unsigned char>(tok[cmd])))
+        ++cmd;
+      std::string_view command = tok.substr(i+2, cmd-i-2);
+      if (command == "oe" || command == "ae" || command == "aa" ||
+          command == "o" || command == "l" || command == "ss" ||
+          command == "i" || command == "j")
+        return true;
+      if (command == "OE" || command == "AE" || command == "AA" ||
+          command == "O" || command == "L")
+        return false;
+      for (size_t j = cmd; j < end; ++j)
+        if (isalpha(static_cast<unsigned char>(tok[j])))
+          return islower(static_cast<unsigned char>(tok[j]));
+    }
+    i = end-1;
+  }
+  return false;
+}
+
+
+std::string NameCache::join(const std::vector<token> &tokens, size_t begin,
+    size_t end)
+{
+  std::string str;
+  for (size_t i = begin; i < end; ++i) {
+    if (i > begin)
+      str += tokens[i].sep;
+    str.append(tokens[i].text.data(), tokens[i].text.size());
+  }
+  return str;
+}
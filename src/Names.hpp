@@ -0,0 +1,82 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef NAMES_H
+#define NAMES_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// One name of an author or editor field split into its BibTeX parts
+struct bibName
+{
+  std::string first;
+  std::string von;
+  std::string last;
+  std::string jr;
+};
+
+// Parses author and editor fields. Every distinct field value is parsed only
+// once, an edited field has a new value and is therefore parsed again.
+class NameCache
+{
+  public:
+    // Returns the names in the field value 'value'
+    // The reference is valid until the next call of get()
+    const std::vector<bibName>& get(std::string_view value);
+
+    // Returns the last name of the first name in 'value', empty if there is
+    // none
+    const std::string& first_lastname(std::string_view value);
+
+    // Splits 'value' at every "and" into names and every name into the parts
+    // first, von, last and jr following the rules of BibTeX
+    static std::vector<bibName> parse(std::string_view value);
+
+  private:
+    // The cache is cleared when it reaches this number of values
+    static const size_t max_size = 1 << 16;
+
+    // A word of a name and the character that separated it from the word
+    // before (' ', '~' or '-')
+    struct token {
+      std::string_view text;
+      char sep;
+    };
+
+    // Parsed names of all field values seen so far
+    std::unordered_map<std::string, std::vector<bibName>> cache;
+
+    // Splits one name into its parts
+    static bibName parse_name(std::string_view name);
+
+    // Returns true if the first letter of 'tok' at brace depth zero is lower
+    // case, letters of special characters like {\"u} count too
+    static bool is_lower(std::string_view tok);
+
+    // Joins the tokens [begin, end) using their separators
+    static std::string join(const std::vector<token> &tokens, size_t begin,
+        size_t end);
+};
+
+#endif
@@ -18,11 +18,25 @@
  *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <sstream>
+#include "CaseFold.hpp"
+#include "CompactStore.hpp"
 #include "DataStructure.hpp"
+#include "Macros.hpp"
 #include "Parser.hpp"
 
+Parser::Parser(MacroTable *_macros) :
+  macros(_macros),
+  keep(nullptr),
+  hashes(nullptr),
+  source(0),
+  position(0)
+{
+}
+
+
 void Parser::add(std::istream &is, std::vector<bibEntry> &bib)
 {
   // add the stream to 'bib'
@@ -31,52 +45,153 @@ void Parser::add(std::istream &is, std::vector<bibEntry> &bib)
 }
 
 
-std::string Parser::clean_string(std::string str) const
+void Parser::add(std::istream &is, CompactStore &store)
+{
+  // only one entry exists as bibEntry at a time
+  for (bibEntry bE; get_bibEntry(is, bE); bE.element.clear())
+    store.push_back(bE);
+}
+
+
+size_t Parser::add(std::istream &is, std::vector<bibEntry> &bib,
+    size_t max_bytes)
+{
+  size_t bytes = 0;
+  for (bibEntry bE; bytes < max_bytes && get_bibEntry(is, bE);
+      bE.element.clear()) {
+    bytes += bE.type.size() + bE.key.size();
+    for (const bibElement &bEl : bE.element)
+      bytes += bEl.field.size() + bEl.value.size();
+    bib.push_back(bE);
+  }
+  return bytes;
+}
+
+
+void Parser::set_projection(std::function<bool(std::string_view)> _keep)
 {
-  // Replace the characters \f, \n, \r, \t, \v with spaces
-  std::replace_if(str.begin(), str.end(),
-      [] (char c) -> bool { return (isspace(c) && c != ' '); }, ' ');
+  keep = _keep;
+}
 
-  // Remove double spaces
-  auto del_from = std::unique(str.begin(), str.end(),
-      [] (char c1, char c2) { return (c1 == c2 && c1 == ' '); } );
-  str.erase(del_from, str.end());
 
-  // Delete leading and ending spaces
-  size_t first = str.find_first_not_of(" ");
-  if (first == std::string::npos)
-    return "";
-  size_t last = str.find_last_not_of(" ");
-  str = str.substr(first, last-first+1);
+void Parser::set_hashes(std::vector<std::vector<size_t>> *_hashes)
+{
+  hashes = _hashes;
+}
+
 
+size_t Parser::element_hash(std::string_view field, std::string_view value)
+{
+  // runs of white space count as one space, leading and ending ones are
+  // ignored like in clean_string()
+  uint64_t h = 0xcbf29ce484222325ULL;
+  bool space = false, begun = false;
+  for (char c : value) {
+    if (c == ' ' || (c >= '\t' && c <= '\r')) {
+      space = begun;
+      continue;
+    }
+    if (space)
+      h = (h ^ uint64_t(' ')) * 0x100000001b3ULL;
+    h = (h ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+    space = false;
+    begun = true;
+  }
+  return CaseFold::hash(field) * 31 + (h ^ (h >> 32));
+}
+
+
+void Parser::set_source(size_t id, uint64_t offset)
+{
+  source = id;
+  position = offset;
+}
+
+
+std::string_view Parser::trim(std::string_view str)
+{
+  while (!str.empty() && (str.front() == ' ' ||
+        (str.front() >= '\t' && str.front() <= '\r')))
+    str.remove_prefix(1);
+  while (!str.empty() && (str.back() == ' ' ||
+        (str.back() >= '\t' && str.back() <= '\r')))
+    str.remove_suffix(1);
   return str;
 }
 
 
-std::istream& Parser::get_block(std::istream& is, std::string& str) const
+void Parser::clean_string(std::string &str) const
 {
-    std::stringstream block;
-    int depth = 1;
-    for (char c; is.get(c);) {
-      if (c == '{')
-        ++depth;
-      else if ((c == '}') && !--depth)
+  // Replace the characters \f, \n, \r, \t, \v with spaces, remove double
+  // spaces and delete leading and ending spaces in a single pass. 'out' never
+  // overtakes 'in', so the string is rewritten in place.
+  const uint64_t ones = 0x0101010101010101ULL;
+  const uint64_t high = 0x8080808080808080ULL;
+  char *p = &str[0];
+  size_t in = 0, out = 0, len = str.size();
+  bool space = true;
+  while (in < len) {
+    // copy blocks of eight bytes that contain no byte <= ' ' at once
+    if (!space) {
+      while (in+8 <= len) {
+        uint64_t x;
+        std::memcpy(&x, p+in, sizeof(x));
+        if ((x - ones*0x21) & ~x & high)
+          break;
+        if (out != in)
+          std::memcpy(p+out, &x, sizeof(x));
+        in += 8;
+        out += 8;
+      }
+      if (in == len)
         break;
-      block << c;
     }
-    str = block.str();
+    char c = p[in++];
+    if (c == ' ' || (c >= '\t' && c <= '\r')) {
+      if (!space)
+        p[out++] = ' ';
+      space = true;
+    }
+    else {
+      p[out++] = c;
+      space = false;
+    }
+  }
+  if (out > 0 && p[out-1] == ' ')
+    --out;
+  str.resize(out);
+}
+
+
+std::istream& Parser::get_block(std::istream& is, std::string& str) const
+{
+  str.clear();
+  if (!is)
     return is;
+  // read from the buffer directly, every character is appended to 'str'
+  std::streambuf *sb = is.rdbuf();
+  int depth = 1;
+  for (int i; (i = sb->sbumpc()) != std::char_traits<char>::eof();) {
+    char c = i;
+    if (c == '{')
+      ++depth;
+    else if ((c == '}') && !--depth)
+      return is;
+    str += c;
+  }
+  is.setstate(std::ios::eofbit | std::ios::failbit);
+  return is;
 }
 
-std::istream& Parser::get_unnested(std::istream& is, std::string& str) const
+size_t Parser::find_unnested(const std::string &str, size_t pos) const
 {
-  std::stringstream unnested;
   int depth(0);
   bool use_quotes = false;
   bool is_escaped = false;
 
   // iterate over all characters
-  for (char c; is.get(c);) {
+  for (size_t i = pos; i < str.size(); ++i) {
+    char c = str[i];
 
     // a leading quotation mark increases the depth, an ending one decreases it
     if (c == '"' && !is_escaped) {
@@ -99,71 +214,202 @@ std::istream& Parser::get_unnested(std::istream& is, std::string& str) const
 
     // stop if we are at depth zero and a comma is found
     else if ((c == ',') && !depth) {
-      break;
+      return i;
     }
 
     // save if escape character is used
-    if (c == '\\') {
-      is_escaped = true;
-    } else {
-      is_escaped = false;
-    }
-
-    // add character to unnested
-    unnested << c;
+    is_escaped = (c == '\\');
   }
 
-  str = unnested.str();
-  return is;
+  return std::string::npos;
 }
 
-std::istream& Parser::get_bibEntry(std::istream& is, bibEntry& bEn) const
+std::istream& Parser::get_bibEntry(std::istream& is, bibEntry& bEn)
 {
-  // Discard everything bevore the first @
   std::string tmp;
-  std::getline(is, tmp, '@');
+  while (true) {
+    // Discard everything bevore the first @
+    std::getline(is, tmp, '@');
+    position += tmp.size() + 1;
+    bEn.source = source;
+    bEn.offset = position - 1;
 
-  // get type
-  std::getline(is, bEn.type, '{');  
-  bEn.type = clean_string(bEn.type);
+    // get type, the stream may end after @string or @comment
+    if (!std::getline(is, bEn.type, '{'))
+      return is;
+    position += bEn.type.size() + 1;
+    clean_string(bEn.type);
 
-  // save block in stringstream
+    // macros and preambles are not entries, comments are skipped
+    bool is_string = CaseFold::equals(bEn.type, "string");
+    bool is_preamble = CaseFold::equals(bEn.type, "preamble");
+    if (!is_string && !is_preamble && !CaseFold::equals(bEn.type, "comment"))
+      break;
+    get_block(is, tmp);
+    position += tmp.size() + 1;
+    if (!is || !macros)
+      continue;
+    std::string expr;
+    if (is_preamble) {
+      if (get_expression(tmp, expr, true))
+        macros->add_preamble(expr);
+      continue;
+    }
+    size_t eq = tmp.find('=');
+    if (is_string && eq != std::string::npos &&
+        get_expression(std::string_view(tmp).substr(eq+1), expr, true)) {
+      tmp.erase(eq);
+      clean_string(tmp);
+      macros->define(tmp, expr);
+    }
+  }
+
+  // save block, the elements are located in it without copying
   std::string bEn_s;
   get_block(is, bEn_s);
-  std::stringstream bEn_ss(bEn_s);
+  position += bEn_s.size() + 1;
+  if (hashes && is)
+    hashes->emplace_back();
 
-  // create bibEntry
-  auto old_position = bEn_ss.tellg();
-  std::getline(bEn_ss, bEn.key, ',');
-  bEn.key = clean_string(bEn.key);
+  // create bibEntry, the key ends at the first ','
+  size_t pos = bEn_s.find(',');
+  bEn.key.assign(bEn_s, 0, pos);
+  clean_string(bEn.key);
   if (bEn.key.find('=') != std::string::npos) {
     bEn.key = "";
-    bEn_ss.seekg(old_position);
+    pos = 0;
   }
+  else
+    pos = (pos == std::string::npos) ? bEn_s.size() : pos+1;
+  // the streams are reused for all elements
+  std::string bEl_s;
+  std::istringstream bEl_ss;
+  bibElement skipped;
   while (true) {
-    std::string bEl_s;
-    // get one line ending with ',' however last line may not end with ','
-    bool last = !get_unnested(bEn_ss, bEl_s);
-    bEl_s = clean_string(bEl_s);
-    if (last && bEl_s.empty()) {
-      break;
+    // get one element ending with ',' however last element may not end
+    // with ','
+    size_t end = find_unnested(bEn_s, pos);
+    bool last = (end == std::string::npos);
+    if (last)
+      end = bEn_s.size();
+    size_t begin = pos;
+    pos = end+1;
+    // an element without '=' is not a field, e.g. a stray note or binary
+    // data, and is skipped
+    std::string_view element(bEn_s.data()+begin, end-begin);
+    if (element.find('=') == std::string_view::npos) {
+      if (last)
+        break;
+      continue;
+    }
+    // elements that are not kept are skipped before their value is copied,
+    // if their hashes are needed they are taken from the value in the block
+    bool kept = true;
+    if (keep) {
+      std::string_view field = trim(element.substr(0, element.find('=')));
+      std::string_view value;
+      if (!field.empty() && !keep(field)) {
+        kept = false;
+        if (!hashes || locate_value(element, value)) {
+          if (hashes)
+            hashes->back().push_back(element_hash(field, value));
+          if (last)
+            break;
+          continue;
+        }
+      }
     }
-    // extract element
-    std::stringstream bEl_ss(bEl_s);
+    bEl_s.assign(bEn_s, begin, end-begin);
+    clean_string(bEl_s);
+    // a skipped expression is parsed into 'skipped' to reuse its memory
     bibElement bEl;
-    // field is the part before '='
-    std::getline(bEl_ss, bEl.field, '=');
-    bEl.field = clean_string(bEl.field);
-    // 'delim' is the first printable character that is not a space
-    std::string bEl_str = bEl_ss.str().substr(bEl_ss.tellg());
-    char delim = ' ';
-    for (char& c : bEl_str) {
-      if ((!isspace(c)) && (isprint(c))) {
-        delim = c;
+    bibElement &target = kept ? bEl : skipped;
+    target.expression = false;
+    get_element(bEl_s, bEl_ss, tmp, target);
+    if (hashes)
+      hashes->back().push_back(element_hash(target.field, target.value));
+    if (!kept) {
+      if (last)
         break;
-      }
+      continue;
+    }
+    bEn.element.push_back(std::move(bEl));
+    if (last) break;
+  }
+
+  return is;
+}
+
+
+bool Parser::locate_value(std::string_view element, std::string_view &value)
+{
+  // the same delimiters as in get_element() are recognized
+  value = std::string_view();
+  size_t start = element.find('=');
+  if (start == std::string_view::npos)
+    return true;
+  ++start;
+  while (start < element.size() &&
+      (isspace(static_cast<unsigned char>(element[start])) ||
+       !isprint(static_cast<unsigned char>(element[start]))))
+    ++start;
+  if (start == element.size())
+    return true;
+  char delim = element[start];
+  if (element.find('#', start) != std::string_view::npos ||
+      (delim != '{' && delim != '"' &&
+       !isdigit(static_cast<unsigned char>(delim))))
+    return false;
+  if (delim == '{') {
+    // the value ends at the matching brace or at the end of the element
+    size_t end = start+1;
+    for (int depth = 1; end < element.size(); ++end)
+      if (element[end] == '{')
+        ++depth;
+      else if (element[end] == '}' && !--depth)
+        break;
+    value = element.substr(start+1, end-start-1);
+  }
+  else if (delim == '"') {
+    value = element.substr(start+1);
+    value = value.substr(0, value.find_last_of('"'));
+  }
+  else
+    value = element.substr(start);
+  return true;
+}
+
+
+void Parser::get_element(const std::string &bEl_s, std::istringstream &bEl_ss,
+    std::string &tmp, bibElement &bEl) const
+{
+  bEl_ss.clear();
+  bEl_ss.str(bEl_s);
+  // field is the part before '='
+  std::getline(bEl_ss, bEl.field, '=');
+  clean_string(bEl.field);
+  // 'delim' is the first printable character that is not a space, there is
+  // none if the element contains no '='
+  std::istream::pos_type pos = bEl_ss.tellg();
+  char delim = ' ';
+  size_t start = pos == std::istream::pos_type(-1) ? bEl_s.size()
+                                                   : size_t(pos);
+  for (size_t i = start; i < bEl_s.size(); ++i) {
+    unsigned char c = bEl_s[i];
+    if ((!isspace(c)) && (isprint(c))) {
+      delim = c;
+      break;
     }
-    // value may be in {} or "" or without delimiter
+  }
+  // macros and concatenations are kept as expression, plain values may be
+  // in {} or "" or without delimiter
+  if (start < bEl_s.size() && (bEl_s.find('#', start) != std::string::npos ||
+        (delim != '{' && delim != '"' &&
+         !isdigit(static_cast<unsigned char>(delim)))) &&
+      get_expression(std::string_view(bEl_s).substr(start), bEl.value,
+        false))
+    bEl.expression = true;
+  else {
     std::getline(bEl_ss, tmp, delim);
     if (delim == '{') {
       get_block(bEl_ss, bEl.value);
@@ -178,11 +424,32 @@ std::istream& Parser::get_bibEntry(std::istream& is, bibEntry& bEn) const
       bEl_ss.unget();
       std::getline(bEl_ss, bEl.value);
     }
-    bEl.value = clean_string(bEl.value);
-    bEn.element.push_back(bEl);
-    if (last) break;
+    clean_string(bEl.value);
   }
-
-  return is;
 }
 
+
+bool Parser::get_expression(std::string_view text, std::string &expr,
+    bool simple) const
+{
+  std::string result;
+  size_t parts = 0;
+  bool has_macro = false;
+  bool valid = MacroTable::for_each_part(text,
+      [&] (std::string_view part, MacroTable::Part kind) {
+        if (parts++ > 0)
+          result += " # ";
+        if (kind != MacroTable::STRING)
+          result.append(part.data(), part.size());
+        else {
+          result += '{';
+          result.append(part.data(), part.size());
+          result += '}';
+        }
+        has_macro |= (kind == MacroTable::MACRO);
+      });
+  if (!valid || (!simple && parts == 1 && !has_macro))
+    return false;
+  expr.swap(result);
+  return true;
+}
@@ -21,35 +21,107 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <cstdint>
+#include <functional>
 #include <istream>
+#include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 // Forward declaration of user-defined types
-class bibEntry;
+struct bibElement;
+struct bibEntry;
+class CompactStore;
+class MacroTable;
 
 class Parser
 {
   public:
+    // Constructor, @string and @preamble are added to 'macros' and skipped if
+    // it is nullptr
+    Parser(MacroTable *_macros = nullptr);
+
+    // Keep only the elements whose field 'keep' returns true for, the values
+    // of all other elements are skipped without being copied or cleaned
+    void set_projection(std::function<bool(std::string_view)> _keep);
+
+    // Add one vector per parsed entry to 'hashes' with the hashes of all
+    // its elements, including the ones skipped by the projection
+    void set_hashes(std::vector<std::vector<size_t>> *_hashes);
+
+    // Hash of an element, equal for fields that differ only in case and for
+    // values that are equal after clean_string()
+    static size_t element_hash(std::string_view field, std::string_view value);
+
     // Parse the content of the stream 'is' and add it to 'bib'
     void add(std::istream &is, std::vector<bibEntry> &bib);
 
+    // Parse the content of the stream 'is' and add it to 'store'
+    void add(std::istream &is, CompactStore &store);
+
+    // Parse entries of 'is' and add them to 'bib' until at least 'max_bytes'
+    // bytes of keys and values were added, returns the number of added bytes
+    size_t add(std::istream &is, std::vector<bibEntry> &bib, size_t max_bytes);
+
+    // Mark the following entries with the source 'id', the stream they are
+    // read from starts at byte 'offset' of the source
+    void set_source(size_t id, uint64_t offset = 0);
+
+    // Byte offset in the source after the last parsed entry
+    uint64_t offset() const { return position; }
+
   private:
+    // Macros and preambles of the bibliography
+    MacroTable *macros;
+
+    // Selects the elements that are kept, all are kept if empty
+    std::function<bool(std::string_view)> keep;
+
+    // Element hashes of the parsed entries, not collected if nullptr
+    std::vector<std::vector<size_t>> *hashes;
+
+    // Source of the entries and the number of bytes read from it
+    size_t source;
+    uint64_t position;
+
+    // Returns 'str' without leading and ending white space
+    static std::string_view trim(std::string_view str);
+
     // Deletes all double spaces, leading/ending spaces and nonprintable
-    // characters in 'str'
-    std::string clean_string(std::string str) const;
+    // characters in 'str' (in place)
+    void clean_string(std::string &str) const;
 
     // Extracts characters from 'is' and stores them into 'str' until the block
     // ends. A block is denoted by '}' and the block may contain pairs of
     // parenthesis.
     std::istream& get_block(std::istream& is, std::string& str) const;
     
-    // Extracts characters from 'is' and stores them into 'str' until an
-    // unnested ',' is found, i.e. one that is not inside parenthesis.
-    std::istream& get_unnested(std::istream& is, std::string& str) const;
+    // Returns the position of the first unnested ',' in 'str' at or after
+    // 'pos', i.e. one that is not inside parenthesis, or npos.
+    size_t find_unnested(const std::string &str, size_t pos) const;
     
-    // Reads one bibtex entry from 'is' and stores it into 'bEn'
-    std::istream& get_bibEntry(std::istream& is, bibEntry& bEn) const;
+    // Reads one bibtex entry from 'is' and stores it into 'bEn', @string,
+    // @preamble and @comment are handled on the way. The bytes read are
+    // counted in 'position'.
+    std::istream& get_bibEntry(std::istream& is, bibEntry& bEn);
+
+    // Locates the value of the uncleaned element text 'element' without
+    // copying it, the delimiters are removed. Returns false if the value is
+    // an expression, which has to be parsed by get_element().
+    static bool locate_value(std::string_view element, std::string_view &value);
+
+    // Extracts the field and value of the cleaned element text 'bEl_s' into
+    // 'bEl', the streams 'bEl_ss' and 'tmp' are reused
+    void get_element(const std::string &bEl_s, std::istringstream &bEl_ss,
+        std::string &tmp, bibElement &bEl) const;
+
+    // Converts the value 'text' into an expression whose parts are joined by
+    // " # " and whose strings are enclosed in braces. Returns false if 'text'
+    // is not a valid expression or, if 'simple' is false, if it is a single
+    // string or number.
+    bool get_expression(std::string_view text, std::string &expr,
+        bool simple) const;
 };
 
 #endif
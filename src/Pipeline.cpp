@@ -0,0 +1,177 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <memory>
+#include <sstream>
+#include <thread>
+#include "Bibliography.hpp"
+#include "ChunkBuffer.hpp"
+#include "Compression.hpp"
+#include "Macros.hpp"
+#include "Parser.hpp"
+#include "Pipeline.hpp"
+
+// Size of the chunks read from the input
+static const size_t chunk_size = 1 << 16;
+
+// Largest number of entries formatted at once
+static const size_t batch_size = 512;
+
+
+Pipeline::Pipeline(std::function<void(Bibliography&)> _transform,
+    const std::vector<std::string> &_only) :
+  transform(_transform),
+  only(_only),
+  chunks(64),
+  entries(4096),
+  output(64)
+{
+}
+
+
+void Pipeline::run(const std::vector<std::string> &filenames,
+    std::ostream &os)
+{
+  std::thread reader(&Pipeline::read, this, std::cref(filenames));
+  std::thread parser(&Pipeline::parse, this);
+  std::thread formatter(&Pipeline::format, this);
+  write(os);
+  reader.join();
+  parser.join();
+  formatter.join();
+  if (filenames.empty())
+    diagnostics.locate(std::vector<std::string>(1, "-"), starts);
+  else
+    diagnostics.locate(filenames, starts);
+}
+
+
+void Pipeline::read(const std::vector<std::string> &filenames)
+{
+  std::string chunk;
+  uint64_t bytes = 0;
+  starts.clear();
+  if (filenames.empty()) {
+    starts.push_back(0);
+    // forward whatever is available, a slow producer must not hold back
+    // the entries that were already received
+    InputFile in;
+    while (in.peek() != std::char_traits<char>::eof()) {
+      chunk.resize(chunk_size);
+      chunk.resize(in.readsome(&chunk[0], chunk_size));
+      chunks.push(std::move(chunk));
+    }
+  }
+  for (const std::string &filename : filenames) {
+    InputFile bibFile(filename);
+    starts.push_back(bytes);
+    do {
+      chunk.resize(chunk_size);
+      bibFile.read(&chunk[0], chunk_size);
+      chunk.resize(bibFile.gcount());
+      bytes += chunk.size();
+      chunks.push(std::move(chunk));
+    } while (bibFile);
+  }
+  chunks.close();
+}
+
+
+void Pipeline::parse()
+{
+  ChunkBuffer buffer(chunks);
+  std::istream is(&buffer);
+  MacroTable macros;
+  Parser parser(&macros);
+  // parse one entry at a time, the definitions before it are passed on first
+  std::vector<bibEntry> parsed;
+  while (is) {
+    parser.add(is, parsed, 1);
+    item defined{macros.pending(), bibEntry()};
+    if (!defined.definitions.empty())
+      entries.push(std::move(defined));
+    for (bibEntry &bEn : parsed)
+      entries.push(item{{}, std::move(bEn)});
+    parsed.clear();
+  }
+  entries.close();
+}
+
+
+void Pipeline::format()
+{
+  // definitions of all batches, the ones not printed yet are printed before
+  // the next batch
+  std::shared_ptr<MacroTable> macros = std::make_shared<MacroTable>();
+  bool defined = false;
+  std::vector<bibEntry> batch;
+  auto flush = [&] () {
+    if (batch.empty() && !defined)
+      return;
+    // the parents of an entry may be in another batch
+    Bibliography bib;
+    bib.use_macros(macros);
+    bib.resolve_crossref(false);
+    bib.check_entries(false);
+    bib.add(batch);
+    batch.clear();
+    transform(bib);
+    std::ostringstream ss;
+    bib.print_bib(only, ss);
+    diagnostics.merge(bib.get_diagnostics());
+    output.push(ss.str());
+    defined = false;
+  };
+  // entries are checked one by one so that the batches do not change the
+  // output, definitions end the batch of the entries before them
+  auto take = [&] (item &it) {
+    if (!it.definitions.empty()) {
+      flush();
+      macros->add(it.definitions);
+      defined = true;
+    }
+    else if (check.check(it.entry, diagnostics))
+      batch.push_back(std::move(it.entry));
+  };
+  for (item it; entries.pop(it);) {
+    // take all items that are available without waiting
+    take(it);
+    while (batch.size() < batch_size && entries.try_pop(it))
+      take(it);
+    flush();
+  }
+  if (check.size() == 0)
+    diagnostics.report(Diagnostics::EMPTY_BIBLIOGRAPHY, "", "", 0, 0);
+  output.close();
+}
+
+
+void Pipeline::write(std::ostream &os)
+{
+  std::string formatted;
+  while (output.pop(formatted)) {
+    os << formatted;
+    while (output.try_pop(formatted))
+      os << formatted;
+    // flush before waiting for the next batch
+    os.flush();
+  }
+}
@@ -0,0 +1,99 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "DataStructure.hpp"
+#include "Diagnostics.hpp"
+#include "Macros.hpp"
+#include "SpscQueue.hpp"
+#include "StreamCheck.hpp"
+
+// Forward declaration of user-defined types
+class Bibliography;
+
+// Processes the input in four threads: reading raw chunks, parsing entries,
+// transforming and formatting batches of entries and writing the output.
+// Only transformations that work on single entries can be used. The @string
+// and @preamble definitions are printed before the entries read after them.
+// Redundant
+// entries and duplicate keys are checked against all entries read before, so
+// an entry is only deleted if an earlier entry contains it.
+class Pipeline
+{
+  public:
+    // Constructor, 'transform' is applied to every batch of entries before
+    // the fields in 'only' (all if empty) are printed
+    Pipeline(std::function<void(Bibliography&)> _transform,
+        const std::vector<std::string> &_only);
+
+    // Process the files 'filenames' (stdin if empty) and write to 'os'
+    void run(const std::vector<std::string> &filenames, std::ostream &os);
+
+    // Warnings about the entries of all batches
+    const Diagnostics& get_diagnostics() const { return diagnostics; }
+
+  private:
+    // Applied to every batch
+    std::function<void(Bibliography&)> transform;
+
+    // Printed fields
+    std::vector<std::string> only;
+
+    // An entry or, if not empty, the definitions read before the next entry
+    struct item
+    {
+      std::vector<MacroTable::definition> definitions;
+      bibEntry entry;
+    };
+
+    // Queues between the stages
+    SpscQueue<std::string> chunks;
+    SpscQueue<item> entries;
+    SpscQueue<std::string> output;
+
+    // Warnings of the batches, the entries are located in the concatenated
+    // input until the files start at 'starts'
+    Diagnostics diagnostics;
+    std::vector<uint64_t> starts;
+
+    // Checks all entries before they are put into batches
+    StreamCheck check;
+
+    // Reads chunks of the input files
+    void read(const std::vector<std::string> &filenames);
+
+    // Parses the chunks into entries
+    void parse();
+
+    // Transforms and formats the entries that are available
+    void format();
+
+    // Writes the formatted entries to 'os'
+    void write(std::ostream &os);
+};
+
+#endif
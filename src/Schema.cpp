@@ -0,0 +1,168 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include "Constants.hpp"
+#include "Schema.hpp"
+#include "Strings.hpp"
+
+Schema::Schema()
+{
+  // the classic BibTeX types
+  for (std::string_view type : Constants::get_types()) {
+    type_rules &t = rules(type);
+    auto add = [this] (group_list &list, const Constants::field_spec &spec) {
+      std::vector<std::string> fields;
+      for (unsigned int i = 0; i < spec.count; ++i)
+        fields.push_back(std::string(spec.alternatives[i]));
+      add_group(list, fields);
+    };
+    for (const Constants::field_spec &spec :
+        Constants::get_required_fields(type))
+      add(t.required, spec);
+    for (const Constants::field_spec &spec :
+        Constants::get_optional_fields(type))
+      add(t.optional, spec);
+  }
+}
+
+
+bool Schema::load(std::istream &is, const std::string &source)
+{
+  std::string line;
+  for (size_t n = 1; std::getline(is, line); ++n) {
+    auto error = [&] (Strings::STR message) -> bool {
+      std::cerr << Strings::tr(message) << source << ":" << n << "\n";
+      return false;
+    };
+
+    // everything after '#' is a comment, commas separate like spaces
+    line.erase(std::min(line.find('#'), line.size()));
+    std::replace(line.begin(), line.end(), ',', ' ');
+    size_t eq = line.find('=');
+    std::istringstream ss(line.substr(0, std::min(eq, line.size())));
+    std::string type, rest;
+    if (!(ss >> type) && eq == std::string::npos)
+      continue;
+    // type = required ; optional
+    if (eq == std::string::npos || type.empty() || ss >> rest)
+      return error(Strings::ERR_SCHEMA_SYNTAX);
+    std::string fields = line.substr(eq+1);
+
+    // the fields of one kind, alternatives are joined by '|' with optional
+    // spaces around it
+    auto parse = [&] (std::string_view part, group_list &list) -> bool {
+      std::istringstream ps{std::string(part)};
+      std::vector<std::string> groups;
+      for (std::string token; ps >> token;) {
+        if (!groups.empty() &&
+            (groups.back().back() == '|' || token.front() == '|'))
+          groups.back() += token;
+        else
+          groups.push_back(token);
+      }
+      for (const std::string &g : groups) {
+        std::vector<std::string> alternatives(1);
+        for (char c : g) {
+          if (c == '|')
+            alternatives.emplace_back();
+          else
+            alternatives.back() += c;
+        }
+        for (const std::string &a : alternatives)
+          if (a.empty() || a.find_first_of("=;") != std::string::npos)
+            return error(Strings::ERR_SCHEMA_SYNTAX);
+        if (!add_group(list, alternatives))
+          return error(Strings::ERR_SCHEMA_FIELDS);
+      }
+      return true;
+    };
+
+    // a type defined again replaces the previous definition
+    type_rules &t = rules(type);
+    t.required = group_list();
+    t.optional = group_list();
+    size_t semicolon = fields.find(';');
+    std::string_view all(fields);
+    if (!parse(all.substr(0, semicolon), t.required))
+      return false;
+    if (semicolon != std::string::npos &&
+        !parse(all.substr(semicolon+1), t.optional))
+      return false;
+  }
+  return true;
+}
+
+
+int Schema::field_id(std::string_view field) const
+{
+  auto it = field_index.find(field);
+  return (it == field_index.end()) ? -1 : it->second;
+}
+
+
+int Schema::intern(std::string_view field)
+{
+  auto it = field_index.find(field);
+  if (it != field_index.end())
+    return it->second;
+  if (field_names.size() == max_fields)
+    return -1;
+  field_names.push_back(std::string(field));
+  int id = field_names.size()-1;
+  field_index.emplace(field_names.back(), id);
+  return id;
+}
+
+
+Schema::type_rules& Schema::rules(std::string_view type)
+{
+  auto it = type_index.find(type);
+  if (it != type_index.end())
+    return types[it->second];
+  types.push_back(type_rules());
+  types.back().name = type;
+  type_index.emplace(types.back().name, types.size()-1);
+  return types.back();
+}
+
+
+bool Schema::add_group(group_list &list, const std::vector<std::string> &fields)
+{
+  group g;
+  for (const std::string &field : fields) {
+    int id = intern(field);
+    if (id < 0)
+      return false;
+    g.fields.set(id);
+    if (!g.name.empty())
+      g.name += ' ';
+    g.name += field;
+  }
+  if (fields.size() == 1)
+    list.single |= g.fields;
+  else
+    list.alternatives.push_back(list.groups.size());
+  list.groups.push_back(g);
+  return true;
+}
@@ -0,0 +1,140 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+#include <bitset>
+#include <deque>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "CaseFold.hpp"
+
+// Required and optional fields of the entry types, compiled into bitmasks
+// over interned field IDs. A new schema holds the classic BibTeX types,
+// schema files add types or replace them. Every line of a schema file
+// defines one type:
+//
+//   # comment
+//   article = author title journal year doi ; volume number pages month note
+//   book    = author|editor title publisher year ; volume|number series
+//
+// The fields before ';' are required, the ones after it optional. Fields are
+// separated by spaces or commas, '|' joins alternatives of which at least
+// one has to be present.
+class Schema
+{
+  public:
+    // Maximum number of distinct fields in all types
+    static const size_t max_fields = 256;
+
+    // Set of fields, bit 'i' stands for the field with ID 'i'
+    typedef std::bitset<max_fields> mask;
+
+    // Create a schema with the classic BibTeX types
+    Schema();
+
+    // Read the types defined in the schema file 'is', errors are reported
+    // with the name 'source' and the line, returns false on errors
+    bool load(std::istream &is, const std::string &source);
+
+    // ID of 'field' (case insensitive) or -1 if no type uses it
+    int field_id(std::string_view field) const;
+
+    // Calls 'report(name, required)' for every required (and optional if
+    // 'only_required' is false) field of 'type' that is not in 'present',
+    // 'name' is the field as shown to the user, e.g. "author editor"
+    template <class F>
+    void check(std::string_view type, const mask &present, bool only_required,
+        F report) const;
+
+  private:
+    // A required or optional field with all of its alternatives
+    struct group {
+      std::string name;
+      mask fields;
+    };
+
+    // The required or optional groups of a type. If all groups without
+    // alternatives are present, which is found with one AND/NOT of 'single',
+    // only the groups at 'alternatives' have to be checked.
+    struct group_list {
+      std::vector<group> groups;
+      mask single;
+      std::vector<size_t> alternatives;
+    };
+    struct type_rules {
+      std::string name;
+      group_list required;
+      group_list optional;
+    };
+
+    // Types and field names, deques keep the names referenced by the maps
+    // in place
+    std::deque<type_rules> types;
+    std::deque<std::string> field_names;
+    std::unordered_map<std::string_view, size_t, CaseFold::hasher,
+      CaseFold::equal_to> type_index;
+    std::unordered_map<std::string_view, int, CaseFold::hasher,
+      CaseFold::equal_to> field_index;
+
+    // Returns the ID of 'field', a new ID is assigned if it is unknown,
+    // returns -1 if there are 'max_fields' fields already
+    int intern(std::string_view field);
+
+    // Returns the rules of 'type', an empty rule is added if it is unknown
+    type_rules& rules(std::string_view type);
+
+    // Adds the group with the alternatives 'fields' to 'list', returns false
+    // if there are too many fields
+    bool add_group(group_list &list, const std::vector<std::string> &fields);
+};
+
+
+template <class F>
+void Schema::check(std::string_view type, const mask &present,
+    bool only_required, F report) const
+{
+  auto it = type_index.find(type);
+  if (it == type_index.end())
+    return;
+  const type_rules &t = types[it->second];
+
+  auto check_groups = [&] (const group_list &list, bool required) {
+    if ((list.single & ~present).none()) {
+      for (size_t g : list.alternatives)
+        if ((list.groups[g].fields & present).none())
+          report(std::string_view(list.groups[g].name), required);
+      return;
+    }
+    for (const group &g : list.groups)
+      if ((g.fields & present).none())
+        report(std::string_view(g.name), required);
+  };
+  check_groups(t.required, true);
+  if (!only_required)
+    check_groups(t.optional, false);
+}
+
+#endif
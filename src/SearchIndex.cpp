@@ -0,0 +1,923 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <sstream>
+#include <unordered_map>
+#include "CaseFold.hpp"
+#include "Compression.hpp"
+#include "DataStructure.hpp"
+#include "Macros.hpp"
+#include "MappedFile.hpp"
+#include "Names.hpp"
+#include "Parser.hpp"
+#include "SearchIndex.hpp"
+#include "Strings.hpp"
+
+// Layout of an index file in native byte order: the header, one entry record
+// per entry, one entry record per @string or @preamble, one trigram record
+// per trigram sorted by trigram and the posting lists. A posting list holds
+// the numbers of the entries containing the trigram as varint encoded gaps.
+static const char magic[8] = {'b', 'i', 'b', 'f', 'i', 'd', 'x', '2'};
+
+struct index_header {
+  char magic[8];
+  uint64_t size;    // size and modification time of the indexed file
+  int64_t mtime;
+  uint32_t entries;
+  uint32_t trigrams;
+  uint32_t definitions;
+  uint32_t reserved;
+};
+
+struct index_entry {
+  uint64_t offset;  // byte range of the entry in the indexed file
+  uint32_t length;
+  uint32_t trigrams;
+};
+
+struct index_trigram {
+  uint32_t trigram;
+  uint32_t count;
+  uint64_t postings;  // offset of the posting list in the index
+};
+
+static_assert(sizeof(index_header) == 40 && sizeof(index_entry) == 16 &&
+    sizeof(index_trigram) == 16, "unexpected padding in the index layout");
+
+
+// Fields that are indexed
+static bool is_indexed(std::string_view field)
+{
+  return CaseFold::equals(field, "title") ||
+    CaseFold::equals(field, "author") || CaseFold::equals(field, "abstract");
+}
+
+
+// Append 'text' to 'out' in the form that is indexed. LaTeX commands and
+// braces are removed, ASCII letters are lowercased and every run of other
+// characters except digits and non-ASCII bytes becomes a single space. The
+// result starts and ends with a space.
+static void normalize(std::string_view text, std::string &out)
+{
+  // commands that stand for letters or words
+  static const char *letters[] = {"aa", "ae", "i", "j", "l", "o", "oe", "ss",
+    "tex", "latex", "bibtex"};
+  auto separate = [&out] () {
+    if (out.empty() || out.back() != ' ')
+      out += ' ';
+  };
+  separate();
+  for (size_t i = 0; i < text.size(); ++i) {
+    unsigned char c = text[i];
+    if (c == '\\') {
+      // a command is a backslash followed by letters or by one other
+      // character, accents leave the letter they apply to
+      size_t end = i+1;
+      while (end < text.size() && std::isalpha(static_cast<unsigned char>(
+              text[end])))
+        ++end;
+      std::string_view name = text.substr(i+1, end-i-1);
+      if (name.empty())
+        ++i;
+      else {
+        for (const char *letter : letters)
+          if (CaseFold::equals(name, letter)) {
+            out += letter;
+            break;
+          }
+        i = end-1;
+      }
+    }
+    else if (c == '{' || c == '}')
+      continue;
+    else if (c >= 'A' && c <= 'Z')
+      out += char(c - 'A' + 'a');
+    else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c >= 0x80)
+      out += char(c);
+    else
+      separate();
+  }
+  separate();
+}
+
+
+// Call 'f' with every trigram of the words of the normalized 'text', which
+// starts and ends with a space. The padding of the words matches the
+// beginning and the end of words, but a trigram never spans two words.
+template <typename F>
+static void for_each_trigram(std::string_view text, F f)
+{
+  uint32_t t = 0;
+  for (size_t i = 0; i < text.size(); ++i) {
+    t = (t << 8 | static_cast<unsigned char>(text[i])) & 0xffffff;
+    if (i >= 2 && text[i-1] != ' ')
+      f(t);
+  }
+}
+
+
+// Name of the index of 'filename'
+static std::string index_name(const std::string &filename)
+{
+  return filename + ".idx";
+}
+
+
+// Returns the byte range 'e' of 'file'
+static std::string read_range(std::istream &file, const index_entry &e)
+{
+  file.clear();
+  file.seekg(e.offset);
+  std::string text(e.length, '\0');
+  file.read(&text[0], e.length);
+  text.resize(file.gcount());
+  return text;
+}
+
+
+SearchIndex::SearchIndex()
+{
+}
+
+
+SearchIndex::~SearchIndex()
+{
+  for (const mapped &m : indexes)
+    unmap_file(m.data, m.size);
+}
+
+
+bool SearchIndex::build(const std::string &filename)
+{
+  index_header h;
+  {
+    InputFile in(filename);
+    if (!in || in.compression() != Compression::NONE ||
+        !file_stamp(filename, h.size, h.mtime)) {
+      std::cerr << Strings::tr(Strings::ERR_INDEX_INPUT) << filename << "\n";
+      return false;
+    }
+  }
+  size_t size = 0;
+  const char *data = map_file(filename, size);
+  std::string_view content(data, data ? size : 0);
+
+  // posting lists of all trigrams, the entries are added in order and
+  // 'slots' holds the position of the list of a trigram plus one
+  struct postings {
+    uint32_t trigram;
+    uint32_t last;
+    uint32_t count;
+    std::string gaps;
+  };
+  std::vector<postings> lists;
+  std::vector<uint32_t> slots(1 << 24, 0);
+  std::vector<index_entry> entries;
+  std::vector<index_entry> definitions;
+
+  // same rules as the parser: an entry starts with '@' and ends with the
+  // '}' that closes the first '{', @string and @comment contain no entry
+  MacroTable macros;
+  Parser parser(&macros);
+  parser.set_projection(is_indexed);
+  std::vector<bibEntry> parsed;
+  std::istringstream is;
+  std::string text;
+  for (size_t pos = content.find('@'); pos != std::string_view::npos;
+      pos = content.find('@', pos)) {
+    size_t begin = pos, end = content.size();
+    size_t open = content.find('{', begin);
+    if (open != std::string_view::npos) {
+      int depth = 1;
+      for (size_t i = open+1; i < content.size(); ++i) {
+        if (content[i] == '{')
+          ++depth;
+        else if (content[i] == '}' && --depth == 0) {
+          end = i+1;
+          break;
+        }
+      }
+    }
+    pos = end;
+    parsed.clear();
+    is.clear();
+    is.str(std::string(content.substr(begin, end-begin)));
+    parser.add(is, parsed);
+    // the definitions are printed with the hits of a search
+    if (!macros.pending().empty())
+      definitions.push_back(index_entry{begin, uint32_t(end-begin), 0});
+    if (parsed.empty())
+      continue;
+    text.clear();
+    for (const bibElement &bEl : parsed.front().element)
+      normalize(bEl.value, text);
+    uint32_t number = entries.size();
+    uint32_t distinct = 0;
+    for_each_trigram(text, [&] (uint32_t t) {
+      if (!slots[t]) {
+        lists.push_back(postings{t, 0, 0, std::string()});
+        slots[t] = lists.size();
+      }
+      postings &p = lists[slots[t]-1];
+      // a trigram is added once per entry
+      if (p.count > 0 && p.last == number)
+        return;
+      for (uint32_t gap = number - p.last; ; gap >>= 7) {
+        if (gap < 0x80) {
+          p.gaps += char(gap);
+          break;
+        }
+        p.gaps += char((gap & 0x7f) | 0x80);
+      }
+      p.last = number;
+      ++p.count;
+      ++distinct;
+    });
+    entries.push_back(index_entry{begin, uint32_t(end-begin), distinct});
+  }
+  if (data)
+    unmap_file(data, size);
+
+  // trigram table in sorted order, the posting lists follow it
+  std::sort(lists.begin(), lists.end(),
+      [] (const postings &a, const postings &b) -> bool {
+        return a.trigram < b.trigram;
+      });
+  std::vector<index_trigram> table;
+  table.reserve(lists.size());
+  for (const postings &p : lists)
+    table.push_back(index_trigram{p.trigram, p.count, 0});
+  uint64_t offset = sizeof(index_header) +
+    (entries.size() + definitions.size())*sizeof(index_entry) +
+    table.size()*sizeof(index_trigram);
+  for (size_t i = 0; i < table.size(); ++i) {
+    table[i].postings = offset;
+    offset += lists[i].gaps.size();
+  }
+
+  std::memcpy(h.magic, magic, sizeof(magic));
+  h.entries = entries.size();
+  h.trigrams = table.size();
+  h.definitions = definitions.size();
+  h.reserved = 0;
+  std::ofstream out(index_name(filename), std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+  out.write(reinterpret_cast<const char*>(entries.data()),
+      entries.size()*sizeof(index_entry));
+  out.write(reinterpret_cast<const char*>(definitions.data()),
+      definitions.size()*sizeof(index_entry));
+  out.write(reinterpret_cast<const char*>(table.data()),
+      table.size()*sizeof(index_trigram));
+  for (const postings &p : lists)
+    out.write(p.gaps.data(), p.gaps.size());
+  out.close();
+  if (!out) {
+    std::cerr << Strings::tr(Strings::ERR_INDEX_WRITE)
+      << index_name(filename) << "\n";
+    return false;
+  }
+  return true;
+}
+
+
+bool SearchIndex::open(const std::vector<std::string> &filenames)
+{
+  for (const std::string &filename : filenames) {
+    mapped m{filename, nullptr, 0};
+    m.data = map_file(index_name(filename), m.size);
+    if (m.data)
+      indexes.push_back(m);
+    const index_header *h = reinterpret_cast<const index_header*>(m.data);
+    if (!m.data || m.size < sizeof(index_header) ||
+        std::memcmp(h->magic, magic, sizeof(magic)) != 0 ||
+        m.size < sizeof(index_header) +
+        (uint64_t(h->entries) + h->definitions)*sizeof(index_entry) +
+        uint64_t(h->trigrams)*sizeof(index_trigram)) {
+      std::cerr << Strings::tr(Strings::ERR_INDEX_READ) << filename << "\n";
+      return false;
+    }
+    // the byte ranges of the entries are only valid for the indexed file
+    uint64_t size;
+    int64_t mtime;
+    if (!file_stamp(filename, size, mtime) || size != h->size ||
+        mtime != h->mtime) {
+      std::cerr << Strings::tr(Strings::ERR_INDEX_OUTDATED) << filename
+        << "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+
+bool SearchIndex::valid_query(std::string_view query)
+{
+  std::string normalized;
+  normalize(query, normalized);
+  return normalized.size() - std::count(normalized.begin(), normalized.end(),
+      ' ') >= 3;
+}
+
+
+std::vector<std::string> SearchIndex::search(std::string_view query,
+    size_t max_hits) const
+{
+  std::string normalized;
+  normalize(query, normalized);
+  std::vector<uint32_t> query_trigrams;
+  for_each_trigram(normalized, [&query_trigrams] (uint32_t t) {
+    query_trigrams.push_back(t);
+  });
+  std::sort(query_trigrams.begin(), query_trigrams.end());
+  query_trigrams.erase(std::unique(query_trigrams.begin(),
+        query_trigrams.end()), query_trigrams.end());
+  std::vector<std::string> result;
+  if (query_trigrams.empty())
+    return result;
+
+  // a swap of two letters changes up to three trigrams of a word, a third
+  // of the trigrams still finds words with one such typo
+  std::vector<hit> hits;
+  for (size_t file = 0; file < indexes.size(); ++file)
+    search(file, query_trigrams, (query_trigrams.size()+2)/3, hits);
+
+  // higher scores first, among equal scores the entries that contain fewer
+  // other words
+  auto better = [] (const hit &a, const hit &b) -> bool {
+    if (a.score != b.score)
+      return a.score > b.score;
+    if (a.trigrams != b.trigrams)
+      return a.trigrams < b.trigrams;
+    if (a.file != b.file)
+      return a.file < b.file;
+    return a.entry < b.entry;
+  };
+  if (hits.size() > max_hits) {
+    std::partial_sort(hits.begin(), hits.begin()+max_hits, hits.end(),
+        better);
+    hits.resize(max_hits);
+  }
+  else
+    std::sort(hits.begin(), hits.end(), better);
+
+  // only the matching entries are read from the files
+  for (const hit &ht : hits) {
+    const mapped &m = indexes[ht.file];
+    const index_entry *entries = reinterpret_cast<const index_entry*>(
+        m.data + sizeof(index_header));
+    std::ifstream file(m.name, std::ios::binary);
+    result.push_back(read_range(file, entries[ht.entry]));
+  }
+  return result;
+}
+
+
+std::vector<std::string> SearchIndex::definitions() const
+{
+  std::vector<std::string> result;
+  for (const mapped &m : indexes) {
+    const index_header *h = reinterpret_cast<const index_header*>(m.data);
+    const index_entry *definitions = reinterpret_cast<const index_entry*>(
+        m.data + sizeof(index_header)) + h->entries;
+    std::ifstream file(m.name, std::ios::binary);
+    for (uint32_t i = 0; i < h->definitions; ++i)
+      result.push_back(read_range(file, definitions[i]));
+  }
+  return result;
+}
+
+
+void SearchIndex::search(size_t file, const std::vector<uint32_t> &query,
+    uint32_t min_count, std::vector<hit> &hits) const
+{
+  const mapped &m = indexes[file];
+  const index_header *h = reinterpret_cast<const index_header*>(m.data);
+  const index_entry *entries = reinterpret_cast<const index_entry*>(
+      m.data + sizeof(index_header));
+  const index_trigram *table = reinterpret_cast<const index_trigram*>(
+      m.data + sizeof(index_header) +
+      (uint64_t(h->entries) + h->definitions)*sizeof(index_entry));
+  const index_trigram *table_end = table + h->trigrams;
+
+  // count the query trigrams of every entry by walking the posting lists,
+  // rare trigrams weigh more than common ones
+  std::vector<uint32_t> counts(h->entries, 0);
+  std::vector<float> weights(h->entries, 0);
+  for (uint32_t t : query) {
+    const index_trigram *r = std::lower_bound(table, table_end, t,
+        [] (const index_trigram &r, uint32_t t) -> bool {
+          return r.trigram < t;
+        });
+    if (r == table_end || r->trigram != t)
+      continue;
+    const unsigned char *p = reinterpret_cast<const unsigned char*>(
+        m.data + r->postings);
+    const unsigned char *p_end = reinterpret_cast<const unsigned char*>(
+        m.data + m.size);
+    float weight = std::log((h->entries + 1.0) / r->count);
+    uint32_t number = 0;
+    for (uint32_t i = 0; i < r->count && p < p_end; ++i) {
+      uint32_t gap = 0;
+      for (int shift = 0; p < p_end; shift += 7) {
+        gap |= uint32_t(*p & 0x7f) << shift;
+        if (!(*p++ & 0x80))
+          break;
+      }
+      number += gap;
+      if (number < h->entries) {
+        ++counts[number];
+        weights[number] += weight;
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < h->entries; ++i)
+    if (counts[i] >= min_count)
+      hits.push_back(hit{weights[i], entries[i].trigrams, file, i});
+}
+
+
+// Layout of a completion index in native byte order: the header, the trie
+// nodes, the completions and the pool of their texts. The texts of a kind are
+// sorted case insensitively. The children of a node are consecutive and
+// sorted by the first byte of their label, the label is a part of the text of
+// the first completion below the child.
+static const char completion_magic[8] = {'b', 'i', 'b', 'f', 'c', 'p', 'l',
+  '2'};
+
+struct completion_header {
+  char magic[8];
+  uint64_t size;    // size and modification time of the indexed file
+  int64_t mtime;
+  uint32_t nodes;
+  uint32_t completions;
+  uint32_t roots[CompletionIndex::KINDS];
+  uint32_t pool;    // size of the text pool
+};
+
+struct completion_node {
+  uint32_t label;       // offset of the label in the text pool
+  uint32_t child;       // number of the first child
+  uint32_t best;        // highest frequency of a completion below the node
+  uint32_t completion;  // number of the completion ending here plus one
+  uint16_t length;      // length of the label
+  uint16_t children;
+};
+
+struct completion_text {
+  uint32_t text;        // offset of the text in the text pool
+  uint32_t length;
+  uint32_t count;       // frequency in the indexed file
+};
+
+static_assert(sizeof(completion_header) == 48 &&
+    sizeof(completion_node) == 20 && sizeof(completion_text) == 12,
+    "unexpected padding in the completion index layout");
+
+// Longer texts are not completed
+static const size_t max_text = 255;
+
+
+// Fields that are completed
+static bool is_completed(std::string_view field)
+{
+  return CaseFold::equals(field, "author") ||
+    CaseFold::equals(field, "editor") || CaseFold::equals(field, "journal") ||
+    CaseFold::equals(field, "journaltitle");
+}
+
+
+// Name of the completion index of 'filename'
+static std::string completion_name(const std::string &filename)
+{
+  return filename + ".cpl";
+}
+
+
+// Returns 'n' in the form "von Last, Jr, First" or an empty string for
+// "others" and names without last name
+static std::string name_text(const bibName &n)
+{
+  if (n.last.empty() || CaseFold::equals(n.last, "others"))
+    return "";
+  std::string text = n.von.empty() ? n.last : n.von + ' ' + n.last;
+  if (!n.jr.empty())
+    text += ", " + n.jr;
+  if (!n.first.empty())
+    text += ", " + n.first;
+  return text;
+}
+
+
+// Builds the path compressed trie of the completions of one kind
+struct trie_builder {
+  std::vector<completion_node> &nodes;
+  const std::vector<completion_text> &completions;
+  const std::string &pool;
+
+  std::string_view text(uint32_t i) const
+  {
+    return std::string_view(pool).substr(completions[i].text,
+        completions[i].length);
+  }
+
+  // Fill the node 'n' whose prefix has 'depth' bytes with the completions
+  // [lo, hi), which all start with the prefix. Returns the highest frequency.
+  uint32_t fill(uint32_t n, uint32_t lo, uint32_t hi, size_t depth)
+  {
+    uint32_t best = 0;
+    if (lo < hi && text(lo).size() == depth) {
+      nodes[n].completion = lo+1;
+      best = completions[lo].count;
+      ++lo;
+    }
+    // one child per first byte after the prefix
+    std::vector<uint32_t> starts;
+    for (uint32_t i = lo; i < hi; ++i)
+      if (i == lo || CaseFold::to_lower(text(i)[depth]) !=
+          CaseFold::to_lower(text(i-1)[depth]))
+        starts.push_back(i);
+    starts.push_back(hi);
+    uint32_t first = nodes.size();
+    nodes[n].child = first;
+    nodes[n].children = starts.size()-1;
+    nodes.resize(first + starts.size()-1, completion_node{0, 0, 0, 0, 0, 0});
+    for (size_t c = 0; c+1 < starts.size(); ++c) {
+      // the label ends where the first and the last text of the child differ
+      std::string_view a = text(starts[c]), b = text(starts[c+1]-1);
+      size_t end = depth+1;
+      while (end < a.size() && end < b.size() &&
+          CaseFold::to_lower(a[end]) == CaseFold::to_lower(b[end]))
+        ++end;
+      nodes[first+c].label = completions[starts[c]].text + depth;
+      nodes[first+c].length = end - depth;
+      best = std::max(best, fill(first+c, starts[c], starts[c+1], end));
+    }
+    nodes[n].best = best;
+    return best;
+  }
+};
+
+
+// Finds the completions of a prefix in one completion index, the most
+// frequent first, by a best first search: a node is expanded when no
+// completion found so far and no other node can be more frequent. The texts
+// are stored in sorted order, so the position of a text or label in the pool
+// orders equal frequencies alphabetically.
+struct trie_search {
+  CompletionIndex::Kind kind;
+  const completion_header *h;
+  const completion_node *nodes;
+  const completion_text *completions;
+  std::string_view pool;
+
+  struct candidate {
+    uint32_t count;
+    uint32_t position;
+    bool found;
+    uint32_t number;
+  };
+  std::vector<candidate> heap;
+
+  static bool worse(const candidate &a, const candidate &b)
+  {
+    if (a.count != b.count)
+      return a.count < b.count;
+    return a.position > b.position;
+  }
+
+  trie_search(const char *data, CompletionIndex::Kind _kind,
+      std::string_view prefix) :
+    kind(_kind),
+    h(reinterpret_cast<const completion_header*>(data)),
+    nodes(reinterpret_cast<const completion_node*>(
+          data + sizeof(completion_header))),
+    completions(reinterpret_cast<const completion_text*>(nodes + h->nodes)),
+    pool(reinterpret_cast<const char*>(completions + h->completions),
+        h->pool)
+  {
+    bool inside;
+    uint32_t n = find(prefix, inside);
+    if (n != h->nodes)
+      heap.push_back(candidate{nodes[n].best, nodes[n].label, false, n});
+  }
+
+  // Every node that is visited is checked, the index may be corrupt
+  bool valid(uint32_t n) const
+  {
+    if (n >= h->nodes)
+      return false;
+    const completion_node &node = nodes[n];
+    return uint64_t(node.label) + node.length <= h->pool &&
+      uint64_t(node.child) + node.children <= h->nodes &&
+      node.completion <= h->completions;
+  }
+
+  // Returns the node below which all completions start with 'prefix' or
+  // the number of nodes if there is none. The prefix may end inside the
+  // label of the node, then 'inside' is set.
+  uint32_t find(std::string_view prefix, bool &inside) const
+  {
+    inside = false;
+    uint32_t n = h->roots[kind];
+    if (!valid(n))
+      return h->nodes;
+    while (!prefix.empty()) {
+      const completion_node &node = nodes[n];
+      const completion_node *first = nodes + node.child;
+      const completion_node *last = first + node.children;
+      char c = CaseFold::to_lower(prefix.front());
+      const completion_node *child = std::lower_bound(first, last, c,
+          [this] (const completion_node &a, char c) -> bool {
+            return a.label < pool.size() &&
+              static_cast<unsigned char>(CaseFold::to_lower(pool[a.label])) <
+              static_cast<unsigned char>(c);
+          });
+      if (child == last || !valid(child - nodes) || child->length == 0)
+        return h->nodes;
+      std::string_view label = pool.substr(child->label, child->length);
+      size_t len = std::min(label.size(), prefix.size());
+      if (!CaseFold::equals(label.substr(0, len), prefix.substr(0, len)))
+        return h->nodes;
+      inside = len < label.size();
+      prefix.remove_prefix(len);
+      n = child - nodes;
+    }
+    return n;
+  }
+
+  // Highest frequency of the completions that were not returned yet
+  uint32_t bound() const
+  {
+    return heap.empty() ? 0 : heap.front().count;
+  }
+
+  // Returns false if there is no further completion, sets 'text' and
+  // 'count' to the next one otherwise
+  bool next(std::string_view &text, uint32_t &count)
+  {
+    while (!heap.empty()) {
+      std::pop_heap(heap.begin(), heap.end(), worse);
+      candidate c = heap.back();
+      heap.pop_back();
+      if (c.found) {
+        const completion_text &t = completions[c.number];
+        if (uint64_t(t.text) + t.length > h->pool)
+          continue;
+        text = pool.substr(t.text, t.length);
+        count = t.count;
+        return true;
+      }
+      const completion_node &node = nodes[c.number];
+      if (node.completion) {
+        const completion_text &t = completions[node.completion-1];
+        heap.push_back(candidate{t.count, t.text, true, node.completion-1});
+        std::push_heap(heap.begin(), heap.end(), worse);
+      }
+      for (uint32_t i = node.child; i < node.child + node.children; ++i) {
+        if (!valid(i))
+          continue;
+        heap.push_back(candidate{nodes[i].best, nodes[i].label, false, i});
+        std::push_heap(heap.begin(), heap.end(), worse);
+      }
+    }
+    return false;
+  }
+
+  // Returns the frequency of 'text' (case insensitive), 0 if it is not a
+  // completion
+  uint32_t count(std::string_view text) const
+  {
+    bool inside;
+    uint32_t n = find(text, inside);
+    if (n == h->nodes || inside || !nodes[n].completion)
+      return 0;
+    return completions[nodes[n].completion-1].count;
+  }
+};
+
+CompletionIndex::CompletionIndex()
+{
+}
+
+
+CompletionIndex::~CompletionIndex()
+{
+  for (const mapped &m : indexes)
+    unmap_file(m.data, m.size);
+}
+
+
+bool CompletionIndex::build(const std::string &filename)
+{
+  completion_header h;
+  InputFile in(filename);
+  if (!in || !file_stamp(filename, h.size, h.mtime)) {
+    std::cerr << Strings::tr(Strings::ERR_INDEX_INPUT) << filename << "\n";
+    return false;
+  }
+
+  // frequency of every text of every kind
+  std::vector<std::unordered_map<std::string, uint32_t>> counts(KINDS);
+  auto add = [&counts] (Kind kind, std::string text) {
+    if (!text.empty() && text.size() <= max_text)
+      ++counts[kind][std::move(text)];
+  };
+  // journal = j1 is indexed as the name the macro stands for, values with
+  // undefined macros are skipped
+  MacroTable macros;
+  Parser parser(&macros);
+  parser.set_projection(is_completed);
+  std::vector<bibEntry> parsed;
+  std::string expanded;
+  while (in) {
+    parser.add(in, parsed, 1);
+    for (const bibEntry &bEn : parsed) {
+      add(KEY, bEn.key);
+      for (const bibElement &bEl : bEn.element) {
+        std::string_view value = bEl.value;
+        if (bEl.expression) {
+          if (!macros.expand(value, expanded))
+            continue;
+          value = expanded;
+        }
+        if (CaseFold::equals(bEl.field, "author") ||
+            CaseFold::equals(bEl.field, "editor"))
+          for (const bibName &n : NameCache::parse(value))
+            add(AUTHOR, name_text(n));
+        else
+          add(JOURNAL, std::string(value));
+      }
+    }
+    parsed.clear();
+  }
+
+  // texts that differ only in case are one completion with the most
+  // frequent spelling
+  std::vector<completion_text> completions;
+  std::vector<completion_node> nodes;
+  std::string pool;
+  for (int kind = 0; kind < KINDS; ++kind) {
+    std::vector<std::pair<std::string, uint32_t>> texts(
+        counts[kind].begin(), counts[kind].end());
+    counts[kind].clear();
+    std::sort(texts.begin(), texts.end(),
+        [] (const std::pair<std::string, uint32_t> &a,
+          const std::pair<std::string, uint32_t> &b) -> bool {
+          int c = CaseFold::compare(a.first, b.first);
+          if (c != 0)
+            return c < 0;
+          if (a.second != b.second)
+            return a.second > b.second;
+          return a.first < b.first;
+        });
+    uint32_t lo = completions.size();
+    for (size_t i = 0; i < texts.size(); ++i) {
+      if (i > 0 && CaseFold::equals(texts[i].first, texts[i-1].first)) {
+        completions.back().count += texts[i].second;
+        continue;
+      }
+      completions.push_back(completion_text{uint32_t(pool.size()),
+          uint32_t(texts[i].first.size()), texts[i].second});
+      pool += texts[i].first;
+    }
+    h.roots[kind] = nodes.size();
+    nodes.push_back(completion_node{0, 0, 0, 0, 0, 0});
+    trie_builder builder{nodes, completions, pool};
+    builder.fill(h.roots[kind], lo, completions.size(), 0);
+  }
+
+  std::memcpy(h.magic, completion_magic, sizeof(completion_magic));
+  h.nodes = nodes.size();
+  h.completions = completions.size();
+  h.pool = pool.size();
+  std::ofstream out(completion_name(filename), std::ios::binary);
+  out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+  out.write(reinterpret_cast<const char*>(nodes.data()),
+      nodes.size()*sizeof(completion_node));
+  out.write(reinterpret_cast<const char*>(completions.data()),
+      completions.size()*sizeof(completion_text));
+  out.write(pool.data(), pool.size());
+  out.close();
+  if (!out) {
+    std::cerr << Strings::tr(Strings::ERR_INDEX_WRITE)
+      << completion_name(filename) << "\n";
+    return false;
+  }
+  return true;
+}
+
+
+bool CompletionIndex::open(const std::vector<std::string> &filenames)
+{
+  for (const std::string &filename : filenames) {
+    mapped m{nullptr, 0};
+    m.data = map_file(completion_name(filename), m.size);
+    if (m.data)
+      indexes.push_back(m);
+    const completion_header *h =
+      reinterpret_cast<const completion_header*>(m.data);
+    if (!m.data || m.size < sizeof(completion_header) ||
+        std::memcmp(h->magic, completion_magic,
+          sizeof(completion_magic)) != 0 ||
+        m.size != sizeof(completion_header) +
+        uint64_t(h->nodes)*sizeof(completion_node) +
+        uint64_t(h->completions)*sizeof(completion_text) + h->pool) {
+      std::cerr << Strings::tr(Strings::ERR_INDEX_READ) << filename << "\n";
+      return false;
+    }
+    // the completions are only valid for the indexed file
+    uint64_t size;
+    int64_t mtime;
+    if (!file_stamp(filename, size, mtime) || size != h->size ||
+        mtime != h->mtime) {
+      std::cerr << Strings::tr(Strings::ERR_INDEX_OUTDATED) << filename
+        << "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+
+std::vector<std::string> CompletionIndex::complete(Kind kind,
+    std::string_view prefix, size_t max_hits) const
+{
+  std::vector<std::string> result;
+  if (max_hits == 0)
+    return result;
+
+  // the completions of every index come in the order of their frequency in
+  // that index. The index with the highest remaining frequency goes next,
+  // and the frequencies of a new text in all indexes are added. No text
+  // that was not found yet can be more frequent than the sum of the
+  // remaining frequencies of all indexes.
+  std::vector<trie_search> searches;
+  for (const mapped &m : indexes)
+    searches.emplace_back(m.data, kind, prefix);
+  std::unordered_map<std::string_view, uint32_t, CaseFold::hasher,
+    CaseFold::equal_to> totals;
+  std::vector<hit> hits;
+  // the 'max_hits' highest frequencies found so far, the lowest first
+  std::priority_queue<uint32_t, std::vector<uint32_t>,
+    std::greater<uint32_t>> top;
+  while (true) {
+    uint64_t remaining = 0;
+    trie_search *next = nullptr;
+    for (trie_search &s : searches) {
+      remaining += s.bound();
+      if (s.bound() > 0 && (!next || s.bound() > next->bound()))
+        next = &s;
+    }
+    if (!next || (top.size() == max_hits && top.top() >= remaining))
+      break;
+    std::string_view text;
+    uint32_t count;
+    if (!next->next(text, count) || totals.count(text))
+      continue;
+    uint32_t total = 0;
+    for (const trie_search &s : searches)
+      total += s.count(text);
+    totals.emplace(text, total);
+    hits.push_back(hit{text, total});
+    top.push(total);
+    if (top.size() > max_hits)
+      top.pop();
+  }
+
+  // most frequent first, equal frequencies in alphabetical order
+  std::sort(hits.begin(), hits.end(), [] (const hit &a, const hit &b) {
+        if (a.count != b.count)
+          return a.count > b.count;
+        return CaseFold::compare(a.text, b.text) < 0;
+      });
+  for (size_t i = 0; i < hits.size() && i < max_hits; ++i)
+    result.emplace_back(hits[i].text);
+  return result;
+}
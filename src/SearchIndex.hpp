@@ -0,0 +1,137 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Trigram index of the titles, authors and abstracts of BibTeX files. The
+// index of a file is written next to it as <file>.idx. A search maps the
+// indexes into memory and reads only the matching entries from the files.
+class SearchIndex
+{
+  public:
+    // Constructor
+    SearchIndex();
+
+    // Destructor, unmaps the indexes
+    ~SearchIndex();
+
+    // Write the index of 'filename' to 'filename'.idx, returns false on errors
+    static bool build(const std::string &filename);
+
+    // Map the indexes of 'filenames', returns false if one is missing or out
+    // of date
+    bool open(const std::vector<std::string> &filenames);
+
+    // True if 'query' has at least 3 letters or digits, shorter queries
+    // match too many entries to be ranked
+    static bool valid_query(std::string_view query);
+
+    // Returns the text of at most 'max_hits' entries that contain at least a
+    // third of the trigrams of 'query', the best matches first. Every shared
+    // trigram counts with a weight that is higher the fewer entries have it.
+    std::vector<std::string> search(std::string_view query,
+        size_t max_hits) const;
+
+    // Returns the text of the @string and @preamble definitions of all
+    // indexed files in order
+    std::vector<std::string> definitions() const;
+
+  private:
+    // Index of one file mapped into memory
+    struct mapped {
+      std::string name;
+      const char *data;
+      size_t size;
+    };
+
+    // An entry sharing trigrams with the query
+    struct hit {
+      float score;        // sum of the weights of the query trigrams
+      uint32_t trigrams;  // number of trigrams in the entry
+      size_t file;        // position of the index in 'indexes'
+      uint32_t entry;     // number of the entry in the index
+    };
+
+    std::vector<mapped> indexes;
+
+    // Add the entries of the index 'file' that contain at least 'min_count'
+    // of the trigrams in 'query' to 'hits'
+    void search(size_t file, const std::vector<uint32_t> &query,
+        uint32_t min_count, std::vector<hit> &hits) const;
+};
+
+// Prefix completion of the keys, authors and journals of BibTeX files. The
+// index of a file is a path compressed trie written next to it as
+// <file>.cpl. Every node knows the highest frequency below it, so the most
+// frequent completions are found without visiting the whole subtree.
+class CompletionIndex
+{
+  public:
+    // What is completed
+    enum Kind {
+      KEY,
+      AUTHOR,   // names of authors and editors as "von Last, Jr, First"
+      JOURNAL,
+      KINDS
+    };
+
+    // Constructor
+    CompletionIndex();
+
+    // Destructor, unmaps the indexes
+    ~CompletionIndex();
+
+    // Write the index of 'filename' to 'filename'.cpl, returns false on errors
+    static bool build(const std::string &filename);
+
+    // Map the indexes of 'filenames', returns false if one is missing or out
+    // of date
+    bool open(const std::vector<std::string> &filenames);
+
+    // Returns at most 'max_hits' completions of 'prefix' (case insensitive),
+    // the most frequent in all indexes together first
+    std::vector<std::string> complete(Kind kind, std::string_view prefix,
+        size_t max_hits) const;
+
+  private:
+    // Index of one file mapped into memory
+    struct mapped {
+      const char *data;
+      size_t size;
+    };
+
+    // A completion and its frequency
+    struct hit {
+      std::string_view text;
+      uint32_t count;
+    };
+
+    std::vector<mapped> indexes;
+};
+
+#endif
@@ -0,0 +1,275 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include "Bibliography.hpp"
+#include "CaseFold.hpp"
+#include "Compression.hpp"
+#include "Macros.hpp"
+#include "Parser.hpp"
+#include "Strings.hpp"
+#include "Splitter.hpp"
+
+// Largest number of entries formatted at once
+static const size_t batch_size = 512;
+
+// Largest number of writer threads
+static const size_t max_writers = 8;
+
+// Largest number of files a writer keeps open, the least recently used one
+// is closed and opened again for appending when it is needed
+static const size_t max_open = 64;
+
+// Longest partition name used in a file name
+static const size_t max_name = 64;
+
+
+Splitter::Splitter(std::function<void(Bibliography&)> _transform,
+    const std::vector<std::string> &_only, const std::string &_pattern) :
+  transform(_transform),
+  only(_only),
+  pattern(_pattern),
+  by_type(true),
+  buckets(0)
+{
+}
+
+
+bool Splitter::set_scheme(const std::string &scheme)
+{
+  by_type = (scheme == "type");
+  field.clear();
+  buckets = 0;
+  if (by_type)
+    return true;
+  if (scheme == "year")
+    field = "year";
+  else if (scheme.compare(0, 6, "field:") == 0)
+    field = scheme.substr(6);
+  else if (scheme.compare(0, 5, "hash:") == 0) {
+    const char *begin = scheme.c_str()+5;
+    char *end;
+    unsigned long n = std::strtoul(begin, &end, 10);
+    if (end == begin || *end || n == 0 || n > 65536)
+      return false;
+    buckets = n;
+    return true;
+  }
+  return !field.empty();
+}
+
+
+bool Splitter::run(const std::vector<std::string> &filenames)
+{
+  size_t count = std::max<size_t>(1,
+      std::min<size_t>(std::thread::hardware_concurrency(), max_writers));
+  writers = std::vector<writer>(count);
+  for (writer &w : writers)
+    w.thread = std::thread(&Splitter::write, this, std::ref(w));
+
+  // parse one entry at a time, check it against all entries before it and
+  // route it to its partition, the entries are located in the concatenated
+  // input
+  MacroTable macros;
+  Parser parser(&macros);
+  std::vector<uint64_t> starts;
+  std::vector<bibEntry> parsed;
+  auto split = [&] (std::istream &is) {
+    while (is) {
+      parser.add(is, parsed, 1);
+      std::vector<MacroTable::definition> defined = macros.pending();
+      if (!defined.empty()) {
+        // the entries read before are sent without the new definitions
+        for (route &r : routes)
+          if (!r.pending.empty())
+            send(r);
+        definitions.insert(definitions.end(), defined.begin(),
+            defined.end());
+      }
+      for (bibEntry &bEn : parsed)
+        if (check.check(bEn, diagnostics))
+          add(bEn);
+      parsed.clear();
+    }
+  };
+  if (filenames.empty()) {
+    starts.push_back(0);
+    InputFile in;
+    split(in);
+  }
+  for (const std::string &filename : filenames) {
+    InputFile bibFile(filename);
+    starts.push_back(parser.offset());
+    split(bibFile);
+  }
+
+  for (route &r : routes)
+    if (!r.pending.empty())
+      send(r);
+  if (check.size() == 0)
+    diagnostics.report(Diagnostics::EMPTY_BIBLIOGRAPHY, "", "", 0, 0);
+  bool ok = true;
+  for (writer &w : writers) {
+    w.batches.close();
+    w.thread.join();
+    ok &= !w.failed;
+    diagnostics.merge(w.diagnostics);
+  }
+  if (filenames.empty())
+    diagnostics.locate(std::vector<std::string>(1, "-"), starts);
+  else
+    diagnostics.locate(filenames, starts);
+  return ok;
+}
+
+
+std::string Splitter::partition_name(const bibEntry &bEn) const
+{
+  if (buckets)
+    return std::to_string(CaseFold::hash(bEn.key) % buckets);
+  std::string_view value;
+  if (by_type)
+    value = bEn.type;
+  else
+    for (const bibElement &bEl : bEn.element)
+      if (CaseFold::equals(bEl.field, field)) {
+        value = bEl.value;
+        break;
+      }
+  // only characters that are safe in file names are kept, the name is in
+  // lower case so that partitions do not differ by case only
+  std::string name;
+  for (char c : value.substr(0, max_name)) {
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9') || c == '-' || (c == '.' && !name.empty()))
+      name += CaseFold::to_lower(c);
+    else if (name.empty() || name.back() != '_')
+      name += '_';
+  }
+  return name.empty() ? "none" : name;
+}
+
+
+void Splitter::add(bibEntry &bEn)
+{
+  std::string name = partition_name(bEn);
+  auto found = partitions.find(name);
+  if (found == partitions.end()) {
+    // new partitions are assigned to the writers in turn
+    route r;
+    r.writer = routes.size() % writers.size();
+    r.partition = routes.size() / writers.size();
+    r.pending.push_back(std::move(bEn));
+    routes.push_back(std::move(r));
+    partitions.emplace(name, routes.size()-1);
+    // the file name is sent with the first batch
+    std::string filename = pattern;
+    size_t pos = filename.find("{}");
+    filename.replace(pos, 2, name);
+    send(routes.back(), filename);
+    return;
+  }
+  route &r = routes[found->second];
+  r.pending.push_back(std::move(bEn));
+  if (r.pending.size() >= batch_size)
+    send(r);
+}
+
+
+void Splitter::send(route &r, std::string filename)
+{
+  batch b;
+  b.partition = r.partition;
+  b.filename = std::move(filename);
+  b.definitions.assign(definitions.begin()+r.defined, definitions.end());
+  r.defined = definitions.size();
+  b.entries.swap(r.pending);
+  writers[r.writer].batches.push(std::move(b));
+}
+
+
+void Splitter::write(writer &w)
+{
+  // the files of the partitions, their names (empty if they could not be
+  // opened), the number of the last batch written to them and the
+  // partitions whose files are open
+  std::vector<OutputFile*> files;
+  std::vector<std::string> names;
+  std::vector<size_t> used;
+  std::vector<size_t> opened;
+  size_t count = 0;
+  std::vector<std::shared_ptr<MacroTable>> macros;
+  for (batch b; w.batches.pop(b);) {
+    if (!b.filename.empty()) {
+      std::filesystem::path parent =
+        std::filesystem::path(b.filename).parent_path();
+      std::error_code ec;
+      if (!parent.empty())
+        std::filesystem::create_directories(parent, ec);
+      files.push_back(new OutputFile);
+      names.push_back(b.filename);
+      used.push_back(0);
+      macros.push_back(std::make_shared<MacroTable>());
+    }
+    size_t p = b.partition;
+    OutputFile &file = *files[p];
+    if (!file.is_open()) {
+      if (names[p].empty())
+        continue;
+      if (opened.size() >= max_open) {
+        auto lru = std::min_element(opened.begin(), opened.end(),
+            [&used] (size_t p1, size_t p2) -> bool {
+              return used[p1] < used[p2];
+            });
+        files[*lru]->close();
+        *lru = opened.back();
+        opened.pop_back();
+      }
+      // only the first batch truncates the file
+      file.open(names[p], b.filename.empty());
+      if (!file.is_open()) {
+        std::cerr << Strings::tr(Strings::ERR_SPLIT_WRITE) << names[p]
+          << "\n";
+        w.failed = true;
+        names[p].clear();
+        continue;
+      }
+      opened.push_back(p);
+    }
+    used[p] = ++count;
+    // the new definitions are printed before the entries
+    macros[b.partition]->add(b.definitions);
+    Bibliography bib;
+    bib.use_macros(macros[b.partition]);
+    bib.resolve_crossref(false);
+    bib.check_entries(false);
+    bib.add(b.entries);
+    transform(bib);
+    bib.print_bib(only, file);
+    w.diagnostics.merge(bib.get_diagnostics());
+  }
+  for (OutputFile *file : files)
+    delete file;
+}
@@ -0,0 +1,137 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SPLITTER_H
+#define SPLITTER_H
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "DataStructure.hpp"
+#include "Diagnostics.hpp"
+#include "Macros.hpp"
+#include "SpscQueue.hpp"
+#include "StreamCheck.hpp"
+
+// Forward declaration of user-defined types
+class Bibliography;
+
+// Writes every entry to the file of its partition. The input is parsed and
+// routed once, the partitions are transformed, formatted and written by
+// concurrent writers. Every partition belongs to one writer, so its entries
+// keep the order of the input. Entries are checked for redundancy and
+// duplicate keys across all partitions before they are routed. Only
+// transformations that work on single entries can be used. Every partition file starts with the @string and
+// @preamble definitions read before its entries.
+class Splitter
+{
+  public:
+    // Constructor, 'transform' is applied to every batch of entries before
+    // the fields in 'only' (all if empty) are printed. The file of a
+    // partition is 'pattern' with "{}" replaced by the partition name.
+    Splitter(std::function<void(Bibliography&)> _transform,
+        const std::vector<std::string> &_only, const std::string &_pattern);
+
+    // Set the partitions: 'type', 'year', 'field:X' (the value of field X)
+    // or 'hash:N' (N partitions by the hash of the key), returns false if
+    // 'scheme' is invalid
+    bool set_scheme(const std::string &scheme);
+
+    // Split the files 'filenames' (stdin if empty), returns false if a
+    // partition could not be written
+    bool run(const std::vector<std::string> &filenames);
+
+    // Warnings about the entries of all partitions
+    const Diagnostics& get_diagnostics() const { return diagnostics; }
+
+  private:
+    // Entries of one partition that are formatted together and the
+    // definitions read before them that were not sent to the partition yet,
+    // the file name is only set in the first batch of a partition
+    struct batch {
+      size_t partition;
+      std::string filename;
+      std::vector<MacroTable::definition> definitions;
+      std::vector<bibEntry> entries;
+    };
+
+    // Formats and writes the partitions it owns in its own thread
+    struct writer {
+      SpscQueue<batch> batches{64};
+      std::thread thread;
+      bool failed = false;
+      Diagnostics diagnostics;
+    };
+
+    // Partition as seen by the router: its writer, its index among the
+    // partitions of the writer, the entries not yet sent and the number of
+    // definitions sent
+    struct route {
+      size_t writer;
+      size_t partition;
+      std::vector<bibEntry> pending;
+      size_t defined = 0;
+    };
+
+    // Applied to every batch
+    std::function<void(Bibliography&)> transform;
+
+    // Printed fields
+    std::vector<std::string> only;
+
+    // Output file names
+    std::string pattern;
+
+    // Partition by type, by the value of 'field' or, if 'buckets' is not 0,
+    // by the hash of the key into 'buckets' partitions
+    bool by_type;
+    std::string field;
+    size_t buckets;
+
+    std::vector<writer> writers;
+    std::vector<route> routes;
+    std::unordered_map<std::string, size_t> partitions;
+
+    // Definitions read so far
+    std::vector<MacroTable::definition> definitions;
+
+    // Redundancy and key checks of all entries, before they are routed
+    StreamCheck check;
+
+    // Warnings of the checks and of the writers
+    Diagnostics diagnostics;
+
+    // Returns the name of the partition of 'bEn'
+    std::string partition_name(const bibEntry &bEn) const;
+
+    // Add 'bEn' to the pending entries of its partition
+    void add(bibEntry &bEn);
+
+    // Send the pending entries of 'r' to its writer
+    void send(route &r, std::string filename = "");
+
+    // Format and write the batches of 'w'
+    void write(writer &w);
+};
+
+#endif
@@ -0,0 +1,112 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// push() waits while the queue is full, which slows down the producer to the
+// speed of the consumer.
+template <class T>
+class SpscQueue
+{
+  public:
+    // Constructor, 'capacity' is rounded up to a power of two
+    SpscQueue(size_t capacity) : slots(round_up(capacity)),
+      mask(slots.size()-1), head(0), tail(0), closed(false) {}
+
+    // Append 'item', waits while the queue is full
+    void push(T item)
+    {
+      size_t t = tail.load(std::memory_order_relaxed);
+      for (unsigned int spins = 0;
+          t - head.load(std::memory_order_acquire) == slots.size();)
+        wait(spins);
+      slots[t & mask] = std::move(item);
+      tail.store(t+1, std::memory_order_release);
+    }
+
+    // Remove the first item and store it in 'item' if the queue is not
+    // empty, returns false otherwise
+    bool try_pop(T &item)
+    {
+      size_t h = head.load(std::memory_order_relaxed);
+      if (h == tail.load(std::memory_order_acquire))
+        return false;
+      item = std::move(slots[h & mask]);
+      head.store(h+1, std::memory_order_release);
+      return true;
+    }
+
+    // Remove the first item and store it in 'item', waits while the queue is
+    // empty. Returns false if the queue is empty and closed.
+    bool pop(T &item)
+    {
+      for (unsigned int spins = 0; !try_pop(item); wait(spins)) {
+        // items pushed before close() are visible after reading 'closed'
+        if (closed.load(std::memory_order_acquire))
+          return try_pop(item);
+      }
+      return true;
+    }
+
+    // Called by the producer after the last push()
+    void close() { closed.store(true, std::memory_order_release); }
+
+  private:
+    // Ring buffer of items
+    std::vector<T> slots;
+    size_t mask;
+
+    // Positions of the next pop() and push(), only increased. Each is
+    // written by one thread, they are kept on separate cache lines.
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+
+    // Set when no more items will be pushed
+    std::atomic<bool> closed;
+
+    // Returns the smallest power of two that is not less than 'n'
+    static size_t round_up(size_t n)
+    {
+      size_t p = 1;
+      while (p < n)
+        p *= 2;
+      return p;
+    }
+
+    // Spin shortly, then give the processor to other threads
+    static void wait(unsigned int &spins)
+    {
+      if (++spins < 64)
+        std::this_thread::yield();
+      else
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+};
+
+#endif
@@ -0,0 +1,152 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <functional>
+#include "CaseFold.hpp"
+#include "DataStructure.hpp"
+#include "Diagnostics.hpp"
+#include "StreamCheck.hpp"
+
+
+bool StreamCheck::check(const bibEntry &bEn, Diagnostics &diagnostics)
+{
+  // elements are compared by hashes of the lower case field and the value,
+  // like delete_redundant_entries() of the bibliography does
+  uint64_t type = CaseFold::hash(bEn.type);
+  std::vector<uint64_t> hashes;
+  hashes.reserve(bEn.element.size());
+  for (const bibElement &bEl : bEn.element)
+    hashes.push_back(CaseFold::hash(bEl.field) * 31 +
+        std::hash<std::string>()(bEl.value));
+  std::sort(hashes.begin(), hashes.end());
+  if (contained(type, hashes)) {
+    diagnostics.report(Diagnostics::REDUNDANT_ENTRY, bEn.key, "",
+        bEn.source, bEn.offset);
+    return false;
+  }
+
+  uint32_t id = types.size();
+  types.push_back(type);
+  ++type_count.insert(type).count;
+  for (uint64_t h : hashes) {
+    elements.push_back(h);
+    slot &sl = element_index.insert(h);
+    if (sl.count > 0 && postings[sl.last].first == id)
+      continue;
+    postings.emplace_back(id, sl.last);
+    sl.last = postings.size()-1;
+    ++sl.count;
+  }
+  first.push_back(elements.size());
+
+  if (bEn.key.empty()) {
+    std::string_view title;
+    for (const bibElement &bEl : bEn.element)
+      if (CaseFold::equals(bEl.field, "title")) {
+        title = bEl.value;
+        break;
+      }
+    diagnostics.report(Diagnostics::EMPTY_KEY, "", title, bEn.source,
+        bEn.offset);
+  }
+  // every definition of a duplicate key is reported, the first one when the
+  // second is found
+  slot &key = keys.insert(std::hash<std::string>()(bEn.key));
+  if (++key.count == 1) {
+    key.last = locations.size();
+    locations.emplace_back(bEn.source, bEn.offset);
+    return true;
+  }
+  if (key.count == 2)
+    diagnostics.report(Diagnostics::DUPLICATE_KEY, bEn.key, "",
+        locations[key.last].first, locations[key.last].second);
+  diagnostics.report(Diagnostics::DUPLICATE_KEY, bEn.key, "", bEn.source,
+      bEn.offset);
+  return true;
+}
+
+
+bool StreamCheck::contained(uint64_t type,
+    const std::vector<uint64_t> &hashes) const
+{
+  // entries without elements are redundant if the type was used before
+  if (hashes.empty())
+    return type_count.find(type) != nullptr;
+  // candidates are the entries that share the least common element
+  const slot *candidates = nullptr;
+  for (uint64_t h : hashes) {
+    const slot *sl = element_index.find(h);
+    if (!sl)
+      return false;
+    if (!candidates || sl->count < candidates->count)
+      candidates = sl;
+  }
+  uint32_t p = candidates->last;
+  for (uint32_t k = 0; k < candidates->count; ++k, p = postings[p].second) {
+    uint32_t c = postings[p].first;
+    if (types[c] != type || first[c+1] - first[c] < hashes.size())
+      continue;
+    if (std::includes(elements.begin() + first[c],
+          elements.begin() + first[c+1], hashes.begin(), hashes.end()))
+      return true;
+  }
+  return false;
+}
+
+
+StreamCheck::slot& StreamCheck::table::insert(uint64_t hash)
+{
+  hash += (hash == 0);
+  // grow at a load factor of 1/2
+  if (2*(used+1) > slots.size()) {
+    std::vector<slot> old(2*slots.size());
+    old.swap(slots);
+    for (const slot &sl : old)
+      if (sl.hash)
+        slots[position(sl.hash)] = sl;
+  }
+  slot &sl = slots[position(hash)];
+  if (!sl.hash) {
+    sl = slot{hash, 0, 0};
+    ++used;
+  }
+  return sl;
+}
+
+
+const StreamCheck::slot* StreamCheck::table::find(uint64_t hash) const
+{
+  hash += (hash == 0);
+  const slot &sl = slots[position(hash)];
+  return sl.hash ? &sl : nullptr;
+}
+
+
+size_t StreamCheck::table::position(uint64_t hash) const
+{
+  // the high bits of the mixed hash select the slot, linear probing
+  size_t mask = slots.size()-1;
+  size_t i = (hash * 0x9e3779b97f4a7c15ULL) >> 32 & mask;
+  while (slots[i].hash && slots[i].hash != hash)
+    i = (i+1) & mask;
+  return i;
+}
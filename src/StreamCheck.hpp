@@ -0,0 +1,98 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef STREAMCHECK_H
+#define STREAMCHECK_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Forward declaration of user-defined types
+class bibEntry;
+class Diagnostics;
+
+// Consistency checks of entries that are seen one at a time in the order of
+// the input, used by the modes that process the input in batches. Every
+// entry is checked against all entries before it, so the result does not
+// depend on how the entries are grouped into batches.
+class StreamCheck
+{
+  public:
+    // Check 'bEn' for an empty or duplicate key and report to 'diagnostics'.
+    // Returns false if the entry is redundant, i.e. its type and elements
+    // are contained in an earlier entry, which is reported as well.
+    bool check(const bibEntry &bEn, Diagnostics &diagnostics);
+
+    // Number of entries that were checked and not redundant
+    size_t size() const { return types.size(); }
+
+  private:
+    // Entry of 'table' for the 64 bit hash 'hash' (0 if unused): the number
+    // of times it was added and the last element of 'postings' added for it
+    struct slot {
+      uint64_t hash;
+      uint32_t count;
+      uint32_t last;
+    };
+
+    // Open addressing hash table of slots, no slot is ever removed
+    class table
+    {
+      public:
+        // Returns the slot of 'hash', which is added if it is not found
+        slot& insert(uint64_t hash);
+
+        // Returns the slot of 'hash' or nullptr
+        const slot* find(uint64_t hash) const;
+
+      private:
+        std::vector<slot> slots{std::vector<slot>(1024)};
+        size_t used = 0;
+
+        // Returns the index of the slot of 'hash' or of an unused slot
+        size_t position(uint64_t hash) const;
+    };
+
+    // Keys seen so far, the source and offset of the first definition of a
+    // key are at the 'last' of its slot in 'locations'
+    table keys;
+    std::vector<std::pair<size_t, uint64_t>> locations;
+
+    // Hash of the type and the sorted element hashes of every kept entry,
+    // the elements of entry i are elements[first[i]] to elements[first[i+1]]
+    std::vector<uint64_t> types;
+    std::vector<uint64_t> elements;
+    std::vector<size_t> first{0};
+
+    // Kept entries that contain an element as linked lists in 'postings',
+    // each posting is the entry and the previous posting of the element
+    table element_index;
+    std::vector<std::pair<uint32_t, uint32_t>> postings;
+
+    // Number of kept entries with each type
+    table type_count;
+
+    // True if an earlier entry of type 'type' contains the sorted 'hashes'
+    bool contained(uint64_t type, const std::vector<uint64_t> &hashes) const;
+};
+
+#endif
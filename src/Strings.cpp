@@ -18,25 +18,24 @@
  *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cstdlib>
 #include "Strings.hpp"
 
 // program version
-const std::string Strings::version = "0.1.10";
+#define VERSION "0.1.10"
 
-// Standard value of current_lang
-Strings::LANG Strings::current_lang = Strings::LANG_EN;
-
-const std::unordered_map<std::string, Strings::LANG> Strings::lang_map {
-  {"en", Strings::LANG_EN},
-  {"de", Strings::LANG_DE}
-};
+// Language is taken from the environment at the first translation
+Strings::LANG Strings::current_lang = Strings::LANG_CNT;
 
 // English
-const std::array<std::string, Strings::STR_CNT> Strings::en {{
+const std::array<const char*, Strings::STR_CNT> Strings::en {{
   "Usage: bibf [OPTION]... [FILE]...",
-  "print to file instead of cout",
+  "print to file instead of cout; files ending in .gz or .zst are"
+    " compressed",
   "create keys using last name of first author plus last"
     " two digits of the year plus [a,b,c...]",
+  "scheme of the keys created by --create-keys, e.g. {author1:last}{year};"
+    " letters are only added to keys that occur more than once",
   "print only the given fields;"
     " different fields must be separated by commas",
   "sort the bibliography by the given citeria; valid values are 'type',"
@@ -56,11 +55,62 @@ const std::array<std::string, Strings::STR_CNT> Strings::en {{
   "set field delimiter, valid values are { or \"",
   "use left instead of right alignment",
   "try to find the correct abbreviation of the month",
+  "abbreviate journal and booktitle values using the dictionary in the given"
+    " file, one \"Full Name;Abbrev.\" per line",
   "interactively create a new BibTeX entry",
+  "print clusters of probable duplicates with a similarity of at least the"
+    " given threshold (default 0.8) using DOI, eprint, normalized titles and"
+    " authors",
+  "join entries with the same DOI or key across all input files; valid"
+    " policies are 'first', 'newest' (newest file wins) and 'union' (union of"
+    " all fields, first value wins)",
+  "write the conflicts found by --merge to a file instead of cerr",
+  "keep the bibliography in a compact representation to reduce the memory"
+    " usage for large files",
+  "sort in batches that use about the given amount of memory in MB; the"
+    " sorted batches are written to temporary files and merged; then an"
+    " entry is only deleted as redundant if an earlier entry contains it",
+  "read, parse, transform and print the entries in concurrent threads;"
+    " not possible with actions that need the whole bibliography; an entry"
+    " is only deleted as redundant if an earlier entry contains it",
+  "watch the input files and print the output again after every change;"
+    " only changed entries are processed again; an entry is only deleted as"
+    " redundant if an earlier entry contains it",
+  "write the entries as JSON Lines (jsonl) or tab separated values (tsv)"
+    " while reading; --only selects the fields or the columns (default"
+    " author,title,year)",
+  "copy the fields inherited through crossref into the entries and remove"
+    " the crossref fields",
+  "print the values of the @string macros instead of the macros and leave"
+    " out the @string definitions",
+  "load required and optional fields of entry types from a schema file;"
+    " can be given more than once",
+  "apply the edits (rename, set, replace, erase) of a script file to every"
+    " entry; can be given more than once",
+  "write a trigram index of the titles, authors and abstracts of every input"
+    " file to <file>.idx for --search and a completion index to <file>.cpl"
+    " for --complete",
+  "print the entries of the input files that match the query of at least 3"
+    " letters or digits best, using the index written by --build-index",
+  "print the most frequent keys, authors or journals (key, author, journal)"
+    " that start with the first input argument, using the index written by"
+    " --build-index",
+  "print the added, removed and modified entries and fields of the second"
+    " input file compared with the first; entries are joined by key or DOI",
+  "output format of --diff, text or jsonl (one JSON object per changed"
+    " entry)",
+  "write every entry to the file of its partition: type, year, field:X (the"
+    " value of field X) or hash:N (N partitions by key); the partition"
+    " replaces {} in --output, which is a directory otherwise (default"
+    " {}.bib)",
+  "write all warnings with the keys and byte offsets of their entries as"
+    " JSON report to the given file",
+  "print at most the given number of different warnings of each kind"
+    ", 0 prints all",
   "display this help and exit",
   "output version information and exit",
   "BibTeX files for input",
-  "bibf " + version + " Copyright (C) 2014 Dennis Dast\n\n"
+  "bibf " VERSION " Copyright (C) 2014 Dennis Dast\n\n"
     "This program comes with ABSOLUTELY NO WARRANTY.\n"
     "This is free software, and you are welcome to redistribute it"
     " under certain conditions.\n",
@@ -75,15 +125,20 @@ const std::array<std::string, Strings::STR_CNT> Strings::en {{
   "\nAdd user-defined fields (use empty input to exit):\n",
   " and ",
   " are alternatives\n",
+  "Duplicate cluster ",
+  " entries",
+  " added, ",
+  " removed, ",
+  " modified\n",
+  "... and ",
+  " more\n",
+  "Warnings: ",
   "Malformed option '--change-case', valid options"
     " are one or two characters.\n",
   "Illegal field delimiter: ",
   "Author field is empty",
   "Warning: Key \"",
   "\" defined more than once\n",
-  "Bibliography::create_keys(): Author ",
-  " has more than 26 entries in the year ",
-  ". Ran out of identifiers for creating the keys.",
   "Bibliography::change_case : case_t must be 'U', 'L' or 'S' but is ",
   "Bibliography::change_case : case_f must be 'U', 'L' or 'S' but is ",
   "Warning: set_field_delimiter called with illegal "
@@ -94,15 +149,52 @@ const std::array<std::string, Strings::STR_CNT> Strings::en {{
   "Bibliography is empty\n",
   "Entry with key \"",
   "\" was deleted (redundant entry)\n",
-  "Warning: Empty key in entry with title: \""
+  "Warning: Empty key in entry with title: \"",
+  "Unknown merge policy: ",
+  "Could not create a temporary file\n",
+  "Corrupt or truncated compressed file: ",
+  "bibf was built without zstd support, cannot handle: ",
+  "Could not watch the input files: ",
+  "--watch needs input files and cannot be combined with actions that"
+    " need the whole bibliography or with --expand-macros\n",
+  "Unknown export format: ",
+  "\" refers to an unknown crossref entry \"",
+  "\" is part of a crossref cycle\n",
+  "Syntax error in schema file ",
+  "Too many different fields in schema file ",
+  "Cannot open schema file ",
+  "Syntax error in edit script ",
+  "Cannot open edit script ",
+  "Cannot write index file ",
+  "Cannot read the index of ",
+  "Index is out of date, run --build-index again: ",
+  "Cannot index the compressed or unreadable file ",
+  "The search query needs at least 3 letters or digits: ",
+  "Invalid key template: ",
+  "--diff needs exactly two input files\n",
+  "Cannot open input file ",
+  "Unknown diff format: ",
+  "Invalid partition scheme: ",
+  "--split-by cannot be combined with sorting or actions that need the"
+    " whole bibliography\n",
+  "Cannot write partition file ",
+  "Unknown completion kind: ",
+  "--complete needs a prefix and input files\n",
+  "Cannot read the journal abbreviations in ",
+  "Cannot write the diagnostics report ",
+  "Cannot write the output file "
 }};
 
 // German
-const std::array<std::string, Strings::STR_CNT> Strings::de {{
+const std::array<const char*, Strings::STR_CNT> Strings::de {{
   "Verwendung: bibf [OPTION]... [DATEI]...",
-  "schreibe in Datei anstatt auf cout",
+  "schreibe in Datei anstatt auf cout; Dateien mit der Endung .gz oder"
+    " .zst werden komprimiert",
   "erstelle Schlüssel aus dem Nachnamen des ersten Autors plus den letzten"
     " zwei Stellen des Jahres plus [a,b,c...]",
+  "Schema der von --create-keys erzeugten Schlüssel, z.B."
+    " {author1:last}{year}; Buchstaben werden nur an mehrfach vorkommende"
+    " Schlüssel angehängt",
   "gebe nur die angegeben Felder aus;"
     " mehrere Felder werden durch Kommas getrennt",
   "sortiere die Bibliothek nach den angegebenen Kriterien; mögliche Werte sind"
@@ -126,11 +218,67 @@ const std::array<std::string, Strings::STR_CNT> Strings::de {{
   "legt Feldtrenner fest, mögliche Werte sind { oder \"",
   "versucht die korrekte Abkürzung für den Monat zu finden",
   "verwende linke statt rechte Ausrichtung",
+  "kürze Zeitschriften und Buchtitel mit dem Wörterbuch in der angegebenen"
+    " Datei ab, eine Zeile \"Voller Name;Abk.\" pro Eintrag",
   "erzeuge interaktiv einen neuen BibTeX Eintrag",
+  "zeige Gruppen wahrscheinlicher Duplikate mit einer Ähnlichkeit von"
+    " mindestens dem angegebenen Schwellwert (Standard 0.8) anhand von DOI,"
+    " eprint, normalisierten Titeln und Autoren",
+  "verbinde Einträge mit gleicher DOI oder gleichem Schlüssel aus allen"
+    " Eingabedateien; mögliche Strategien sind 'first', 'newest' (neueste Datei"
+    " gewinnt) und 'union' (alle Felder, der erste Wert gewinnt)",
+  "schreibe die von --merge gefundenen Konflikte in eine Datei anstatt auf"
+    " cerr",
+  "halte das Literaturverzeichnis in einer kompakten Darstellung um den"
+    " Speicherverbrauch bei großen Dateien zu reduzieren",
+  "sortiere in Teilen, die etwa die angegebene Menge an Speicher in MB"
+    " verwenden; die sortierten Teile werden in temporäre Dateien geschrieben"
+    " und zusammengeführt; dann wird ein Eintrag nur als redundant gelöscht,"
+    " wenn ein früherer Eintrag ihn enthält",
+  "lese, verarbeite und schreibe die Einträge in parallelen Threads;"
+    " nicht möglich mit Aktionen, die das ganze Literaturverzeichnis"
+    " benötigen; ein Eintrag wird nur als redundant gelöscht, wenn ein"
+    " früherer Eintrag ihn enthält",
+  "beobachte die Eingabedateien und gib die Ausgabe nach jeder Änderung"
+    " erneut aus; nur geänderte Einträge werden neu verarbeitet; ein Eintrag"
+    " wird nur als redundant gelöscht, wenn ein früherer Eintrag ihn enthält",
+  "schreibe die Einträge beim Lesen als JSON Lines (jsonl) oder durch"
+    " Tabulatoren getrennte Werte (tsv); --only wählt die Felder oder die"
+    " Spalten (Standard author,title,year)",
+  "kopiere die über crossref geerbten Felder in die Einträge und entferne"
+    " die crossref Felder",
+  "gib die Werte der @string Makros anstatt der Makros aus und lasse die"
+    " @string Definitionen weg",
+  "lade die benötigten und optionalen Felder der Eintragstypen aus einer"
+    " Schemadatei; kann mehrfach angegeben werden",
+  "wende die Änderungen (rename, set, replace, erase) einer Skriptdatei auf"
+    " jeden Eintrag an; kann mehrfach angegeben werden",
+  "schreibe einen Trigramm-Index der Titel, Autoren und Zusammenfassungen"
+    " jeder Eingabedatei nach <Datei>.idx für --search und einen Index zur"
+    " Vervollständigung nach <Datei>.cpl für --complete",
+  "gib die Einträge der Eingabedateien aus, die am besten zur Anfrage aus"
+    " mindestens 3 Buchstaben oder Ziffern passen, mit Hilfe des von"
+    " --build-index geschriebenen Index",
+  "gib die häufigsten Schlüssel, Autoren oder Zeitschriften (key, author,"
+    " journal) aus, die mit dem ersten Eingabeargument beginnen, mit Hilfe"
+    " des von --build-index geschriebenen Index",
+  "gib die hinzugefügten, entfernten und geänderten Einträge und Felder der"
+    " zweiten Eingabedatei im Vergleich zur ersten aus; Einträge werden über"
+    " Schlüssel oder DOI zugeordnet",
+  "Ausgabeformat von --diff, text oder jsonl (ein JSON-Objekt pro"
+    " geändertem Eintrag)",
+  "schreibe jeden Eintrag in die Datei seiner Partition: type, year,"
+    " field:X (der Wert des Feldes X) oder hash:N (N Partitionen nach"
+    " Schlüssel); die Partition ersetzt {} in --output, das sonst ein"
+    " Verzeichnis ist (Standard {}.bib)",
+  "schreibe alle Warnungen mit den Schlüsseln und Byte-Positionen ihrer"
+    " Einträge als JSON-Bericht in die angegebene Datei",
+  "gib höchstens die angegebene Zahl verschiedener Warnungen jeder Art aus"
+    ", 0 gibt alle aus",
   "zeige diese Hilfe an",
   "zeige Versionsinformationen an",
   "BibTeX Dateien zum Einlesen",
-  "bibf " + version + " Copyright (C) 2014 Dennis Dast\n\n"
+  "bibf " VERSION " Copyright (C) 2014 Dennis Dast\n\n"
     "This program comes with ABSOLUTELY NO WARRANTY.\n"
     "This is free software, and you are welcome to redistribute it"
     " under certain conditions.\n",
@@ -145,15 +293,20 @@ const std::array<std::string, Strings::STR_CNT> Strings::de {{
   "\nFüge benutzerdefinierte Felder hinzu (leere Eingabe bricht ab):\n",
   " und ",
   " sind Alternativen\n",
+  "Duplikatgruppe ",
+  " Einträge",
+  " hinzugefügt, ",
+  " entfernt, ",
+  " geändert\n",
+  "... und ",
+  " weitere\n",
+  "Warnungen: ",
   "Unbekannte Option für '--change-case', mögliche Werte sind ein oder zwei"
     " Zifferns.\n",
   "Nicht erlaubtes Zeichen für Feldtrennung: ",
   "Feld 'author' ist leer",
   "Warnung: Schlüssel \"",
   "\" mehr als einmal definiert\n",
-  "Bibliography::create_keys(): Autor ",
-  " hat mehr als 26 Einträge im Jahr ",
-  ". Keine eindeutige Schlüsselerzeugung möglich.",
   "Bibliography::change_case : case_t muss 'U', 'L' oder 'S' sein, aber ist ",
   "Bibliography::change_case : case_f muss 'U', 'L' oder 'S' sein, aber ist ",
   "Warnung: set_field_delimiter mit unerlaubtem Zeichen als Feldbeginnzeichen"
@@ -164,22 +317,71 @@ const std::array<std::string, Strings::STR_CNT> Strings::de {{
   "Bibliothek ist leer\n",
   "Eintrag mit Schlüssel \"",
   "\" wurde gelöscht (redundanter Eintrag)\n",
-  "Warnung: Leerer Schlüssel im Eintrag mit Titel: \""
+  "Warnung: Leerer Schlüssel im Eintrag mit Titel: \"",
+  "Unbekannte Strategie zum Zusammenführen: ",
+  "Konnte keine temporäre Datei erstellen\n",
+  "Beschädigte oder unvollständige komprimierte Datei: ",
+  "bibf wurde ohne Unterstützung für zstd erstellt, kann nicht verarbeitet werden: ",
+  "Konnte die Eingabedateien nicht beobachten: ",
+  "--watch benötigt Eingabedateien und kann nicht mit Aktionen kombiniert"
+    " werden, die das ganze Literaturverzeichnis benötigen, oder mit"
+    " --expand-macros\n",
+  "Unbekanntes Exportformat: ",
+  "\" verweist auf einen unbekannten crossref Eintrag \"",
+  "\" ist Teil eines crossref Zyklus\n",
+  "Syntaxfehler in der Schemadatei ",
+  "Zu viele verschiedene Felder in der Schemadatei ",
+  "Die Schemadatei kann nicht geöffnet werden: ",
+  "Syntaxfehler im Änderungsskript ",
+  "Das Änderungsskript kann nicht geöffnet werden: ",
+  "Die Indexdatei kann nicht geschrieben werden: ",
+  "Der Index kann nicht gelesen werden: ",
+  "Der Index ist veraltet, --build-index erneut ausführen: ",
+  "Die komprimierte oder unlesbare Datei kann nicht indiziert werden: ",
+  "Die Suchanfrage benötigt mindestens 3 Buchstaben oder Ziffern: ",
+  "Ungültige Schlüsselvorlage: ",
+  "--diff benötigt genau zwei Eingabedateien\n",
+  "Eingabedatei kann nicht geöffnet werden: ",
+  "Unbekanntes Vergleichsformat: ",
+  "Ungültige Partitionierung: ",
+  "--split-by kann nicht mit Sortieren oder Aktionen kombiniert werden, die"
+    " die ganze Bibliographie benötigen\n",
+  "Partitionsdatei kann nicht geschrieben werden: ",
+  "Unbekannte Art der Vervollständigung: ",
+  "--complete benötigt ein Präfix und Eingabedateien\n",
+  "Die Zeitschriftenabkürzungen können nicht gelesen werden: ",
+  "Der Diagnosebericht kann nicht geschrieben werden: ",
+  "Die Ausgabedatei kann nicht geschrieben werden: "
 }};
 
-const std::array<std::array<std::string, Strings::STR_CNT>, Strings::LANG_CNT>
-    Strings::langs {{
-  Strings::en,
-  Strings::de
+const std::array<const std::array<const char*, Strings::STR_CNT>*,
+    Strings::LANG_CNT> Strings::langs {{
+  &Strings::en,
+  &Strings::de
 }};
 
-void Strings::set_locale(std::string lang)
+void Strings::set_locale(std::string_view lang)
 {
   // if lang is unknown use english
-  try {
-    current_lang = lang_map.at(lang);
-  }
-  catch(std::out_of_range& e) {
+  if (lang == "de")
+    current_lang = LANG_DE;
+  else
     current_lang = LANG_EN;
+}
+
+Strings::LANG Strings::language()
+{
+  if (current_lang != LANG_CNT)
+    return current_lang;
+  // the first of LC_ALL, LC_MESSAGES and LANG that is set decides, the
+  // language is the part before '_' as in de_DE.UTF-8
+  const char *lang = nullptr;
+  for (const char *name : {"LC_ALL", "LC_MESSAGES", "LANG"}) {
+    lang = std::getenv(name);
+    if (lang && *lang)
+      break;
   }
+  std::string_view value = lang ? lang : "";
+  set_locale(value.substr(0, value.find_first_of("_.")));
+  return current_lang;
 }
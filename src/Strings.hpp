@@ -22,8 +22,7 @@
 #define STRINGS_H
 
 #include <array>
-#include <string>
-#include <unordered_map>
+#include <string_view>
 
 class Strings
 {
@@ -33,6 +32,7 @@ class Strings
       OPT_USAGE,
       OPT_OUTPUT,
       OPT_CREATE,
+      OPT_KEY_TEMPLATE,
       OPT_ONLY,
       OPT_SORT_BIB,
       OPT_SORT_ELEMENTS,
@@ -45,7 +45,28 @@ class Strings
       OPT_DELIMITER,
       OPT_ALIGN_LEFT,
       OPT_ABBREV_MONTH,
+      OPT_ABBREV_JOURNAL,
       OPT_NEW_ENTRY,
+      OPT_FIND_DUPLICATES,
+      OPT_MERGE,
+      OPT_MERGE_REPORT,
+      OPT_COMPACT,
+      OPT_MAX_MEMORY,
+      OPT_PIPELINE,
+      OPT_WATCH,
+      OPT_EXPORT,
+      OPT_INLINE_CROSSREF,
+      OPT_EXPAND_MACROS,
+      OPT_SCHEMA,
+      OPT_EDIT,
+      OPT_BUILD_INDEX,
+      OPT_SEARCH,
+      OPT_COMPLETE,
+      OPT_DIFF,
+      OPT_DIFF_FORMAT,
+      OPT_SPLIT_BY,
+      OPT_DIAGNOSTICS,
+      OPT_MAX_WARNINGS,
       OPT_HELP,
       OPT_VERSION,
       OPT_INPUT,
@@ -61,14 +82,19 @@ class Strings
       OUT_CREATE_ENTRY_ARB,
       OUT_CREATE_ENTRY_ALT1,
       OUT_CREATE_ENTRY_ALT2,
+      OUT_DUPLICATE_CLUSTER,
+      OUT_DUPLICATE_ENTRIES,
+      OUT_DIFF_ADDED,
+      OUT_DIFF_REMOVED,
+      OUT_DIFF_MODIFIED,
+      OUT_DIAGNOSTICS_MORE_1,
+      OUT_DIAGNOSTICS_MORE_2,
+      OUT_DIAGNOSTICS_SUMMARY,
       ERR_CHANGE_CASE,
       ERR_DELIMITER,
       ERR_EMPTY_AUTHOR,
       ERR_DOUBLE_KEY_1,
       ERR_DOUBLE_KEY_2,
-      ERR_RAN_OUT_OF_IDS_1,
-      ERR_RAN_OUT_OF_IDS_2,
-      ERR_RAN_OUT_OF_IDS_3,
       ERR_UNKNOWN_CHANGE_CASE_T,
       ERR_UNKNOWN_CHANGE_CASE_F,
       ERR_ILLEGAL_FIELD_DELIMITER_BEG,
@@ -78,14 +104,45 @@ class Strings
       ERR_REDUNDANT_ENTRY_1,
       ERR_REDUNDANT_ENTRY_2,
       ERR_EMPTY_KEY,
+      ERR_UNKNOWN_MERGE_POLICY,
+      ERR_TEMPORARY_FILE,
+      ERR_DECOMPRESS,
+      ERR_NO_ZSTD,
+      ERR_WATCH,
+      ERR_WATCH_OPTIONS,
+      ERR_UNKNOWN_EXPORT_FORMAT,
+      ERR_CROSSREF_NOT_FOUND,
+      ERR_CROSSREF_CYCLE,
+      ERR_SCHEMA_SYNTAX,
+      ERR_SCHEMA_FIELDS,
+      ERR_SCHEMA_OPEN,
+      ERR_EDIT_SYNTAX,
+      ERR_EDIT_OPEN,
+      ERR_INDEX_WRITE,
+      ERR_INDEX_READ,
+      ERR_INDEX_OUTDATED,
+      ERR_INDEX_INPUT,
+      ERR_SEARCH_QUERY,
+      ERR_KEY_TEMPLATE,
+      ERR_DIFF_INPUT,
+      ERR_DIFF_OPEN,
+      ERR_UNKNOWN_DIFF_FORMAT,
+      ERR_SPLIT_BY,
+      ERR_SPLIT_OPTIONS,
+      ERR_SPLIT_WRITE,
+      ERR_COMPLETE_KIND,
+      ERR_COMPLETE_INPUT,
+      ERR_ABBREV_JOURNAL,
+      ERR_DIAGNOSTICS_WRITE,
+      ERR_OUTPUT_WRITE,
       STR_CNT
     };
 
-    // set the current locale
-    static void set_locale(std::string lang);
+    // set the current language, english is used for unknown languages
+    static void set_locale(std::string_view lang);
 
     // returns the string in the current language
-    static std::string tr(STR str) { return langs[current_lang][str]; }
+    static const char* tr(STR str) { return (*langs[language()])[str]; }
 
   private:
     // supported languages
@@ -95,21 +152,21 @@ class Strings
       LANG_CNT
     };
 
-    // program version
-    static const std::string version;
-
-    // map to translage between a string the the enum
-    static const std::unordered_map<std::string, LANG> lang_map;
-
-    // current language (default english)
+    // current language, LANG_CNT until it is set or taken from the
+    // environment by the first translation
     static LANG current_lang;
 
-    // strings in different languages
-    static const std::array<std::string, STR_CNT> en;
-    static const std::array<std::string, STR_CNT> de;
+    // returns the current language
+    static LANG language();
+
+    // strings in different languages, constant initialized so that a run
+    // allocates nothing for the strings it does not print
+    static const std::array<const char*, STR_CNT> en;
+    static const std::array<const char*, STR_CNT> de;
 
     // contains the arrays with the different languages
-    static const std::array<std::array<std::string, STR_CNT>, LANG_CNT> langs;
+    static const std::array<const std::array<const char*, STR_CNT>*, LANG_CNT>
+      langs;
 };
 
 #endif
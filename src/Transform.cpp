@@ -0,0 +1,327 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include "Abbreviations.hpp"
+#include "Constants.hpp"
+#include "DataStructure.hpp"
+#include "Macros.hpp"
+#include "Strings.hpp"
+#include "Transform.hpp"
+
+Transform::Transform() :
+  case_t(KEEP),
+  case_f(KEEP),
+  month(false),
+  sort(false)
+{
+}
+
+
+bool Transform::set_case(char _case_t, char _case_f)
+{
+  auto to_case = [] (char c) -> Case {
+    switch (c) {
+      case 'L': return LOWER;
+      case 'U': return UPPER;
+      case 'S': return START;
+      default: return KEEP;
+    }
+  };
+  if (to_case(_case_t) == KEEP) {
+    std::cerr << Strings::tr(Strings::ERR_UNKNOWN_CHANGE_CASE_T)
+      << _case_t << std::endl;
+    return false;
+  }
+  if (to_case(_case_f) == KEEP) {
+    std::cerr << Strings::tr(Strings::ERR_UNKNOWN_CHANGE_CASE_F)
+      << _case_f << std::endl;
+    return false;
+  }
+  case_t = to_case(_case_t);
+  case_f = to_case(_case_f);
+  return true;
+}
+
+
+void Transform::abbreviate_month()
+{
+  month = true;
+}
+
+
+bool Transform::abbreviate_journals(const std::string &filename)
+{
+  std::shared_ptr<JournalAbbreviations> table =
+    std::make_shared<JournalAbbreviations>();
+  if (!table->load(filename))
+    return false;
+  journals = table;
+  return true;
+}
+
+
+void Transform::erase_field(std::string_view field)
+{
+  erased.insert(intern(field));
+}
+
+
+void Transform::sort_elements()
+{
+  sort = true;
+}
+
+
+bool Transform::load_script(std::istream &is, const std::string &source)
+{
+  std::string line;
+  for (size_t n = 1; std::getline(is, line); ++n) {
+    auto error = [&] () -> bool {
+      std::cerr << Strings::tr(Strings::ERR_EDIT_SYNTAX) << source << ":" << n
+        << "\n";
+      return false;
+    };
+
+    // command and field, the rest of the line is the argument
+    std::istringstream ss(line);
+    std::string command, field;
+    if (!(ss >> command) || command[0] == '#')
+      continue;
+    if (!(ss >> field))
+      return error();
+    std::string arg;
+    std::getline(ss >> std::ws, arg);
+    while (!arg.empty() && isspace(static_cast<unsigned char>(arg.back())))
+      arg.pop_back();
+
+    edit e;
+    if (command == "rename" && !arg.empty() &&
+        arg.find_first_of(" \t") == std::string::npos) {
+      e.kind = RENAME;
+      e.text = arg;
+    }
+    else if (command == "set" && !arg.empty()) {
+      // a value in braces or quotes is set without them
+      e.kind = SET;
+      if (arg.size() >= 2 && ((arg.front() == '{' && arg.back() == '}') ||
+            (arg.front() == '"' && arg.back() == '"')))
+        arg = arg.substr(1, arg.size()-2);
+      e.text = arg;
+    }
+    else if (command == "replace" && arg.size() >= 3) {
+      // /regex/replacement/ with any delimiter, the delimiter is escaped
+      // with a backslash
+      e.kind = REPLACE;
+      char delim = arg[0];
+      std::string parts[2];
+      size_t i = 1;
+      for (std::string &part : parts) {
+        for (; i < arg.size() && arg[i] != delim; ++i) {
+          if (arg[i] == '\\' && i+1 < arg.size() && arg[i+1] == delim)
+            ++i;
+          part += arg[i];
+        }
+        if (i++ == arg.size())
+          return error();
+      }
+      if (i != arg.size())
+        return error();
+      try {
+        e.regex = std::regex(parts[0]);
+      }
+      catch (const std::regex_error &) {
+        return error();
+      }
+      e.text = parts[1];
+    }
+    else if (command == "erase" && arg.empty())
+      e.kind = ERASE;
+    else
+      return error();
+
+    auto it = edits.find(field);
+    if (it == edits.end())
+      it = edits.emplace(intern(field), field_edits{std::vector<edit>(),
+            std::string::npos, std::string::npos}).first;
+    field_edits &fe = it->second;
+    if (e.kind == SET && fe.slot == std::string::npos) {
+      fe.first_set = fe.edits.size();
+      fe.slot = added.size();
+      added.emplace_back(it->first, &fe);
+    }
+    fe.edits.push_back(std::move(e));
+  }
+  return true;
+}
+
+
+bool Transform::is_journal(std::string_view field)
+{
+  return CaseFold::equals(field, "journal") ||
+    CaseFold::equals(field, "booktitle");
+}
+
+
+bool Transform::changes_value(std::string_view field) const
+{
+  return (month && CaseFold::equals(field, "month")) ||
+    (journals && is_journal(field));
+}
+
+
+bool Transform::change_value(std::string_view field, std::string_view value,
+    bool &expression, MacroTable *macros, std::string &result) const
+{
+  if (journals && is_journal(field)) {
+    // journal = prl is looked up as the name the macro stands for
+    std::string expanded;
+    if (expression) {
+      if (!macros || !macros->expand(value, expanded))
+        return false;
+      value = expanded;
+    }
+    std::string_view abbrev = journals->find(value);
+    if (abbrev.empty() || abbrev == value)
+      return false;
+    result.assign(abbrev.data(), abbrev.size());
+    expression = false;
+    return true;
+  }
+  result = Constants::find_month_abbreviation(std::string(value));
+  return result != value;
+}
+
+
+std::string_view Transform::intern(std::string_view name)
+{
+  names.push_back(std::string(name));
+  return names.back();
+}
+
+
+void Transform::change_case(std::string &name, bool type) const
+{
+  Case c = type ? case_t : case_f;
+  if (c == KEEP)
+    return;
+  if (c == UPPER)
+    CaseFold::to_upper(name);
+  else
+    CaseFold::to_lower(name);
+  if (c == START && !name.empty())
+    name[0] = CaseFold::to_upper(name[0]);
+}
+
+
+void Transform::apply(bibEntry &bEn, bool names, MacroTable *macros) const
+{
+  if (names)
+    change_case(bEn.type, true);
+
+  // the elements are edited and erased in place
+  std::vector<char> found(added.size(), 0);
+  size_t out = 0;
+  for (size_t j = 0, m = bEn.element.size(); j < m; ++j) {
+    bibElement &bEl = bEn.element[j];
+    bool keep = true;
+    if (!edits.empty()) {
+      auto it = edits.find(bEl.field);
+      if (it != edits.end()) {
+        if (it->second.slot != std::string::npos)
+          found[it->second.slot] = 1;
+        keep = apply_edits(bEl, it->second, 0);
+        // a field renamed to a field with a 'set' edit gets the value
+        // instead of a second element
+        if (keep && !CaseFold::equals(bEl.field, it->first)) {
+          auto to = edits.find(bEl.field);
+          if (to != edits.end() && to->second.slot != std::string::npos) {
+            found[to->second.slot] = 1;
+            keep = apply_edits(bEl, to->second, to->second.first_set);
+          }
+        }
+      }
+    }
+    if (!keep || !apply_fields(bEl, names, macros))
+      continue;
+    if (out != j)
+      bEn.element[out] = std::move(bEl);
+    ++out;
+  }
+  bEn.element.resize(out);
+
+  // fields set by the script that the entry did not have
+  for (size_t a = 0; a < added.size(); ++a) {
+    if (found[a])
+      continue;
+    bibElement bEl;
+    bEl.field = added[a].first;
+    if (apply_edits(bEl, *added[a].second, added[a].second->first_set) &&
+        apply_fields(bEl, names, macros))
+      bEn.element.push_back(std::move(bEl));
+  }
+
+  if (sort)
+    std::sort(bEn.element.begin(), bEn.element.end(),
+        [] (const bibElement &bEl1, const bibElement &bEl2) -> bool {
+          return bEl1.field < bEl2.field;
+        });
+}
+
+
+bool Transform::apply_edits(bibElement &bEl, const field_edits &fe,
+    size_t first) const
+{
+  for (size_t k = first; k < fe.edits.size(); ++k) {
+    const edit &e = fe.edits[k];
+    switch (e.kind) {
+      case RENAME:
+        bEl.field = e.text;
+        break;
+      case SET:
+        bEl.value = e.text;
+        bEl.expression = false;
+        break;
+      case REPLACE:
+        bEl.value = std::regex_replace(bEl.value, e.regex, e.text);
+        break;
+      case ERASE:
+        return false;
+    }
+  }
+  return true;
+}
+
+
+bool Transform::apply_fields(bibElement &bEl, bool names,
+    MacroTable *macros) const
+{
+  if (names)
+    change_case(bEl.field, false);
+  if (changes_value(bEl.field)) {
+    std::string value;
+    if (change_value(bEl.field, bEl.value, bEl.expression, macros, value))
+      bEl.value.swap(value);
+  }
+  return keeps(bEl.field);
+}
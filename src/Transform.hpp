@@ -0,0 +1,185 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <deque>
+#include <istream>
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "CaseFold.hpp"
+#include "KeyTemplate.hpp"
+
+// Forward declaration of user-defined types
+class JournalAbbreviations;
+class MacroTable;
+struct bibElement;
+struct bibEntry;
+
+// Per-entry transformations compiled into a single pass, every entry and
+// element is visited once however many transformations are requested. The
+// edits of the scripts are applied first, then the case is changed, months
+// and journals are abbreviated, fields are erased and the elements are
+// sorted.
+//
+// An edit script has one edit per line, lines starting with '#' are
+// comments:
+//
+//   rename journaltitle journal
+//   set publisher {ACM}
+//   replace pages /(\d+)-(\d+)/$1--$2/
+//   erase abstract
+//
+// Edits match the field names of the input (case insensitive), so a renamed
+// field is still edited under its old name. 'set' adds the field to entries
+// that do not have it, a field renamed to it gets the value instead.
+// 'replace' is an ECMAScript regex replacement and can use any delimiter.
+class Transform
+{
+  public:
+    // Nothing is changed by default
+    Transform();
+
+    // Not copyable, the maps refer to 'names' and 'edits'
+    Transform(const Transform&) = delete;
+    Transform& operator=(const Transform&) = delete;
+
+    // Change the case of types ('case_t') and fields ('case_f') to lower (L),
+    // upper (U) or start (S) case, returns false if a case is unknown
+    bool set_case(char case_t, char case_f);
+
+    // Try to find the correct abbreviations for the month fields
+    void abbreviate_month();
+
+    // Replace the journal and booktitle values found in the dictionary
+    // 'filename' by their abbreviations, returns false if it cannot be read
+    bool abbreviate_journals(const std::string &filename);
+
+    // Erase 'field' (case insensitive) in every entry
+    void erase_field(std::string_view field);
+
+    // Sort the elements of every entry alphabetically
+    void sort_elements();
+
+    // Read the edit script 'is', errors are reported with the name 'source'
+    // and the line, returns false on errors
+    bool load_script(std::istream &is, const std::string &source);
+
+    // True if there are edits of a script
+    bool has_edits() const { return !edits.empty(); }
+
+    // True if the elements are sorted
+    bool sorts() const { return sort; }
+
+    // True if the elements of 'field' are kept
+    bool keeps(std::string_view field) const
+      { return erased.empty() || !erased.count(field); }
+
+    // True if the values of 'field' are changed apart from the edits
+    bool changes_value(std::string_view field) const;
+
+    // Stores the new 'value' of 'field', for which changes_value() is true,
+    // in 'result', returns false if it is unchanged. A journal that is an
+    // 'expression' is looked up with the macros of 'macros' expanded and is
+    // no expression any more if it is abbreviated.
+    bool change_value(std::string_view field, std::string_view value,
+        bool &expression, MacroTable *macros, std::string &result) const;
+
+    // Apply all transformations to 'bEn', the case of the type and field
+    // names is left as it is if 'names' is false. Journals are looked up
+    // with the macros of 'macros' expanded.
+    void apply(bibEntry &bEn, bool names = true,
+        MacroTable *macros = nullptr) const;
+
+    // Change the case of the type or field name 'name'
+    void change_case(std::string &name, bool type) const;
+
+    // Use 'scheme' for the keys created by Bibliography::create_keys(),
+    // returns false on a syntax error
+    bool set_key_template(std::string_view scheme)
+      { return keys.compile(scheme); }
+
+    // Scheme of the created keys, the built-in one by default
+    const KeyTemplate& key_template() const { return keys; }
+
+  private:
+    enum Case { KEEP, LOWER, UPPER, START };
+    Case case_t;
+    Case case_f;
+    bool month;
+    bool sort;
+    KeyTemplate keys;
+
+    // Journal abbreviations
+    std::shared_ptr<const JournalAbbreviations> journals;
+
+    // True if 'field' is a journal or booktitle
+    static bool is_journal(std::string_view field);
+
+    // An edit of the script, 'text' is the new name, the new value or the
+    // replacement
+    enum Kind { RENAME, SET, REPLACE, ERASE };
+    struct edit {
+      Kind kind;
+      std::string text;
+      std::regex regex;
+    };
+
+    // The edits of a field in script order, fields with a 'set' edit are
+    // in 'added' at 'slot' and are edited from 'first_set' on if they are
+    // added to an entry
+    struct field_edits {
+      std::vector<edit> edits;
+      size_t first_set;
+      size_t slot;
+    };
+
+    // Edits and erased fields by name, the deque keeps the names referenced
+    // by the maps in place
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, field_edits, CaseFold::hasher,
+      CaseFold::equal_to> edits;
+    std::unordered_set<std::string_view, CaseFold::hasher,
+      CaseFold::equal_to> erased;
+
+    // Fields with a 'set' edit in script order
+    std::vector<std::pair<std::string_view, const field_edits*>> added;
+
+    // Returns 'name' stored in 'names'
+    std::string_view intern(std::string_view name);
+
+    // Applies the edits from 'first' on to 'bEl', returns false if the
+    // element is erased
+    bool apply_edits(bibElement &bEl, const field_edits &fe,
+        size_t first) const;
+
+    // Applies the transformations after the edits to 'bEl', returns false if
+    // the element is erased
+    bool apply_fields(bibElement &bEl, bool names, MacroTable *macros) const;
+};
+
+#endif
@@ -0,0 +1,362 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "CaseFold.hpp"
+#include "Macros.hpp"
+#include "Parser.hpp"
+#include "StreamCheck.hpp"
+#include "Strings.hpp"
+#include "Watcher.hpp"
+
+// Returns the directory of 'filename'
+static std::string directory(const std::string &filename)
+{
+  std::string dir = std::filesystem::path(filename).parent_path().string();
+  return dir.empty() ? "." : dir;
+}
+
+
+// Returns the length of the common prefix of 's1' and 's2'
+static size_t common_prefix(std::string_view s1, std::string_view s2)
+{
+  size_t len = std::min(s1.size(), s2.size()), i = 0;
+  // skip equal blocks with memcmp
+  const size_t block = 4096;
+  while (i+block <= len && std::memcmp(s1.data()+i, s2.data()+i, block) == 0)
+    i += block;
+  while (i < len && s1[i] == s2[i])
+    ++i;
+  return i;
+}
+
+
+// Returns the length of the common suffix of 's1' and 's2'
+static size_t common_suffix(std::string_view s1, std::string_view s2)
+{
+  size_t len = std::min(s1.size(), s2.size()), i = 0;
+  const char *e1 = s1.data()+s1.size(), *e2 = s2.data()+s2.size();
+  const size_t block = 4096;
+  while (i+block <= len &&
+      std::memcmp(e1-i-block, e2-i-block, block) == 0)
+    i += block;
+  while (i < len && e1[-1-i] == e2[-1-i])
+    ++i;
+  return i;
+}
+
+
+Watcher::Watcher(
+    std::function<std::string(bibEntry&, std::vector<bibEntry>&)> _process) :
+  process(_process)
+{
+}
+
+
+int Watcher::run(const std::vector<std::string> &filenames,
+    std::function<void(const std::vector<std::string_view>&,
+      const Diagnostics&)> emit)
+{
+  for (const std::string &filename : filenames) {
+    files.push_back(file());
+    files.back().name = filename;
+    update(files.back());
+  }
+  {
+    Diagnostics diagnostics;
+    std::vector<std::string_view> out = output(diagnostics);
+    emit(out, diagnostics);
+  }
+
+  int fd = inotify_init1(IN_CLOEXEC);
+  if (fd == -1) {
+    std::cerr << Strings::tr(Strings::ERR_WATCH) << std::strerror(errno)
+      << "\n";
+    return 1;
+  }
+  // watch the directories, editors often replace a file instead of
+  // writing to it
+  std::unordered_map<int, std::string> dirs;
+  for (const file &f : files) {
+    int wd = inotify_add_watch(fd, directory(f.name).c_str(),
+        IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd == -1) {
+      std::cerr << Strings::tr(Strings::ERR_WATCH) << f.name << "\n";
+      close(fd);
+      return 1;
+    }
+    dirs[wd] = directory(f.name);
+  }
+
+  alignas(inotify_event) char buf[4096];
+  while (true) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0) {
+      if (errno == EINTR)
+        continue;
+      std::cerr << Strings::tr(Strings::ERR_WATCH) << std::strerror(errno)
+        << "\n";
+      close(fd);
+      return 1;
+    }
+    // update all files that were written
+    bool changed = false;
+    for (char *p = buf; p < buf+n;) {
+      const inotify_event *ev = reinterpret_cast<const inotify_event*>(p);
+      p += sizeof(inotify_event) + ev->len;
+      if (ev->len == 0)
+        continue;
+      for (file &f : files) {
+        if (dirs[ev->wd] == directory(f.name) &&
+            std::filesystem::path(f.name).filename() == ev->name)
+          changed = update(f) || changed;
+      }
+    }
+    if (changed) {
+      Diagnostics diagnostics;
+      std::vector<std::string_view> out = output(diagnostics);
+      emit(out, diagnostics);
+    }
+  }
+}
+
+
+bool Watcher::update(file &f)
+{
+  std::ifstream is(f.name.c_str(), std::ios::binary);
+  if (!is)
+    return false;
+  // read into the buffer of the previous content to avoid new allocations
+  std::string &content = buffer;
+  is.seekg(0, std::ios::end);
+  content.resize(is.tellg());
+  is.seekg(0);
+  is.read(&content[0], content.size());
+  content.resize(is.gcount());
+
+  // only the part between the common prefix and suffix has changed
+  size_t prefix = common_prefix(f.content, content);
+  if (prefix == f.content.size() && prefix == content.size())
+    return false;
+  size_t suffix = std::min(common_suffix(f.content, content),
+      std::min(f.content.size(), content.size()) - prefix);
+  size_t unchanged = content.size() - suffix;
+  size_t delta = content.size() - f.content.size();
+
+  // keep the entries before the first change
+  auto first = std::partition_point(f.ranges.begin(), f.ranges.end(),
+      [prefix] (const range &r) -> bool { return r.end < prefix; });
+  std::vector<range> ranges(f.ranges.begin(), first);
+
+  // find the entries in the changed part, until an entry starts in the
+  // common suffix at the same position as before
+  range r;
+  for (size_t pos = ranges.empty() ? 0 : ranges.back().end;
+      next_range(content, pos, r); pos = r.end) {
+    if (r.begin >= unchanged) {
+      size_t old_begin = r.begin - delta;
+      auto old = std::lower_bound(first, f.ranges.end(), old_begin,
+          [] (const range &r, size_t begin) -> bool {
+            return r.begin < begin;
+          });
+      if (old != f.ranges.end() && old->begin == old_begin) {
+        for (; old != f.ranges.end(); ++old)
+          ranges.push_back(range{old->begin + delta, old->end + delta,
+              old->entry});
+        break;
+      }
+    }
+    r.entry = lookup(content, r);
+    ranges.push_back(r);
+  }
+
+  f.content.swap(content);
+  f.ranges.swap(ranges);
+  return true;
+}
+
+
+bool Watcher::next_range(const std::string &content, size_t pos,
+    range &r) const
+{
+  // same rules as the parser: an entry starts with '@' and ends with the
+  // '}' that closes the first '{'
+  size_t at = content.find('@', pos);
+  if (at == std::string::npos)
+    return false;
+  r.begin = at;
+  r.end = content.size();
+  size_t open = content.find('{', at);
+  if (open == std::string::npos)
+    return true;
+  int depth = 1;
+  for (size_t i = open+1; i < content.size(); ++i) {
+    if (content[i] == '{')
+      ++depth;
+    else if (content[i] == '}' && --depth == 0) {
+      r.end = i+1;
+      break;
+    }
+  }
+  return true;
+}
+
+
+const Watcher::cached* Watcher::lookup(const std::string &content,
+    const range &r)
+{
+  std::string_view text(content.data()+r.begin, r.end-r.begin);
+  size_t hash = std::hash<std::string_view>()(text);
+  auto found = cache.equal_range(hash);
+  for (auto it = found.first; it != found.second; ++it)
+    if (it->second.text == text)
+      return &it->second;
+
+  // parse and process the new entry, an entry with crossref is processed
+  // with its parents when the output is created. @string and @preamble are
+  // printed in place.
+  cached c;
+  c.text = text;
+  std::istringstream is(c.text);
+  std::vector<bibEntry> parsed;
+  MacroTable macros;
+  Parser parser(&macros);
+  parser.add(is, parsed);
+  std::ostringstream definitions;
+  macros.print(definitions, true);
+  c.output = definitions.str();
+  std::vector<bibEntry> parents;
+  for (bibEntry &bEn : parsed) {
+    c.entries.push_back(bEn);
+    if (c.key.empty())
+      c.key = bEn.key;
+    for (const bibElement &bEl : bEn.element)
+      if (CaseFold::equals(bEl.field, "crossref")) {
+        c.crossref = bEl.value;
+        break;
+      }
+    if (c.crossref.empty())
+      c.output += process(bEn, parents);
+  }
+  return &cache.emplace(hash, std::move(c))->second;
+}
+
+
+const Watcher::inherited* Watcher::resolve(const cached *entry,
+    const std::unordered_map<std::string_view, const cached*,
+      CaseFold::hasher, CaseFold::equal_to> &keys,
+    std::unordered_set<const inherited*> &used)
+{
+  // the texts of the entry and its parents, a cycle ends the chain
+  std::string texts = entry->text;
+  std::vector<const cached*> chain(1, entry);
+  for (const cached *e = entry; !e->crossref.empty();) {
+    auto found = keys.find(e->crossref);
+    if (found == keys.end() || std::find(chain.begin(), chain.end(),
+          found->second) != chain.end())
+      break;
+    e = found->second;
+    chain.push_back(e);
+    texts += '\0';
+    texts += e->text;
+  }
+  size_t hash = std::hash<std::string>()(texts);
+  auto found = resolved.equal_range(hash);
+  for (auto it = found.first; it != found.second; ++it)
+    if (it->second.texts == texts) {
+      used.insert(&it->second);
+      return &it->second;
+    }
+
+  // parse the entry and its parents again, there are usually few of them
+  std::vector<bibEntry> parsed;
+  Parser parser;
+  for (const cached *e : chain) {
+    std::istringstream is(e->text);
+    parser.add(is, parsed, 1);
+  }
+  inherited i;
+  i.texts = std::move(texts);
+  if (!parsed.empty()) {
+    std::vector<bibEntry> parents(std::make_move_iterator(parsed.begin()+1),
+        std::make_move_iterator(parsed.end()));
+    i.output = process(parsed.front(), parents);
+  }
+  const inherited *result = &resolved.emplace(hash, std::move(i))->second;
+  used.insert(result);
+  return result;
+}
+
+
+std::vector<std::string_view> Watcher::output(Diagnostics &diagnostics)
+{
+  // the first entry with a key is the parent, as in the bibliography
+  std::unordered_map<std::string_view, const cached*, CaseFold::hasher,
+    CaseFold::equal_to> keys;
+  std::unordered_set<const cached*> current;
+  for (const file &f : files)
+    for (const range &r : f.ranges) {
+      current.insert(r.entry);
+      if (!r.entry->key.empty())
+        keys.emplace(r.entry->key, r.entry);
+    }
+
+  // every entry is checked against the entries before it, which only
+  // needs their hashes, the redundant ones are left out
+  StreamCheck check;
+  std::vector<std::string_view> out;
+  std::unordered_set<const inherited*> used;
+  for (const file &f : files) {
+    size_t source = diagnostics.add_source(f.name);
+    for (const range &r : f.ranges) {
+      bool redundant = false;
+      for (bibEntry &bEn : r.entry->entries) {
+        bEn.source = source;
+        bEn.offset = r.begin;
+        redundant = !check.check(bEn, diagnostics) || redundant;
+      }
+      if (redundant)
+        continue;
+      if (r.entry->crossref.empty())
+        out.push_back(r.entry->output);
+      else
+        out.push_back(resolve(r.entry, keys, used)->output);
+    }
+  }
+  if (check.size() == 0)
+    diagnostics.report(Diagnostics::EMPTY_BIBLIOGRAPHY, "", "", 0, 0);
+
+  // remove the entries that were changed or deleted
+  for (auto it = cache.begin(); it != cache.end();)
+    it = current.count(&it->second) ? std::next(it) : cache.erase(it);
+  for (auto it = resolved.begin(); it != resolved.end();)
+    it = used.count(&it->second) ? std::next(it) : resolved.erase(it);
+  return out;
+}
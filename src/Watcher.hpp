@@ -0,0 +1,128 @@
+/*  bibf - a simple bibtex pretty printer
+ *
+ *  Copyright (C) 2014 Dennis Dast <mail@ddast.de>
+ *
+ *  This file is part of bibf.
+ *
+ *  bibf is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  bibf is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "CaseFold.hpp"
+#include "DataStructure.hpp"
+#include "Diagnostics.hpp"
+
+// Watches the input files with inotify and reformats them after every
+// change. Only the entries whose text changed are parsed and processed
+// again, the output of all other entries is taken from a cache. Entries with
+// a crossref are processed again if the text of one of their parents
+// changed. Redundant entries and empty or duplicate keys are checked across
+// all entries after every change, as in the normal run, but an entry is only
+// left out if an earlier entry contains it. The @string and @preamble
+// definitions are printed where they are read.
+class Watcher
+{
+  public:
+    // Constructor, 'process' returns the output for a single entry, given
+    // its crossref parents with the nearest first
+    Watcher(std::function<std::string(bibEntry&, std::vector<bibEntry>&)>
+        _process);
+
+    // Call 'emit' with the output of all entries of 'filenames' and the
+    // warnings of the checks across entries now and after every change of
+    // one of the files. Returns only if watching fails.
+    int run(const std::vector<std::string> &filenames,
+        std::function<void(const std::vector<std::string_view>&,
+          const Diagnostics&)> emit);
+
+  private:
+    // Output of an entry and the text it was created from, the output of an
+    // entry with crossref is in 'resolved'. The parsed entry is kept for the
+    // checks across entries, it is located at every use of the text.
+    struct cached {
+      std::string text;
+      std::string output;
+      std::string key;
+      std::string crossref;
+      mutable std::vector<bibEntry> entries;
+    };
+
+    // Output of an entry with crossref and the texts of it and its parents
+    struct inherited {
+      std::string texts;
+      std::string output;
+    };
+
+    // Byte range of an entry in a file, from '@' to the closing '}'
+    struct range {
+      size_t begin;
+      size_t end;
+      const cached *entry;
+    };
+
+    // Content of a watched file and the entries in it
+    struct file {
+      std::string name;
+      std::string content;
+      std::vector<range> ranges;
+    };
+
+    // Creates the output for one entry
+    std::function<std::string(bibEntry&, std::vector<bibEntry>&)> process;
+
+    // Watched files
+    std::vector<file> files;
+
+    // Output of all entries by the hash of their text and of the entries
+    // with crossref by the hash of the texts of them and their parents
+    std::unordered_multimap<size_t, cached> cache;
+    std::unordered_multimap<size_t, inherited> resolved;
+
+    // Space for reading a file, holds the previous content afterwards
+    std::string buffer;
+
+    // Read 'f' again and update its ranges, returns false if the file did
+    // not change
+    bool update(file &f);
+
+    // Finds the next entry in 'content' at or after 'pos'
+    bool next_range(const std::string &content, size_t pos, range &r) const;
+
+    // Returns the cached output for the text of 'r', processes the entry if
+    // necessary
+    const cached* lookup(const std::string &content, const range &r);
+
+    // Returns the output of 'entry' with the parents found in 'keys',
+    // processes it if necessary and adds it to 'used'
+    const inherited* resolve(const cached *entry,
+        const std::unordered_map<std::string_view, const cached*,
+          CaseFold::hasher, CaseFold::equal_to> &keys,
+        std::unordered_set<const inherited*> &used);
+
+    // Returns the output of all entries in order without the redundant ones
+    // and reports the checks across entries to 'diagnostics', cached outputs
+    // that are no longer used are removed
+    std::vector<std::string_view> output(Diagnostics &diagnostics);
+};
+
+#endif
@@ -18,14 +18,33 @@
  *  along with bibf.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <cstdio>
 #include <cstdlib>
 #include <exception>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <boost/program_options.hpp>
 #include "Bibliography.hpp"
+#include "CaseFold.hpp"
+#include "Compression.hpp"
+#include "Diagnostics.hpp"
+#include "Differ.hpp"
+#include "Exporter.hpp"
+#include "Macros.hpp"
+#include "Parser.hpp"
+#include "Pipeline.hpp"
+#include "SearchIndex.hpp"
+#include "Splitter.hpp"
+#include "StreamCheck.hpp"
 #include "Strings.hpp"
+#include "Transform.hpp"
+#include "Watcher.hpp"
 #include "bibf.hpp"
 
 namespace po = boost::program_options;
@@ -40,67 +59,821 @@ std::vector<std::string> separate_string(std::string s)
   return result;
 }
 
-void localize_strings()
+time_t modification_time(const std::string &filename)
 {
-  // read environment variable LANG
-  std::string lang = std::getenv("LANG");
-  // if LANG is not set use default language (english)
-  if (lang.empty())
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0)
+    return 0;
+  return st.st_mtime;
+}
+
+int compile_transforms(Transform &transform, const po::variables_map &vm)
+{
+  // edit scripts
+  if (vm.count("edit")) {
+    for (const std::string &filename :
+        vm["edit"].as< std::vector<std::string> >()) {
+      std::ifstream file(filename);
+      if (!file) {
+        std::cerr << Strings::tr(Strings::ERR_EDIT_OPEN) << filename << "\n";
+        return 1;
+      }
+      if (!transform.load_script(file, filename))
+        return 1;
+    }
+  }
+
+  // change case of field ids
+  if (vm.count("change-case")) {
+    std::string cases = vm["change-case"].as<std::string>();
+    if (cases.length() == 1)
+      transform.set_case(cases[0], cases[0]);
+    else if (cases.length() == 2)
+      transform.set_case(cases[0], cases[1]);
+    else {
+      std::cerr << Strings::tr(Strings::ERR_CHANGE_CASE);
+      return 1;
+    }
+  }
+
+  // abbreviate months
+  if (vm.count("abbrev-month"))
+    transform.abbreviate_month();
+
+  // abbreviate journals
+  if (vm.count("abbrev-journal")) {
+    const std::string &filename = vm["abbrev-journal"].as<std::string>();
+    if (!transform.abbreviate_journals(filename)) {
+      std::cerr << Strings::tr(Strings::ERR_ABBREV_JOURNAL) << filename << "\n";
+      return 1;
+    }
+  }
+
+  // erase fields
+  if (vm.count("erase-field")) {
+    std::vector<std::string> erase_vec =
+      separate_string(vm["erase-field"].as<std::string>());
+    for (const std::string &erase : erase_vec)
+      transform.erase_field(erase);
+  }
+
+  // sort elements
+  if (vm.count("sort-elements"))
+    transform.sort_elements();
+
+  // scheme of the created keys
+  if (vm.count("key-template")) {
+    std::string scheme = vm["key-template"].as<std::string>();
+    if (!transform.set_key_template(scheme)) {
+      std::cerr << Strings::tr(Strings::ERR_KEY_TEMPLATE) << scheme << "\n";
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int apply_transforms(Bibliography &bib, const po::variables_map &vm,
+    const Transform &transform)
+{
+  // copy inherited fields first, the other transformations see them
+  if (vm.count("inline-crossref"))
+    bib.inline_crossref();
+
+  // linebreak
+  if (vm.count("linebreak"))
+    bib.set_linebreak(vm["linebreak"].as<unsigned int>());
+
+  // intendation
+  if (vm.count("intendation"))
+    bib.set_intendation(vm["intendation"].as<std::string>());
+
+  // delimiter
+  if (vm.count("delimiter")) {
+    char delim = vm["delimiter"].as<char>();
+    if ((delim == '{') || (delim == '}'))
+      bib.set_field_delimiter('{', '}');
+    else if (delim == '"')
+      bib.set_field_delimiter('"', '"');
+    else
+      std::cerr << Strings::tr(Strings::ERR_DELIMITER) << delim << "\n";
+  }
+
+  // alignment
+  if (vm.count("align-left")) {
+    bool right_aligned = false;
+    bib.set_alignment(right_aligned);
+  }
+
+  // expand macros
+  if (vm.count("expand-macros"))
+    bib.expand_macros();
+
+  // edits, case, months, erased fields and sorted elements in one pass
+  bib.transform(transform);
+
+  // sort bibliography
+  if (vm.count("sort-bib")) {
+    std::vector<std::string> sort =
+      separate_string( vm["sort-bib"].as<std::string>() );
+    bib.sort_bib(sort);
+  }
+
+  // create keys
+  if (vm.count("create-keys"))
+    bib.create_keys(transform.key_template());
+
+  return 0;
+}
+
+bool single_entry_actions(const po::variables_map &vm)
+{
+  return !vm.count("merge") && !vm.count("create-keys") &&
+    !vm.count("new-entry") && !vm.count("show-missing") &&
+    !vm.count("missing-fields") && !vm.count("find-duplicates") &&
+    !vm.count("inline-crossref");
+}
+
+int load_schemas(Bibliography &bib, const po::variables_map &vm)
+{
+  if (!vm.count("schema"))
+    return 0;
+  for (const std::string &filename :
+      vm["schema"].as< std::vector<std::string> >()) {
+    std::ifstream file(filename);
+    if (!file) {
+      std::cerr << Strings::tr(Strings::ERR_SCHEMA_OPEN) << filename << "\n";
+      return 1;
+    }
+    if (!bib.load_schema(file, filename))
+      return 1;
+  }
+  return 0;
+}
+
+void set_projection(Bibliography &bib, const po::variables_map &vm,
+    const Transform &transform)
+{
+  if (vm.count("merge") || vm.count("new-entry") ||
+      vm.count("find-duplicates") || vm.count("inline-crossref") ||
+      vm.count("edit"))
     return;
-  // extract the part before _
-  auto i = lang.find("_");
-  // use default language if LANG has unknown format
-  if (i == std::string::npos)
+  // show-missing checks the fields of the schema and takes precedence over
+  // missing-fields, which takes precedence over only
+  bool standard = vm.count("show-missing");
+  std::vector<std::string> fields, erased;
+  if (!standard && vm.count("missing-fields"))
+    fields = separate_string(vm["missing-fields"].as<std::string>());
+  else if (!standard && vm.count("only"))
+    fields = separate_string(vm["only"].as<std::string>());
+  if (vm.count("erase-field"))
+    erased = separate_string(vm["erase-field"].as<std::string>());
+  // all fields are printed
+  if (!standard && fields.empty())
     return;
-  lang = lang.substr(0, i);
-  // set language
-  Strings::set_locale(lang);
+
+  // fields used by the transformations
+  std::vector<std::string> used;
+  if (vm.count("sort-bib")) {
+    used = separate_string(vm["sort-bib"].as<std::string>());
+    for (std::string &criterion : used)
+      if (CaseFold::equals(criterion, "firstauthor"))
+        criterion = "author";
+  }
+  if (vm.count("create-keys"))
+    for (const std::string &field : transform.key_template().fields())
+      used.push_back(field);
+  if (vm.count("abbrev-month"))
+    used.push_back("month");
+  if (vm.count("abbrev-journal")) {
+    used.push_back("journal");
+    used.push_back("booktitle");
+  }
+
+  auto contains = [] (const std::vector<std::string> &v,
+      std::string_view field) -> bool {
+    for (const std::string &s : v)
+      if (CaseFold::equals(s, field))
+        return true;
+    return false;
+  };
+  bib.set_projection([=, &bib] (std::string_view field) -> bool {
+      if (contains(erased, field))
+        return false;
+      return contains(fields, field) || contains(used, field) ||
+        (standard && bib.is_schema_field(field));
+    });
+}
+
+int report_diagnostics(const Diagnostics &diagnostics,
+    const po::variables_map &vm)
+{
+  diagnostics.print(std::cerr, vm["max-warnings"].as<unsigned int>());
+  if (vm.count("diagnostics")) {
+    const std::string &filename = vm["diagnostics"].as<std::string>();
+    std::ofstream report(filename);
+    diagnostics.write_json(report);
+    if (!report) {
+      std::cerr << Strings::tr(Strings::ERR_DIAGNOSTICS_WRITE) << filename
+        << "\n";
+      return 1;
+    }
+  }
+  return 0;
+}
+
+bool open_output(OutputFile &out, const po::variables_map &vm)
+{
+  if (!vm.count("output"))
+    return true;
+  const std::string &filename = vm["output"].as<std::string>();
+  out.open(filename);
+  if (!out.is_open()) {
+    std::cerr << Strings::tr(Strings::ERR_OUTPUT_WRITE) << filename << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool open_temporary(std::fstream &file)
+{
+  // the file is removed right away, it exists as long as it is open
+  std::string name =
+    (std::filesystem::temp_directory_path() / "bibf-XXXXXX").string();
+  int fd = mkstemp(&name[0]);
+  if (fd == -1)
+    return false;
+  file.open(name, std::ios::in | std::ios::out | std::ios::trunc |
+      std::ios::binary);
+  close(fd);
+  std::remove(name.c_str());
+  return file.is_open();
+}
+
+int external_sort(const po::variables_map &vm)
+{
+  // parsed entries need about three times the memory of their text
+  size_t max_bytes =
+    size_t(vm["max-memory"].as<unsigned int>()) * 1024 * 1024 / 3;
+  if (max_bytes == 0)
+    max_bytes = 1;
+  Transform transform;
+  if (int ret = compile_transforms(transform, vm))
+    return ret;
+  std::vector<std::string> criteria =
+    separate_string(vm["sort-bib"].as<std::string>());
+  std::vector<std::string> only;
+  if (vm.count("only"))
+    only = separate_string(vm["only"].as<std::string>());
+
+  // set output file
+  OutputFile out;
+  if (!open_output(out, vm))
+    return 1;
+  std::ostream &os = out.is_open() ? out : std::cout;
+
+  // sorted runs
+  std::vector<std::unique_ptr<std::fstream>> runs;
+
+  // warnings of all batches
+  Diagnostics diagnostics;
+
+  // @string macros and @preambles of all batches, printed before the merged
+  // runs
+  std::shared_ptr<MacroTable> macros = std::make_shared<MacroTable>();
+
+  // entries are parsed one at a time and located in the concatenated input.
+  // Once the input does not fit into memory, every entry is checked against
+  // all entries before it, so that the batches do not change the output.
+  // Until then the first batch is checked as a whole, as in the normal run.
+  StreamCheck check;
+  Parser parser(macros.get());
+  std::vector<uint64_t> starts;
+  std::vector<bibEntry> parsed;
+  std::vector<bibEntry> kept;
+
+  // read batches of at most 'max_bytes', sort them and write them to runs
+  std::unique_ptr<Bibliography> batch = std::make_unique<Bibliography>();
+  batch->use_macros(macros);
+  batch->check_entries(false);
+  size_t bytes = 0;
+  auto write_batch = [&] () -> int {
+    if (runs.empty()) {
+      std::vector<bibEntry> checked;
+      for (bibEntry &bEn : kept)
+        if (check.check(bEn, diagnostics))
+          checked.push_back(std::move(bEn));
+      kept.swap(checked);
+    }
+    batch->add(kept);
+    // the runs are merged without crossref parents, they cannot be used
+    // for sorting the batches either
+    batch->resolve_crossref(false);
+    if (int ret = apply_transforms(*batch, vm, transform))
+      return ret;
+    runs.push_back(std::make_unique<std::fstream>());
+    if (!open_temporary(*runs.back())) {
+      std::cerr << Strings::tr(Strings::ERR_TEMPORARY_FILE);
+      return 1;
+    }
+    batch->write_run(*runs.back());
+    diagnostics.merge(batch->get_diagnostics());
+    batch = std::make_unique<Bibliography>();
+    batch->use_macros(macros);
+    batch->check_entries(false);
+    bytes = 0;
+    return 0;
+  };
+  auto read = [&] (std::istream &is) -> int {
+    starts.push_back(parser.offset());
+    while (is) {
+      size_t added = parser.add(is, parsed, 1);
+      for (bibEntry &bEn : parsed)
+        if (runs.empty() || check.check(bEn, diagnostics)) {
+          kept.push_back(std::move(bEn));
+          bytes += added;
+        }
+      parsed.clear();
+      if (bytes >= max_bytes)
+        if (int ret = write_batch())
+          return ret;
+    }
+    return 0;
+  };
+
+  int ret = 0;
+  std::vector<std::string> filenames;
+  if (vm.count("input-files")) {
+    filenames = vm["input-files"].as< std::vector<std::string> >();
+    for (const std::string &filename : filenames) {
+      InputFile bibFile(filename);
+      if ((ret = read(bibFile)))
+        break;
+    }
+  }
+  else {
+    filenames.push_back("-");
+    InputFile in;
+    ret = read(in);
+  }
+
+  if (ret == 0 && runs.empty()) {
+    // everything fits into memory, the output is the same as without
+    // --max-memory
+    batch->check_entries(true);
+    batch->add(kept);
+    if ((ret = apply_transforms(*batch, vm, transform)) == 0)
+      batch->print_bib(only, os);
+  }
+  else if (ret == 0) {
+    if (!kept.empty())
+      ret = write_batch();
+    // the formatting options and --expand-macros apply to the merged runs
+    if (ret == 0)
+      ret = apply_transforms(*batch, vm, transform);
+    if (ret == 0) {
+      std::vector<std::istream*> streams;
+      for (std::unique_ptr<std::fstream> &run : runs) {
+        run->seekg(0);
+        streams.push_back(run.get());
+      }
+      batch->merge_runs(streams, criteria, only, os);
+    }
+  }
+
+  diagnostics.merge(batch->get_diagnostics());
+  diagnostics.locate(filenames, starts);
+  if (ret == 0)
+    ret = report_diagnostics(diagnostics, vm);
+  return ret;
+}
+
+int run_pipeline(const po::variables_map &vm)
+{
+  // check the options once before any thread is started
+  Transform transform;
+  if (int ret = compile_transforms(transform, vm))
+    return ret;
+
+  std::vector<std::string> filenames;
+  if (vm.count("input-files"))
+    filenames = vm["input-files"].as< std::vector<std::string> >();
+  std::vector<std::string> only;
+  if (vm.count("only"))
+    only = separate_string(vm["only"].as<std::string>());
+
+  // set output file
+  OutputFile out;
+  if (!open_output(out, vm))
+    return 1;
+
+  Pipeline pipeline([&vm, &transform] (Bibliography &bib) {
+        apply_transforms(bib, vm, transform);
+      }, only);
+  pipeline.run(filenames, out.is_open() ? out : std::cout);
+  return report_diagnostics(pipeline.get_diagnostics(), vm);
+}
+
+void inherit_fields(bibEntry &bEn, const bibEntry &parent)
+{
+  // like the bibliography, a field is inherited if the entry has no value
+  // for it, crossref itself is never inherited
+  for (const bibElement &inherited : parent.element) {
+    if (inherited.value.empty() ||
+        CaseFold::equals(inherited.field, "crossref"))
+      continue;
+    auto found = std::find_if(bEn.element.begin(), bEn.element.end(),
+        [&inherited] (const bibElement &bEl) -> bool {
+          return CaseFold::equals(bEl.field, inherited.field);
+        });
+    if (found == bEn.element.end())
+      bEn.element.push_back(inherited);
+    else if (found->value.empty()) {
+      found->value = inherited.value;
+      found->expression = inherited.expression;
+    }
+  }
+}
+
+int run_watch(const po::variables_map &vm)
+{
+  // every entry is processed on its own, without the macros defined in
+  // other entries
+  if (!vm.count("input-files") || vm.count("sort-bib") ||
+      vm.count("merge") || vm.count("create-keys") ||
+      vm.count("new-entry") || vm.count("find-duplicates") ||
+      vm.count("inline-crossref") || vm.count("expand-macros")) {
+    std::cerr << Strings::tr(Strings::ERR_WATCH_OPTIONS);
+    return 1;
+  }
+  // check the options once
+  Bibliography empty;
+  if (int ret = load_schemas(empty, vm))
+    return ret;
+  Transform transform;
+  if (int ret = compile_transforms(transform, vm))
+    return ret;
+
+  std::vector<std::string> only;
+  if (vm.count("only"))
+    only = separate_string(vm["only"].as<std::string>());
+  std::vector<std::string> fields;
+  if (vm.count("missing-fields"))
+    fields = separate_string(vm["missing-fields"].as<std::string>());
+  bool report = vm.count("show-missing") || vm.count("missing-fields");
+  if (!report) {
+    // the output file is written again after every change
+    OutputFile out;
+    if (!open_output(out, vm))
+      return 1;
+  }
+
+  // output or report of a single entry, the reports and the fields in
+  // 'only' include the fields inherited from the parents
+  bool inherit = report || !only.empty();
+  auto process = [&] (bibEntry &bEn, std::vector<bibEntry> &parents)
+      -> std::string {
+    for (size_t p = 0; inherit && p < parents.size(); ++p)
+      inherit_fields(bEn, parents[p]);
+    std::vector<bibEntry> entries(1);
+    entries[0] = std::move(bEn);
+    // the keys and the redundancy are checked across all entries by the
+    // watcher
+    Bibliography bib;
+    bib.resolve_crossref(false);
+    bib.check_entries(false);
+    bib.add(entries);
+    apply_transforms(bib, vm, transform);
+    std::ostringstream ss;
+    if (vm.count("show-missing")) {
+      bib.use_schema(empty);
+      bib.show_missing_fields(vm["show-missing"].as<char>() != 'O', ss);
+    }
+    else if (vm.count("missing-fields"))
+      bib.show_missing_fields(fields, ss);
+    else
+      bib.print_bib(only, ss);
+    bib.get_diagnostics().print(std::cerr,
+        vm["max-warnings"].as<unsigned int>());
+    return ss.str();
+  };
+  auto emit = [&] (const std::vector<std::string_view> &output,
+      const Diagnostics &diagnostics) {
+    auto write = [&output] (std::ostream &os) {
+      for (std::string_view entry : output)
+        os.write(entry.data(), entry.size());
+      os.flush();
+    };
+    if (report)
+      write(std::cerr);
+    else if (vm.count("output")) {
+      OutputFile out;
+      if (open_output(out, vm))
+        write(out);
+    }
+    else
+      write(std::cout);
+    diagnostics.print(std::cerr, vm["max-warnings"].as<unsigned int>());
+  };
+
+  Watcher watcher(process);
+  return watcher.run(vm["input-files"].as< std::vector<std::string> >(),
+      emit);
+}
+
+int run_export(const po::variables_map &vm)
+{
+  Exporter::Format format;
+  std::string name = vm["export"].as<std::string>();
+  if (name == "jsonl")
+    format = Exporter::JSONL;
+  else if (name == "tsv")
+    format = Exporter::TSV;
+  else {
+    std::cerr << Strings::tr(Strings::ERR_UNKNOWN_EXPORT_FORMAT) << name
+      << "\n";
+    return 1;
+  }
+  std::vector<std::string> only;
+  if (vm.count("only"))
+    only = separate_string(vm["only"].as<std::string>());
+
+  // set output file
+  OutputFile out;
+  if (!open_output(out, vm))
+    return 1;
+
+  Exporter exporter(format, only, out.is_open() ? out : std::cout);
+  if (vm.count("input-files")) {
+    for (const std::string &filename :
+        vm["input-files"].as< std::vector<std::string> >()) {
+      InputFile bibFile(filename);
+      exporter.add(bibFile);
+    }
+  }
+  else {
+    InputFile in;
+    exporter.add(in);
+  }
+  return 0;
+}
+
+int run_build_index(const po::variables_map &vm)
+{
+  if (vm.count("input-files"))
+    for (const std::string &filename :
+        vm["input-files"].as< std::vector<std::string> >())
+      if (!SearchIndex::build(filename) || !CompletionIndex::build(filename))
+        return 1;
+  return 0;
+}
+
+int run_search(const po::variables_map &vm)
+{
+  // number of printed entries
+  const size_t max_hits = 20;
+
+  const std::string &query = vm["search"].as<std::string>();
+  if (!SearchIndex::valid_query(query)) {
+    std::cerr << Strings::tr(Strings::ERR_SEARCH_QUERY) << query << "\n";
+    return 1;
+  }
+  std::vector<std::string> filenames;
+  if (vm.count("input-files"))
+    filenames = vm["input-files"].as< std::vector<std::string> >();
+  SearchIndex index;
+  if (!index.open(filenames))
+    return 1;
+  Transform transform;
+  if (int ret = compile_transforms(transform, vm))
+    return ret;
+
+  // only the matching entries are parsed, in the order of their rank, after
+  // the definitions of the macros they may use
+  std::vector<std::string> hits =
+    index.search(query, max_hits);
+  std::string text;
+  if (!hits.empty())
+    for (const std::string &definition : index.definitions()) {
+      text += definition;
+      text += '\n';
+    }
+  for (const std::string &entry : hits) {
+    text += entry;
+    text += '\n';
+  }
+  std::istringstream is(text);
+  Bibliography bib;
+  bib.resolve_crossref(false);
+  bib.add(is);
+  apply_transforms(bib, vm, transform);
+
+  std::vector<std::string> only;
+  if (vm.count("only"))
+    only = separate_string(vm["only"].as<std::string>());
+  OutputFile out;
+  if (!open_output(out, vm))
+    return 1;
+  bib.print_bib(only, out.is_open() ? out : std::cout);
+  return 0;
+}
+
+int run_complete(const po::variables_map &vm)
+{
+  // number of printed completions
+  const size_t max_hits = 10;
+
+  CompletionIndex::Kind kind;
+  std::string name = vm["complete"].as<std::string>();
+  if (name == "key")
+    kind = CompletionIndex::KEY;
+  else if (name == "author")
+    kind = CompletionIndex::AUTHOR;
+  else if (name == "journal")
+    kind = CompletionIndex::JOURNAL;
+  else {
+    std::cerr << Strings::tr(Strings::ERR_COMPLETE_KIND) << name << "\n";
+    return 1;
+  }
+  // the first positional argument is the prefix
+  std::vector<std::string> filenames;
+  if (vm.count("input-files"))
+    filenames = vm["input-files"].as< std::vector<std::string> >();
+  if (filenames.size() < 2) {
+    std::cerr << Strings::tr(Strings::ERR_COMPLETE_INPUT);
+    return 1;
+  }
+  std::string prefix = filenames.front();
+  filenames.erase(filenames.begin());
+  CompletionIndex index;
+  if (!index.open(filenames))
+    return 1;
+
+  std::string text;
+  for (const std::string &completion :
+      index.complete(kind, prefix, max_hits)) {
+    text += completion;
+    text += '\n';
+  }
+  OutputFile out;
+  if (!open_output(out, vm))
+    return 1;
+  (out.is_open() ? out : std::cout) << text;
+  return 0;
+}
+
+int run_diff(const po::variables_map &vm)
+{
+  Differ::Format format;
+  std::string name = vm["diff-format"].as<std::string>();
+  if (name == "text")
+    format = Differ::TEXT;
+  else if (name == "jsonl")
+    format = Differ::JSONL;
+  else {
+    std::cerr << Strings::tr(Strings::ERR_UNKNOWN_DIFF_FORMAT) << name << "\n";
+    return 1;
+  }
+  std::vector<std::string> filenames;
+  if (vm.count("input-files"))
+    filenames = vm["input-files"].as< std::vector<std::string> >();
+  if (filenames.size() != 2) {
+    std::cerr << Strings::tr(Strings::ERR_DIFF_INPUT);
+    return 1;
+  }
+  for (const std::string &filename : filenames) {
+    if (!std::ifstream(filename)) {
+      std::cerr << Strings::tr(Strings::ERR_DIFF_OPEN) << filename << "\n";
+      return 1;
+    }
+  }
+
+  // set output file
+  OutputFile out;
+  if (!open_output(out, vm))
+    return 1;
+
+  InputFile old_file(filenames[0]);
+  InputFile new_file(filenames[1]);
+  Differ differ(format, out.is_open() ? out : std::cout);
+  differ.compare(old_file, new_file);
+  return 0;
+}
+
+int run_split(const po::variables_map &vm)
+{
+  // every entry is processed on its own
+  if (vm.count("sort-bib") || !single_entry_actions(vm)) {
+    std::cerr << Strings::tr(Strings::ERR_SPLIT_OPTIONS);
+    return 1;
+  }
+  Transform transform;
+  if (int ret = compile_transforms(transform, vm))
+    return ret;
+
+  std::vector<std::string> filenames;
+  if (vm.count("input-files"))
+    filenames = vm["input-files"].as< std::vector<std::string> >();
+  std::vector<std::string> only;
+  if (vm.count("only"))
+    only = separate_string(vm["only"].as<std::string>());
+
+  // the partition name replaces {} in the output, which is a directory if
+  // it contains no {}
+  std::string pattern = "{}.bib";
+  if (vm.count("output")) {
+    pattern = vm["output"].as<std::string>();
+    if (pattern.find("{}") == std::string::npos)
+      pattern = (std::filesystem::path(pattern) / "{}.bib").string();
+  }
+
+  Splitter splitter([&vm, &transform] (Bibliography &bib) {
+        apply_transforms(bib, vm, transform);
+      }, only, pattern);
+  std::string scheme = vm["split-by"].as<std::string>();
+  if (!splitter.set_scheme(scheme)) {
+    std::cerr << Strings::tr(Strings::ERR_SPLIT_BY) << scheme << "\n";
+    return 1;
+  }
+  if (!splitter.run(filenames))
+    return 1;
+  return report_diagnostics(splitter.get_diagnostics(), vm);
+}
+
+void add_options(po::options_description &visible,
+    po::options_description &hidden, bool help)
+{
+  auto text = [help] (Strings::STR str) -> const char* {
+    return help ? Strings::tr(str) : "";
+  };
+
+  // visible command line options
+  visible.add_options()
+    ("output,o", po::value<std::string>(), text(Strings::OPT_OUTPUT))
+    ("create-keys,c", text(Strings::OPT_CREATE))
+    ("key-template", po::value<std::string>(),
+      text(Strings::OPT_KEY_TEMPLATE))
+    ("only,O", po::value<std::string>(), text(Strings::OPT_ONLY))
+    ("sort-bib,s", po::value<std::string>(), text(Strings::OPT_SORT_BIB))
+    ("sort-elements,S", text(Strings::OPT_SORT_ELEMENTS))
+    ("erase-field,e", po::value<std::string>(), text(Strings::OPT_ERASE_FIELD))
+    ("show-missing,m", po::value<char>()->implicit_value('R'),
+      text(Strings::OPT_SHOW_MISSING))
+    ("missing-fields,M", po::value<std::string>(),
+      text(Strings::OPT_MISSING_FIELDS))
+    ("change-case", po::value<std::string>()->default_value("L"),
+      text(Strings::OPT_CHANGE_CASE))
+    ("linebreak", po::value<unsigned int>(), text(Strings::OPT_LINEBREAK))
+    ("intendation", po::value<std::string>(), text(Strings::OPT_INTENDATION))
+    ("delimiter", po::value<char>(), text(Strings::OPT_DELIMITER))
+    ("align-left", text(Strings::OPT_ALIGN_LEFT))
+    ("abbrev-month", text(Strings::OPT_ABBREV_MONTH))
+    ("abbrev-journal", po::value<std::string>(),
+      text(Strings::OPT_ABBREV_JOURNAL))
+    ("inline-crossref", text(Strings::OPT_INLINE_CROSSREF))
+    ("expand-macros", text(Strings::OPT_EXPAND_MACROS))
+    ("schema", po::value< std::vector<std::string> >()->composing(),
+      text(Strings::OPT_SCHEMA))
+    ("edit", po::value< std::vector<std::string> >()->composing(),
+      text(Strings::OPT_EDIT))
+    ("new-entry,n", text(Strings::OPT_NEW_ENTRY))
+    ("find-duplicates", po::value<double>()->implicit_value(0.8, "0.8"),
+      text(Strings::OPT_FIND_DUPLICATES))
+    ("merge", po::value<std::string>(), text(Strings::OPT_MERGE))
+    ("merge-report", po::value<std::string>(), text(Strings::OPT_MERGE_REPORT))
+    ("compact", text(Strings::OPT_COMPACT))
+    ("max-memory", po::value<unsigned int>(), text(Strings::OPT_MAX_MEMORY))
+    ("pipeline", text(Strings::OPT_PIPELINE))
+    ("watch", text(Strings::OPT_WATCH))
+    ("export", po::value<std::string>(), text(Strings::OPT_EXPORT))
+    ("build-index", text(Strings::OPT_BUILD_INDEX))
+    ("search", po::value<std::string>(), text(Strings::OPT_SEARCH))
+    ("complete", po::value<std::string>(), text(Strings::OPT_COMPLETE))
+    ("diff", text(Strings::OPT_DIFF))
+    ("diff-format", po::value<std::string>()->default_value("text"),
+      text(Strings::OPT_DIFF_FORMAT))
+    ("split-by", po::value<std::string>(), text(Strings::OPT_SPLIT_BY))
+    ("diagnostics", po::value<std::string>(), text(Strings::OPT_DIAGNOSTICS))
+    ("max-warnings", po::value<unsigned int>()->default_value(10),
+      text(Strings::OPT_MAX_WARNINGS))
+    ("help", text(Strings::OPT_HELP))
+    ("version", text(Strings::OPT_VERSION))
+  ;
+
+  // hidden command line options
+  hidden.add_options()
+    ("input-files", po::value< std::vector<std::string> >(),
+      text(Strings::OPT_INPUT))
+  ;
 }
 
 int main(int argc, char* argv[])
 {
   try {
-    // set language
-    localize_strings();
-
-    // visible command line options
-    po::options_description visible(Strings::tr(Strings::OPT_USAGE));
-    visible.add_options()
-      ("output,o", po::value<std::string>(),
-        Strings::tr(Strings::OPT_OUTPUT).c_str())
-      ("create-keys,c", Strings::tr(Strings::OPT_CREATE).c_str())
-      ("only,O", po::value<std::string>(),
-        Strings::tr(Strings::OPT_ONLY).c_str())
-      ("sort-bib,s", po::value<std::string>(),
-        Strings::tr(Strings::OPT_SORT_BIB).c_str())
-      ("sort-elements,S", Strings::tr(Strings::OPT_SORT_ELEMENTS).c_str())
-      ("erase-field,e", po::value<std::string>(),
-        Strings::tr(Strings::OPT_ERASE_FIELD).c_str())
-      ("show-missing,m", po::value<char>()->implicit_value('R'),
-        Strings::tr(Strings::OPT_SHOW_MISSING).c_str())
-      ("missing-fields,M", po::value<std::string>(),
-        Strings::tr(Strings::OPT_MISSING_FIELDS).c_str())
-      ("change-case", po::value<std::string>()->default_value("L"),
-        Strings::tr(Strings::OPT_CHANGE_CASE).c_str())
-      ("linebreak", po::value<unsigned int>(),
-        Strings::tr(Strings::OPT_LINEBREAK).c_str())
-      ("intendation", po::value<std::string>(),
-        Strings::tr(Strings::OPT_INTENDATION).c_str())
-      ("delimiter", po::value<char>(),
-        Strings::tr(Strings::OPT_DELIMITER).c_str())
-      ("align-left", Strings::tr(Strings::OPT_ALIGN_LEFT).c_str())
-      ("abbrev-month", Strings::tr(Strings::OPT_ABBREV_MONTH).c_str())
-      ("new-entry,n", Strings::tr(Strings::OPT_NEW_ENTRY).c_str())
-      ("help", Strings::tr(Strings::OPT_HELP).c_str())
-      ("version", Strings::tr(Strings::OPT_VERSION).c_str())
-    ;
-
-    // hidden command line options
-    po::options_description hidden;
-    hidden.add_options()
-      ("input-files", po::value< std::vector<std::string> >(),
-        Strings::tr(Strings::OPT_INPUT).c_str())
-    ;
+    // command line options, the descriptions are only translated for --help
+    po::options_description visible, hidden;
+    add_options(visible, hidden, false);
+
     // positional options are interpreted as input-file
     po::positional_options_description pod;
     pod.add("input-files", -1);
@@ -117,7 +890,10 @@ int main(int argc, char* argv[])
 
     // help message
     if (vm.count("help")) {
-      std::cout << visible << "\n";
+      po::options_description described(Strings::tr(Strings::OPT_USAGE));
+      po::options_description unused;
+      add_options(described, unused, true);
+      std::cout << described << "\n";
       return 0;
     }
 
@@ -127,97 +903,120 @@ int main(int argc, char* argv[])
       return 0;
     }
 
+    // stream the entries in a machine readable format
+    if (vm.count("export"))
+      return run_export(vm);
+
+    // write or query the search and completion indexes of the input files
+    if (vm.count("build-index"))
+      return run_build_index(vm);
+    if (vm.count("search"))
+      return run_search(vm);
+    if (vm.count("complete"))
+      return run_complete(vm);
+
+    // compare two versions of a bibliography
+    if (vm.count("diff"))
+      return run_diff(vm);
+
+    // write the entries to the files of their partitions
+    if (vm.count("split-by"))
+      return run_split(vm);
+
+    // sort in batches if the memory is limited and all other actions work on
+    // single entries
+    if (vm.count("max-memory") && vm.count("sort-bib") &&
+        single_entry_actions(vm))
+      return external_sort(vm);
+
+    // process the input in concurrent stages
+    if (vm.count("pipeline") && !vm.count("sort-bib") &&
+        single_entry_actions(vm))
+      return run_pipeline(vm);
+
+    // reformat the input files after every change
+    if (vm.count("watch"))
+      return run_watch(vm);
+
     // create empty Bibliography
     Bibliography bib;
+    if (vm.count("compact"))
+      bib.use_compact_storage();
+
+    // merge policy
+    if (vm.count("merge")) {
+      std::string policy = vm["merge"].as<std::string>();
+      if (policy == "first")
+        bib.set_merge_policy('F');
+      else if (policy == "newest")
+        bib.set_merge_policy('N');
+      else if (policy == "union")
+        bib.set_merge_policy('U');
+      else {
+        std::cerr << Strings::tr(Strings::ERR_UNKNOWN_MERGE_POLICY)
+          << policy << "\n";
+        return 1;
+      }
+    }
+
+    // required and optional fields of the types
+    if (int ret = load_schemas(bib, vm))
+      return ret;
+
+    // per-entry transformations, the options are checked before reading
+    Transform transform;
+    if (int ret = compile_transforms(transform, vm))
+      return ret;
+
+    // skip the fields that are neither printed nor checked
+    set_projection(bib, vm, transform);
 
     // input file
     if (vm.count("input-files")) {
       std::vector<std::string> filenames =
         vm["input-files"].as< std::vector<std::string> >();
-      for (std::string &filename : filenames) {
-        std::ifstream bibFile(filename.c_str());
-        bib.add(bibFile);
-        bibFile.close();
+      if (vm.count("merge")) {
+        // read the newest file last
+        if (vm["merge"].as<std::string>() == "newest")
+          std::stable_sort(filenames.begin(), filenames.end(),
+              [] (const std::string &f1, const std::string &f2) -> bool {
+                return modification_time(f1) < modification_time(f2);
+              });
+        for (std::string &filename : filenames) {
+          InputFile bibFile(filename);
+          bib.merge(bibFile, filename);
+        }
+        // write conflict report
+        if (vm.count("merge-report")) {
+          std::ofstream report(vm["merge-report"].as<std::string>());
+          bib.write_merge_report(report);
+        }
+        else
+          bib.write_merge_report(std::cerr);
+      }
+      else {
+        for (std::string &filename : filenames) {
+          InputFile bibFile(filename);
+          bib.add(bibFile, filename);
+        }
       }
     }
     else if (vm.count("new-entry")) {
       bib.create_entry();
     }
     else {
-      bib.add(std::cin);
+      InputFile in;
+      bib.add(in);
     }
 
     // set output file
-    std::ofstream out;
-    if (vm.count("output")) {
-      out.open(vm["output"].as<std::string>());
-    }
-
-    // change case of field ids
-    if (vm.count("change-case")) {
-      std::string cases = vm["change-case"].as<std::string>();
-      if (cases.length() == 1)
-        bib.change_case(cases[0], cases[0]);
-      else if (cases.length() == 2)
-        bib.change_case(cases[0], cases[1]);
-      else {
-        std::cerr << Strings::tr(Strings::ERR_CHANGE_CASE);
-        return 1;
-      }
-    }
-
-    // linebreak
-    if (vm.count("linebreak"))
-      bib.set_linebreak(vm["linebreak"].as<unsigned int>());
-
-    // intendation
-    if (vm.count("intendation"))
-      bib.set_intendation(vm["intendation"].as<std::string>());
-
-    // delimiter
-    if (vm.count("delimiter")) {
-      char delim = vm["delimiter"].as<char>();
-      if ((delim == '{') || (delim == '}'))
-        bib.set_field_delimiter('{', '}');
-      else if (delim == '"')
-        bib.set_field_delimiter('"', '"');
-      else
-        std::cerr << Strings::tr(Strings::ERR_DELIMITER) << delim << "\n";
-    }
-
-    // alignment
-    if (vm.count("align-left")) {
-      bool right_aligned = false;
-      bib.set_alignment(right_aligned);
-    }
-
-    // abbreviate months
-    if (vm.count("abbrev-month"))
-      bib.abbreviate_month();
+    OutputFile out;
+    if (!open_output(out, vm))
+      return 1;
 
-    // erase fields
-    if (vm.count("erase-field")) {
-      std::vector<std::string> erase_vec =
-        separate_string(vm["erase-field"].as<std::string>());
-      for (const std::string &erase : erase_vec)
-        bib.erase_field(erase);
-    }
-
-    // sort bibliography
-    if (vm.count("sort-bib")) {
-      std::vector<std::string> sort =
-        separate_string( vm["sort-bib"].as<std::string>() );
-      bib.sort_bib(sort);
-    }
-
-    // sort elements
-    if (vm.count("sort-elements")) {
-      bib.sort_elements();
-    }
-
-    // create keys
-    if (vm.count("create-keys"))
-      bib.create_keys();
+    // apply all transformations and formatting options
+    if (int ret = apply_transforms(bib, vm, transform))
+      return ret;
 
     // show missing fields
     if (vm.count("show-missing")) {
@@ -226,7 +1025,17 @@ int main(int argc, char* argv[])
       if (mode == 'O')
         only_required = false;
       bib.show_missing_fields(only_required);
-      return 0;
+      return report_diagnostics(bib.get_diagnostics(), vm);
+    }
+
+    // show clusters of probable duplicates
+    if (vm.count("find-duplicates")) {
+      double threshold = vm["find-duplicates"].as<double>();
+      if (out.is_open())
+        bib.find_duplicates(threshold, out);
+      else
+        bib.find_duplicates(threshold, std::cout);
+      return report_diagnostics(bib.get_diagnostics(), vm);
     }
 
     // show user defined missing fields
@@ -234,7 +1043,7 @@ int main(int argc, char* argv[])
       std::vector<std::string> fields =
         separate_string( vm["missing-fields"].as<std::string>() );
       bib.show_missing_fields(fields);
-      return 0;
+      return report_diagnostics(bib.get_diagnostics(), vm);
     }
 
     // print only given fields
@@ -246,7 +1055,7 @@ int main(int argc, char* argv[])
       else
         bib.print_bib(only, std::cout);
 
-      return 0;
+      return report_diagnostics(bib.get_diagnostics(), vm);
     }
 
     // standard action, print bib
@@ -259,6 +1068,9 @@ int main(int argc, char* argv[])
     if (out.is_open())
       out.close();
 
+    // warnings after the output
+    return report_diagnostics(bib.get_diagnostics(), vm);
+
   }
   catch(std::exception& e) {
     std::cerr << "error: " << e.what() << "\n";
@@ -21,13 +21,100 @@
 #ifndef BIBF_H
 #define BIBF_H
 
+#include <ctime>
+#include <fstream>
 #include <string>
 #include <vector>
+#include <boost/program_options.hpp>
+
+// Forward declaration of user-defined types
+class bibEntry;
+class Bibliography;
+class Diagnostics;
+class OutputFile;
+class Transform;
 
 // Converts a string with comma separated parts into a vector
 std::vector<std::string> separate_string(std::string s);
 
-// Localize the output
-void localize_strings();
+// Returns the time of the last modification of 'filename'
+time_t modification_time(const std::string &filename);
+
+// Add the command line options to 'visible' and 'hidden', the descriptions
+// are only translated if 'help' is true
+void add_options(boost::program_options::options_description &visible,
+    boost::program_options::options_description &hidden, bool help);
+
+// Compile the per-entry transformations given in 'vm' into 'transform',
+// returns the exit code if an option is invalid and 0 otherwise
+int compile_transforms(Transform &transform,
+    const boost::program_options::variables_map &vm);
+
+// Apply the transformations and formatting options given in 'vm' to 'bib',
+// the per-entry transformations are compiled in 'transform'
+int apply_transforms(Bibliography &bib,
+    const boost::program_options::variables_map &vm,
+    const Transform &transform);
+
+// Returns true if all actions in 'vm' except sorting work on single entries
+bool single_entry_actions(const boost::program_options::variables_map &vm);
+
+// Load the schema files given in 'vm' into 'bib', returns the exit code if
+// a file cannot be read and 0 otherwise
+int load_schemas(Bibliography &bib,
+    const boost::program_options::variables_map &vm);
+
+// Parse only the fields needed by the options in 'vm' and the key scheme of
+// 'transform' if the output is a report or a subset of the fields
+void set_projection(Bibliography &bib,
+    const boost::program_options::variables_map &vm,
+    const Transform &transform);
+
+// Print the warnings in 'diagnostics' and write the report given in 'vm',
+// returns the exit code if the report cannot be written and 0 otherwise
+int report_diagnostics(const Diagnostics &diagnostics,
+    const boost::program_options::variables_map &vm);
+
+// Open the file given by --output in 'vm' into 'out', returns false if it
+// cannot be written. Without --output 'out' stays closed and the caller
+// writes to std::cout.
+bool open_output(OutputFile &out,
+    const boost::program_options::variables_map &vm);
+
+// Open a new temporary file for reading and writing
+bool open_temporary(std::fstream &file);
+
+// Sort the input in batches of the size given by --max-memory, write the
+// sorted batches to temporary files and merge them into the output
+int external_sort(const boost::program_options::variables_map &vm);
+
+// Read, parse, transform and print the input in concurrent threads
+int run_pipeline(const boost::program_options::variables_map &vm);
+
+// Write the input as JSON Lines or TSV
+int run_export(const boost::program_options::variables_map &vm);
+
+// Copy the fields of 'parent' that 'bEn' inherits through crossref into
+// 'bEn'
+void inherit_fields(bibEntry &bEn, const bibEntry &parent);
+
+// Print the input files again after every change
+int run_watch(const boost::program_options::variables_map &vm);
+
+// Write the search and completion indexes of every input file
+int run_build_index(const boost::program_options::variables_map &vm);
+
+// Print the entries of the input files that match the --search query best
+int run_search(const boost::program_options::variables_map &vm);
+
+// Print the most frequent completions of a prefix of keys, authors or
+// journals
+int run_complete(const boost::program_options::variables_map &vm);
+
+// Print the differences between the two input files
+int run_diff(const boost::program_options::variables_map &vm);
+
+// Write the entries of the input files to the files of their partitions
+int run_split(const boost::program_options::variables_map &vm);
 
 #endif